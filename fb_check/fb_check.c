@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fb_kernels.h"
+
+// Every count from 0 to MAX_COUNT is run, covering each tail after the 16, 8 and 4 pixel loops
+#define MAX_COUNT 70
+
+// Pixels kept around each buffer, a kernel writing past its row changes them
+#define GUARD 16
+
+// Rows started this many pixels past the start of the buffer, to move them across vector alignments
+#define OFFSETS 4
+
+// Largest rectangle filled
+#define MAX_WIDTH 21
+#define MAX_HEIGHT 4
+
+#define BUFFER_PX (GUARD + OFFSETS + MAX_COUNT + GUARD)
+#define RECT_PX (GUARD + MAX_HEIGHT * (MAX_WIDTH + OFFSETS) + GUARD)
+
+// The plain C fallback, fb_kernels.c built again with FB_KERNELS_SCALAR and its functions renamed
+const char *scalar_kernels_name(void);
+void scalar_fill_span(uint32_t *dst, int count, uint32_t color);
+void scalar_fill_rect(uint32_t *dst, int stride_px, int width, int height, uint32_t color);
+void scalar_copy_row(uint32_t *dst, const uint32_t *src, int count);
+void scalar_copy_row_key(uint32_t *dst, const uint32_t *src, int count, uint32_t key);
+
+static uint32_t key_color = 0xff00ff00;
+
+// random pixels, about one in every keyed of them the key color
+static void random_pixels(uint32_t *px, int count, int keyed)
+{
+    for (int i = 0; i < count; i++)
+    {
+        px[i] = keyed && rand() % keyed == 0 ? key_color : (uint32_t)rand() * 2654435761u;
+    }
+}
+
+// 1 if both buffers are the same, printing the first pixel that is not
+static int same(const char *kernel, const uint32_t *got, const uint32_t *expected, int px, int count, int offset)
+{
+    for (int i = 0; i < px; i++)
+    {
+        if (got[i] != expected[i])
+        {
+            printf("%s count %d offset %d: pixel %d is %08x, scalar wrote %08x\n", kernel, count, offset,
+                   i - GUARD - offset, got[i], expected[i]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// 1 if the compiled in kernels write exactly what the scalar ones do for every count and offset
+static int check_rows()
+{
+    uint32_t got[BUFFER_PX], expected[BUFFER_PX], src[BUFFER_PX];
+    unsigned long cases = 0, failed = 0;
+
+    for (int count = 0; count <= MAX_COUNT; count++)
+    {
+        for (int offset = 0; offset < OFFSETS; offset++)
+        {
+            int const start = GUARD + offset;
+            uint32_t const color = (uint32_t)rand();
+
+            random_pixels(got, BUFFER_PX, 0);
+            memcpy(expected, got, sizeof(got));
+            fb_fill_span(got + start, count, color);
+            scalar_fill_span(expected + start, count, color);
+            failed += !same("fb_fill_span", got, expected, BUFFER_PX, count, offset);
+
+            random_pixels(got, BUFFER_PX, 0);
+            memcpy(expected, got, sizeof(got));
+            random_pixels(src, BUFFER_PX, 0);
+            fb_copy_row(got + start, src + start, count);
+            scalar_copy_row(expected + start, src + start, count);
+            failed += !same("fb_copy_row", got, expected, BUFFER_PX, count, offset);
+
+            // all keyed, none keyed and mixed rows
+            for (int keyed = 0; keyed <= 3; keyed++)
+            {
+                random_pixels(got, BUFFER_PX, 0);
+                memcpy(expected, got, sizeof(got));
+                random_pixels(src, BUFFER_PX, keyed);
+                fb_copy_row_key(got + start, src + start, count, key_color);
+                scalar_copy_row_key(expected + start, src + start, count, key_color);
+                failed += !same("fb_copy_row_key", got, expected, BUFFER_PX, count, offset);
+            }
+            cases += 6;
+        }
+    }
+
+    printf("%s: rows of 0 to %d pixels at %d offsets, %lu cases, %lu differ from scalar\n", fb_kernels_name(),
+           MAX_COUNT, OFFSETS, cases, failed);
+    return failed == 0;
+}
+
+// 1 if fb_fill_rect writes what the scalar one does, with rows as wide as the stride or narrower
+static int check_rects()
+{
+    uint32_t got[RECT_PX], expected[RECT_PX];
+    unsigned long cases = 0, failed = 0;
+
+    for (int width = 0; width <= MAX_WIDTH; width++)
+    {
+        for (int height = 0; height <= MAX_HEIGHT; height++)
+        {
+            for (int pad = 0; pad < OFFSETS; pad++)
+            {
+                uint32_t const color = (uint32_t)rand();
+
+                random_pixels(got, RECT_PX, 0);
+                memcpy(expected, got, sizeof(got));
+                fb_fill_rect(got + GUARD, width + pad, width, height, color);
+                scalar_fill_rect(expected + GUARD, width + pad, width, height, color);
+                failed += !same("fb_fill_rect", got, expected, RECT_PX, width * height, pad);
+                cases++;
+            }
+        }
+    }
+
+    printf("%s: rects up to %dx%d with %d strides, %lu cases, %lu differ from scalar\n", fb_kernels_name(), MAX_WIDTH,
+           MAX_HEIGHT, OFFSETS, cases, failed);
+    return failed == 0;
+}
+
+int main()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (strcmp(fb_kernels_name(), "avx2") == 0 && !__builtin_cpu_supports("avx2"))
+    {
+        printf("avx2: not supported by this cpu, skipped\n");
+        return EXIT_SUCCESS;
+    }
+#endif
+
+    srand(1);
+    int ok = check_rows();
+    ok &= check_rects();
+    ok &= strcmp(scalar_kernels_name(), "scalar") == 0;
+
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,43 @@
+/*
+ * Host stand-in for <arm_neon.h>, with only the intrinsics fb_kernels.c uses, so its NEON path can be run on x86.
+ * Lanes are a GCC vector, loads and stores are unaligned like vld1q/vst1q.
+ */
+
+#ifndef FB_CHECK_ARM_NEON_H
+#define FB_CHECK_ARM_NEON_H
+
+#include <stdint.h>
+#include <string.h>
+
+typedef uint32_t uint32x4_t __attribute__((vector_size(16)));
+
+static inline uint32x4_t vdupq_n_u32(uint32_t value)
+{
+    return (uint32x4_t){value, value, value, value};
+}
+
+static inline uint32x4_t vld1q_u32(const uint32_t *ptr)
+{
+    uint32x4_t v;
+    memcpy(&v, ptr, sizeof(v));
+    return v;
+}
+
+static inline void vst1q_u32(uint32_t *ptr, uint32x4_t v)
+{
+    memcpy(ptr, &v, sizeof(v));
+}
+
+// all ones in the lanes that are equal
+static inline uint32x4_t vceqq_u32(uint32x4_t a, uint32x4_t b)
+{
+    return (uint32x4_t)(a == b);
+}
+
+// bits of a where mask is set, of b elsewhere
+static inline uint32x4_t vbslq_u32(uint32x4_t mask, uint32x4_t a, uint32x4_t b)
+{
+    return (mask & a) | (~mask & b);
+}
+
+#endif
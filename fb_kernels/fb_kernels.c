@@ -0,0 +1,269 @@
+#include <string.h>
+
+#include "public/fb_kernels.h"
+
+// FB_KERNELS_SCALAR forces the plain C fallback, fb_check compares the others
+// against it
+#if defined(FB_KERNELS_SCALAR)
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FB_KERNELS_NEON
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define FB_KERNELS_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define FB_KERNELS_SSE2
+#endif
+
+#if defined(FB_KERNELS_NEON)
+
+const char *fb_kernels_name(void)
+{
+    return "neon";
+}
+
+void fb_fill_span(uint32_t *dst, int count, uint32_t color)
+{
+    uint32x4_t const v = vdupq_n_u32(color);
+    int i = 0;
+
+    // 64 bytes per iteration, a full cache line on the Cortex-A72
+    for (; i + 16 <= count; i += 16)
+    {
+        vst1q_u32(dst + i, v);
+        vst1q_u32(dst + i + 4, v);
+        vst1q_u32(dst + i + 8, v);
+        vst1q_u32(dst + i + 12, v);
+    }
+    for (; i + 4 <= count; i += 4)
+    {
+        vst1q_u32(dst + i, v);
+    }
+    for (; i < count; i++)
+    {
+        dst[i] = color;
+    }
+}
+
+void fb_copy_row(uint32_t *dst, const uint32_t *src, int count)
+{
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        uint32x4_t const v0 = vld1q_u32(src + i);
+        uint32x4_t const v1 = vld1q_u32(src + i + 4);
+        uint32x4_t const v2 = vld1q_u32(src + i + 8);
+        uint32x4_t const v3 = vld1q_u32(src + i + 12);
+        vst1q_u32(dst + i, v0);
+        vst1q_u32(dst + i + 4, v1);
+        vst1q_u32(dst + i + 8, v2);
+        vst1q_u32(dst + i + 12, v3);
+    }
+    for (; i + 4 <= count; i += 4)
+    {
+        vst1q_u32(dst + i, vld1q_u32(src + i));
+    }
+    for (; i < count; i++)
+    {
+        dst[i] = src[i];
+    }
+}
+
+void fb_copy_row_key(uint32_t *dst, const uint32_t *src, int count, uint32_t key)
+{
+    uint32x4_t const k = vdupq_n_u32(key);
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        uint32x4_t const s = vld1q_u32(src + i);
+        uint32x4_t const d = vld1q_u32(dst + i);
+        // keep dst where src matches the key
+        vst1q_u32(dst + i, vbslq_u32(vceqq_u32(s, k), d, s));
+    }
+    for (; i < count; i++)
+    {
+        if (src[i] != key)
+        {
+            dst[i] = src[i];
+        }
+    }
+}
+
+#elif defined(FB_KERNELS_AVX2)
+
+const char *fb_kernels_name(void)
+{
+    return "avx2";
+}
+
+void fb_fill_span(uint32_t *dst, int count, uint32_t color)
+{
+    __m256i const v = _mm256_set1_epi32((int)color);
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        _mm256_storeu_si256((__m256i *)(dst + i), v);
+        _mm256_storeu_si256((__m256i *)(dst + i + 8), v);
+    }
+    for (; i + 8 <= count; i += 8)
+    {
+        _mm256_storeu_si256((__m256i *)(dst + i), v);
+    }
+    for (; i < count; i++)
+    {
+        dst[i] = color;
+    }
+}
+
+void fb_copy_row(uint32_t *dst, const uint32_t *src, int count)
+{
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_loadu_si256((__m256i const *)(src + i)));
+    }
+    for (; i < count; i++)
+    {
+        dst[i] = src[i];
+    }
+}
+
+void fb_copy_row_key(uint32_t *dst, const uint32_t *src, int count, uint32_t key)
+{
+    __m256i const k = _mm256_set1_epi32((int)key);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i const s = _mm256_loadu_si256((__m256i const *)(src + i));
+        __m256i const d = _mm256_loadu_si256((__m256i const *)(dst + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_blendv_epi8(s, d, _mm256_cmpeq_epi32(s, k)));
+    }
+    for (; i < count; i++)
+    {
+        if (src[i] != key)
+        {
+            dst[i] = src[i];
+        }
+    }
+}
+
+#elif defined(FB_KERNELS_SSE2)
+
+const char *fb_kernels_name(void)
+{
+    return "sse2";
+}
+
+void fb_fill_span(uint32_t *dst, int count, uint32_t color)
+{
+    __m128i const v = _mm_set1_epi32((int)color);
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        _mm_storeu_si128((__m128i *)(dst + i), v);
+        _mm_storeu_si128((__m128i *)(dst + i + 4), v);
+        _mm_storeu_si128((__m128i *)(dst + i + 8), v);
+        _mm_storeu_si128((__m128i *)(dst + i + 12), v);
+    }
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_si128((__m128i *)(dst + i), v);
+    }
+    for (; i < count; i++)
+    {
+        dst[i] = color;
+    }
+}
+
+void fb_copy_row(uint32_t *dst, const uint32_t *src, int count)
+{
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_loadu_si128((__m128i const *)(src + i)));
+    }
+    for (; i < count; i++)
+    {
+        dst[i] = src[i];
+    }
+}
+
+void fb_copy_row_key(uint32_t *dst, const uint32_t *src, int count, uint32_t key)
+{
+    __m128i const k = _mm_set1_epi32((int)key);
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i const s = _mm_loadu_si128((__m128i const *)(src + i));
+        __m128i const d = _mm_loadu_si128((__m128i const *)(dst + i));
+        __m128i const m = _mm_cmpeq_epi32(s, k);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(_mm_and_si128(m, d), _mm_andnot_si128(m, s)));
+    }
+    for (; i < count; i++)
+    {
+        if (src[i] != key)
+        {
+            dst[i] = src[i];
+        }
+    }
+}
+
+#else
+
+const char *fb_kernels_name(void)
+{
+    return "scalar";
+}
+
+void fb_fill_span(uint32_t *dst, int count, uint32_t color)
+{
+    for (int i = 0; i < count; i++)
+    {
+        dst[i] = color;
+    }
+}
+
+void fb_copy_row(uint32_t *dst, const uint32_t *src, int count)
+{
+    if (count > 0)
+    {
+        memcpy(dst, src, count * sizeof(uint32_t));
+    }
+}
+
+void fb_copy_row_key(uint32_t *dst, const uint32_t *src, int count, uint32_t key)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (src[i] != key)
+        {
+            dst[i] = src[i];
+        }
+    }
+}
+
+#endif
+
+void fb_fill_rect(uint32_t *dst, int stride_px, int width, int height, uint32_t color)
+{
+    // rows that cover the whole stride are contiguous, fill them in one go
+    if (width == stride_px)
+    {
+        fb_fill_span(dst, width * height, color);
+        return;
+    }
+
+    for (int i = 0; i < height; i++, dst += stride_px)
+    {
+        fb_fill_span(dst, width, color);
+    }
+}
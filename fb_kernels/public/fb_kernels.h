@@ -0,0 +1,69 @@
+#ifndef FB_KERNELS_H
+#define FB_KERNELS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Pixel kernels for 32-bit software framebuffers.
+ *
+ * The implementation is picked at compile time: NEON on aarch64, AVX2 or SSE2
+ * on x86 (for host testing), and a plain C fallback everywhere else or when
+ * FB_KERNELS_SCALAR is defined.
+ * Buffers do not need any particular alignment.
+ */
+
+/**
+ * Name of the implementation compiled in.
+ *
+ * @returns  "neon", "avx2", "sse2" or "scalar"
+ */
+const char *fb_kernels_name(void);
+
+/**
+ * Fill a horizontal span with a solid color.
+ *
+ * @param    dst     first pixel of the span
+ * @param    count   number of pixels
+ * @param    color   pixel value
+ */
+void fb_fill_span(uint32_t *dst, int count, uint32_t color);
+
+/**
+ * Fill a rectangle with a solid color.
+ *
+ * @param    dst        top left pixel of the rectangle
+ * @param    stride_px  distance between rows, in pixels
+ * @param    width      rectangle width in pixels
+ * @param    height     rectangle height in pixels
+ * @param    color      pixel value
+ */
+void fb_fill_rect(uint32_t *dst, int stride_px, int width, int height, uint32_t color);
+
+/**
+ * Copy a row of pixels.
+ *
+ * @param    dst     destination row
+ * @param    src     source row, must not overlap dst
+ * @param    count   number of pixels
+ */
+void fb_copy_row(uint32_t *dst, const uint32_t *src, int count);
+
+/**
+ * Copy a row of pixels, skipping every source pixel equal to the key color.
+ *
+ * @param    dst     destination row
+ * @param    src     source row, must not overlap dst
+ * @param    count   number of pixels
+ * @param    key     transparent color, left untouched in dst
+ */
+void fb_copy_row_key(uint32_t *dst, const uint32_t *src, int count, uint32_t key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
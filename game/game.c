@@ -0,0 +1,190 @@
+#include <stddef.h>
+
+#include "public/game.h"
+
+void game_reset(GameState *state) {
+  for (int i = 0; i < 2; i++) {
+    Player *p = &state->players[i];
+    p->x = (1 + 2 * i) * WINDOW_WIDTH / 4 - PLAYER_WIDTH / 2;
+    p->hitting = 0;
+    p->hp = MAX_HP;
+    p->hp_dirty = 1;
+    p->state = ON_NORMAL_CD;
+    p->cooldown_ms = 0;
+  }
+}
+
+static void tick(Player *p) {
+  if (p->cooldown_ms <= GAME_CLOCK_DELAY) {
+    p->cooldown_ms = 0;
+    p->state = ON_NORMAL_CD;
+  } else {
+    p->cooldown_ms -= GAME_CLOCK_DELAY;
+  }
+}
+
+static void move_player_left(Player *p) {
+  if (p->x <= MOVEMENT_SPEED) {
+    p->x = MOVEMENT_SPEED;
+    return;
+  }
+
+  p->x -= MOVEMENT_SPEED;
+}
+
+static void move_player_right(Player *p) {
+  if (p->x >= WINDOW_WIDTH - (PLAYER_WIDTH + MOVEMENT_SPEED)) {
+    p->x = WINDOW_WIDTH - (PLAYER_WIDTH + MOVEMENT_SPEED);
+    return;
+  }
+
+  p->x += MOVEMENT_SPEED;
+}
+
+static int is_in_swing_range(const Player *attacker, const Player *defender) {
+  int distance = 0;
+  // if attacker is on the right of defender
+  if (attacker->x >= defender->x) {
+    int d = attacker->x - defender->x;
+    // avoid negatives if they're in one-another
+    if (d < PLAYER_WIDTH / 2)
+      return 1;
+    distance = d - PLAYER_WIDTH / 2;
+  } else {
+    int d = defender->x - attacker->x;
+    if (d < PLAYER_WIDTH / 2)
+      return 1;
+    distance = d - PLAYER_WIDTH / 2;
+  }
+
+  if (distance < ATTACK_RADIUS)
+    return 1;
+  return 0;
+}
+
+void game_step(const GameState *prev, const unsigned actions[2],
+               GameState *next) {
+  Player *p = next->players;
+  *next = *prev;
+
+  for (int i = 0; i < 2; i++) {
+    tick(&p[i]);
+    // holding both directions stands still
+    unsigned move = actions[i] & (ACTION_LEFT | ACTION_RIGHT);
+    if (move == ACTION_LEFT)
+      move_player_left(&p[i]);
+    else if (move == ACTION_RIGHT)
+      move_player_right(&p[i]);
+  }
+
+  // every decision below is made against this state, results only go to next
+  GameState before = *next;
+  const Player *b = before.players;
+
+  // what each player does this tick, parrying wins over attacking
+  unsigned intent[2];
+  for (int i = 0; i < 2; i++) {
+    intent[i] = 0;
+    if (b[i].cooldown_ms != 0)
+      continue;
+    if (actions[i] & ACTION_PARRY)
+      intent[i] = ACTION_PARRY;
+    else if (actions[i] & ACTION_ATTACK)
+      intent[i] = ACTION_ATTACK;
+  }
+
+  for (int i = 0; i < 2; i++) {
+    if (intent[i] == ACTION_PARRY) {
+      p[i].cooldown_ms = PARRY_CD;
+      p[i].state = ON_PARRY_CD;
+    } else if (intent[i] == ACTION_ATTACK) {
+      p[i].hitting = 1;
+      p[i].cooldown_ms = ATTACK_CD;
+      p[i].state = ON_ATTACK_CD;
+    }
+  }
+
+  // attacks landing on player i
+  for (int i = 0; i < 2; i++) {
+    int j = 1 - i;
+    if (intent[j] != ACTION_ATTACK || is_in_swing_range(&b[j], &b[i]) == 0)
+      continue;
+
+    // an action started this tick counts as much as one already running
+    int guard = b[i].state;
+    if (intent[i] == ACTION_PARRY)
+      guard = ON_PARRY_CD;
+    else if (intent[i] == ACTION_ATTACK)
+      guard = ON_ATTACK_CD;
+
+    switch (guard) {
+    case ON_PARRY_CD:
+      p[j].cooldown_ms = PARRY_COUNTER_CD;
+      break;
+    case ON_NORMAL_CD:
+      p[i].hp--;
+      p[i].hp_dirty = 1;
+      p[i].state = ON_HIT_CD;
+      p[i].cooldown_ms = HIT_CD;
+      break;
+    case ON_ATTACK_CD:
+      // covers both players attacking at once, the trade hurts both
+      p[i].hp--;
+      p[i].hp_dirty = 1;
+      p[i].state = ON_HIT_CD;
+      if (p[i].cooldown_ms <= HIT_CD)
+        p[i].cooldown_ms = HIT_CD;
+      break;
+    case ON_HIT_CD:
+      break;
+    }
+  }
+
+  if (p[0].hp <= 0 || p[1].hp <= 0)
+    game_reset(next);
+}
+
+// fields of a player that make up the simulation state
+static const struct {
+  const char *name;
+  size_t offset;
+} player_fields[] = {
+    {"x", offsetof(Player, x)},
+    {"hp", offsetof(Player, hp)},
+    {"state", offsetof(Player, state)},
+    {"cooldown_ms", offsetof(Player, cooldown_ms)},
+};
+
+#define PLAYER_FIELDS (sizeof(player_fields) / sizeof(player_fields[0]))
+
+static int player_field(const Player *p, int f) {
+  return *(const int *)((const char *)p + player_fields[f].offset);
+}
+
+uint64_t game_hash(uint64_t prev, const GameState *state) {
+  uint64_t hash = prev;
+  for (int i = 0; i < 2; i++) {
+    for (unsigned f = 0; f < PLAYER_FIELDS; f++) {
+      hash ^= (uint32_t)player_field(&state->players[i], f);
+      hash *= 0x9e3779b97f4a7c15ull;
+      hash ^= hash >> 29;
+    }
+  }
+  return hash;
+}
+
+int game_diff(const GameState *a, const GameState *b, FILE *out) {
+  int diffs = 0;
+  for (int i = 0; i < 2; i++) {
+    for (unsigned f = 0; f < PLAYER_FIELDS; f++) {
+      int va = player_field(&a->players[i], f);
+      int vb = player_field(&b->players[i], f);
+      if (va == vb)
+        continue;
+      fprintf(out, "  players[%d].%s: %d != %d\n", i, player_fields[f].name,
+              va, vb);
+      diffs++;
+    }
+  }
+  return diffs;
+}
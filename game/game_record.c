@@ -0,0 +1,63 @@
+#include <errno.h>
+
+#include "public/game_record.h"
+
+void game_record_header(GameRecordHeader *header, uint32_t seed) {
+  header->magic = GAME_RECORD_MAGIC;
+  header->version = GAME_RECORD_VERSION;
+  header->seed = seed;
+  header->tick_ms = GAME_CLOCK_DELAY;
+  header->max_hp = MAX_HP;
+  header->movement_speed = MOVEMENT_SPEED;
+  header->attack_radius = ATTACK_RADIUS;
+  header->attack_cd = ATTACK_CD;
+  header->hit_cd = HIT_CD;
+  header->parry_cd = PARRY_CD;
+  header->parry_counter_cd = PARRY_COUNTER_CD;
+}
+
+int game_record_create(GameRecord *rec, const char *path, uint32_t seed) {
+  rec->file = fopen(path, "wb");
+  if (rec->file == NULL)
+    return -1;
+
+  game_record_header(&rec->header, seed);
+  if (fwrite(&rec->header, sizeof(rec->header), 1, rec->file) != 1) {
+    fclose(rec->file);
+    rec->file = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+int game_record_append(GameRecord *rec, const unsigned actions[2]) {
+  if (putc(GAME_RECORD_PACK(actions), rec->file) == EOF)
+    return -1;
+  return 0;
+}
+
+int game_record_open(GameRecord *rec, const char *path) {
+  rec->file = fopen(path, "rb");
+  if (rec->file == NULL)
+    return -1;
+
+  if (fread(&rec->header, sizeof(rec->header), 1, rec->file) != 1 ||
+      rec->header.magic != GAME_RECORD_MAGIC ||
+      rec->header.version != GAME_RECORD_VERSION) {
+    fclose(rec->file);
+    rec->file = NULL;
+    errno = EINVAL;
+    return -1;
+  }
+  return 0;
+}
+
+size_t game_record_read(GameRecord *rec, uint8_t *ticks, size_t count) {
+  return fread(ticks, 1, count, rec->file);
+}
+
+int game_record_close(GameRecord *rec) {
+  int err = fclose(rec->file);
+  rec->file = NULL;
+  return err == 0 ? 0 : -1;
+}
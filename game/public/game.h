@@ -0,0 +1,123 @@
+#ifndef GAME_H
+#define GAME_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Game simulation, independent of the screen and the GPIOs.
+ *
+ * A tick is a pure function of the previous state and both players' action
+ * bits, so it can be run headless, replayed and benchmarked.
+ */
+
+#define PLAYER_WIDTH 80
+#define PLAYER_HEIGHT 240
+#define WINDOW_HEIGHT 480
+#define WINDOW_WIDTH 800
+
+#define MOVEMENT_SPEED 5
+#define ATTACK_RADIUS (PLAYER_HEIGHT + 100) / 2
+#define MAX_HP 5
+
+#define ATTACK_CD 800
+#define HIT_CD 500
+#define PARRY_CD 250
+#define PARRY_COUNTER_CD 1000
+
+#define ON_NORMAL_CD 1
+#define ON_ATTACK_CD 2
+#define ON_HIT_CD 3
+#define ON_PARRY_CD 4
+
+// per-player action bits handed to the simulation
+#define ACTION_LEFT 0x1
+#define ACTION_RIGHT 0x2
+#define ACTION_ATTACK 0x4
+#define ACTION_PARRY 0x8
+#define ACTION_COUNT 4
+
+// simulation tick period in ms
+#ifndef GAME_CLOCK_DELAY
+#define GAME_CLOCK_DELAY 15
+#endif
+
+typedef struct {
+  int x;
+  // set by an attack, cleared by whoever draws the ring
+  int hitting;
+  int hp;
+  // set when hp changes, cleared by whoever displays it
+  int hp_dirty;
+  int state;
+  int cooldown_ms;
+} Player;
+
+// fields added here or to Player need an entry in the field tables of game.c
+// to be hashed and compared
+typedef struct {
+  Player players[2];
+} GameState;
+
+#define GAME_HASH_INIT 0xcbf29ce484222325ull
+
+/**
+ * Put both players back at their starting positions with full hp.
+ *
+ * @param    state   game to reset
+ */
+void game_reset(GameState *state);
+
+/**
+ * Advance the game by one tick of GAME_CLOCK_DELAY.
+ *
+ * Cooldowns run down first, then both players' actions are resolved against
+ * the same state, so neither player acts first:
+ *  - movement is applied to both players before any attack is checked,
+ *    holding both directions stands still
+ *  - a player off cooldown parries if ACTION_PARRY is set, otherwise attacks
+ *    if ACTION_ATTACK is set
+ *  - an attack into a parry started this tick or earlier is countered and the
+ *    attacker gets PARRY_COUNTER_CD
+ *  - two attacks in range of each other in the same tick trade, both players
+ *    lose a hp
+ *  - a knockout, including a double knockout, restarts the game
+ *
+ * @param    prev     state before the tick, not modified
+ * @param    actions  ACTION_* bits of player 0 and player 1
+ * @param    next     state after the tick, may not alias prev
+ */
+void game_step(const GameState *prev, const unsigned actions[2],
+               GameState *next);
+
+/**
+ * Hash of the state after a tick, chained with the hash of the tick before so
+ * the last hash of a run covers every tick of it. Start a run with
+ * GAME_HASH_INIT. Only the fields the simulation owns are hashed, the hitting
+ * and hp_dirty flags are cleared by whoever displays them.
+ *
+ * @param    prev    hash of the previous tick, GAME_HASH_INIT for the first
+ * @param    state   state after the tick
+ * @returns  hash of the run up to and including this tick
+ */
+uint64_t game_hash(uint64_t prev, const GameState *state);
+
+/**
+ * Print every hashed field that differs between two states, one per line.
+ *
+ * @param    a       first state
+ * @param    b       second state
+ * @param    out     stream to print to
+ * @returns  number of fields that differ
+ */
+int game_diff(const GameState *a, const GameState *b, FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef GAME_RECORD_H
+#define GAME_RECORD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "game.h"
+
+/*
+ * Match recordings.
+ *
+ * A recording is a GameRecordHeader followed by one byte per tick holding the
+ * ACTION_* bits handed to game_step, player 0 in the low nibble and player 1
+ * in the high nibble. The file is only ever appended to, so a recording cut
+ * short by a crash is still readable up to the last tick written. Everything
+ * is stored little-endian.
+ */
+
+#define GAME_RECORD_MAGIC 0x43524651 // "QFRC"
+#define GAME_RECORD_VERSION 1
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  // seed of the simulation's randomness, 0 while it has none
+  uint32_t seed;
+  // simulation constants the recording was made with, a replay built with
+  // different ones does not reproduce the match
+  uint32_t tick_ms;
+  uint32_t max_hp;
+  uint32_t movement_speed;
+  uint32_t attack_radius;
+  uint32_t attack_cd;
+  uint32_t hit_cd;
+  uint32_t parry_cd;
+  uint32_t parry_counter_cd;
+} GameRecordHeader;
+
+typedef struct {
+  FILE *file;
+  GameRecordHeader header;
+} GameRecord;
+
+#define GAME_RECORD_PACK(actions)                                              \
+  (uint8_t)(((actions)[0] & 0xf) | ((actions)[1] & 0xf) << 4)
+#define GAME_RECORD_UNPACK(tick, actions)                                      \
+  ((actions)[0] = (tick) & 0xf, (actions)[1] = (tick) >> 4)
+
+/**
+ * Fill a header with the constants this build of the simulation uses.
+ *
+ * @param    header   header to fill
+ * @param    seed     seed of the simulation's randomness
+ */
+void game_record_header(GameRecordHeader *header, uint32_t seed);
+
+/**
+ * Start a new recording, replacing any file at path.
+ *
+ * @param    rec      recording to open
+ * @param    path     file to write
+ * @param    seed     seed of the simulation's randomness
+ * @returns  0 on success, -1 with errno set on failure
+ */
+int game_record_create(GameRecord *rec, const char *path, uint32_t seed);
+
+/**
+ * Append one tick's actions to a recording. Writes are buffered, call
+ * game_record_close to make sure everything reaches the file.
+ *
+ * @param    rec      recording opened with game_record_create
+ * @param    actions  ACTION_* bits of player 0 and player 1
+ * @returns  0 on success, -1 with errno set on failure
+ */
+int game_record_append(GameRecord *rec, const unsigned actions[2]);
+
+/**
+ * Open an existing recording and read its header.
+ *
+ * @param    rec      recording to open
+ * @param    path     file to read
+ * @returns  0 on success, -1 with errno set on failure, EINVAL if the file
+ *           is not a recording of a version this build reads
+ */
+int game_record_open(GameRecord *rec, const char *path);
+
+/**
+ * Read packed ticks from a recording opened with game_record_open.
+ *
+ * @param    rec      recording
+ * @param    ticks    packed ticks (output), see GAME_RECORD_UNPACK
+ * @param    count    most ticks to read
+ * @returns  number of ticks read, 0 at the end of the recording
+ */
+size_t game_record_read(GameRecord *rec, uint8_t *ticks, size_t count);
+
+/**
+ * Flush and close a recording.
+ *
+ * @param    rec      recording
+ * @returns  0 on success, -1 with errno set if buffered ticks were lost
+ */
+int game_record_close(GameRecord *rec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
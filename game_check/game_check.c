@@ -0,0 +1,245 @@
+#include <game.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// players standing 100 apart, in swing range of each other
+#define NEAR0 300
+#define NEAR1 400
+// player 0 too far from NEAR1 to reach it
+#define FAR0 100
+
+// fresh player standing at x
+#define IDLE(x) {x, 0, MAX_HP, 0, ON_NORMAL_CD, 0}
+// player 0 and player 1 after a knockout restarted the game
+#define RESET0 {WINDOW_WIDTH / 4 - PLAYER_WIDTH / 2, 0, MAX_HP, 1, ON_NORMAL_CD, 0}
+#define RESET1                                                                 \
+  {3 * WINDOW_WIDTH / 4 - PLAYER_WIDTH / 2, 0, MAX_HP, 1, ON_NORMAL_CD, 0}
+
+// one tick from a given state, players are {x, hitting, hp, hp_dirty, state,
+// cooldown_ms}
+typedef struct {
+  const char *name;
+  GameState before;
+  unsigned actions[2];
+  GameState after;
+} StepCase;
+
+static const StepCase step_cases[] = {
+    {"attack hits an idle player",
+     {{IDLE(NEAR0), IDLE(NEAR1)}},
+     {ACTION_ATTACK, 0},
+     {{{NEAR0, 1, MAX_HP, 0, ON_ATTACK_CD, ATTACK_CD},
+       {NEAR1, 0, MAX_HP - 1, 1, ON_HIT_CD, HIT_CD}}}},
+    {"attack out of range",
+     {{IDLE(FAR0), IDLE(NEAR1)}},
+     {ACTION_ATTACK, 0},
+     {{{FAR0, 1, MAX_HP, 0, ON_ATTACK_CD, ATTACK_CD}, IDLE(NEAR1)}}},
+    {"parry started this tick beats an attack",
+     {{IDLE(NEAR0), IDLE(NEAR1)}},
+     {ACTION_ATTACK, ACTION_PARRY},
+     {{{NEAR0, 1, MAX_HP, 0, ON_ATTACK_CD, PARRY_COUNTER_CD},
+       {NEAR1, 0, MAX_HP, 0, ON_PARRY_CD, PARRY_CD}}}},
+    {"parry wins over attack in the same actions",
+     {{IDLE(NEAR0), IDLE(NEAR1)}},
+     {ACTION_ATTACK, ACTION_ATTACK | ACTION_PARRY},
+     {{{NEAR0, 1, MAX_HP, 0, ON_ATTACK_CD, PARRY_COUNTER_CD},
+       {NEAR1, 0, MAX_HP, 0, ON_PARRY_CD, PARRY_CD}}}},
+    {"running parry beats an attack",
+     {{IDLE(NEAR0), {NEAR1, 0, MAX_HP, 0, ON_PARRY_CD, 100}}},
+     {ACTION_ATTACK, 0},
+     {{{NEAR0, 1, MAX_HP, 0, ON_ATTACK_CD, PARRY_COUNTER_CD},
+       {NEAR1, 0, MAX_HP, 0, ON_PARRY_CD, 100 - GAME_CLOCK_DELAY}}}},
+    {"parry running out this tick no longer guards",
+     {{IDLE(NEAR0), {NEAR1, 0, MAX_HP, 0, ON_PARRY_CD, GAME_CLOCK_DELAY}}},
+     {ACTION_ATTACK, 0},
+     {{{NEAR0, 1, MAX_HP, 0, ON_ATTACK_CD, ATTACK_CD},
+       {NEAR1, 0, MAX_HP - 1, 1, ON_HIT_CD, HIT_CD}}}},
+    {"attacks in range trade",
+     {{IDLE(NEAR0), IDLE(NEAR1)}},
+     {ACTION_ATTACK, ACTION_ATTACK},
+     {{{NEAR0, 1, MAX_HP - 1, 1, ON_HIT_CD, ATTACK_CD},
+       {NEAR1, 1, MAX_HP - 1, 1, ON_HIT_CD, ATTACK_CD}}}},
+    {"attack into a running attack",
+     {{IDLE(NEAR0), {NEAR1, 0, MAX_HP, 0, ON_ATTACK_CD, 700}}},
+     {ACTION_ATTACK, 0},
+     {{{NEAR0, 1, MAX_HP, 0, ON_ATTACK_CD, ATTACK_CD},
+       {NEAR1, 0, MAX_HP - 1, 1, ON_HIT_CD, 700 - GAME_CLOCK_DELAY}}}},
+    {"attack into a hit cooldown",
+     {{IDLE(NEAR0), {NEAR1, 0, MAX_HP - 1, 0, ON_HIT_CD, 300}}},
+     {ACTION_ATTACK, 0},
+     {{{NEAR0, 1, MAX_HP, 0, ON_ATTACK_CD, ATTACK_CD},
+       {NEAR1, 0, MAX_HP - 1, 0, ON_HIT_CD, 300 - GAME_CLOCK_DELAY}}}},
+    {"attack on cooldown does nothing",
+     {{{NEAR0, 0, MAX_HP, 0, ON_ATTACK_CD, 300}, IDLE(NEAR1)}},
+     {ACTION_ATTACK, ACTION_PARRY},
+     {{{NEAR0, 0, MAX_HP, 0, ON_ATTACK_CD, 300 - GAME_CLOCK_DELAY},
+       {NEAR1, 0, MAX_HP, 0, ON_PARRY_CD, PARRY_CD}}}},
+    // 214 apart before moving is out of range, 209 after is in range
+    {"movement comes before the swing",
+     {{IDLE(NEAR1 - 214), IDLE(NEAR1)}},
+     {ACTION_RIGHT | ACTION_ATTACK, 0},
+     {{{NEAR1 - 209, 1, MAX_HP, 0, ON_ATTACK_CD, ATTACK_CD},
+       {NEAR1, 0, MAX_HP - 1, 1, ON_HIT_CD, HIT_CD}}}},
+    {"stepping away comes before the swing",
+     {{IDLE(NEAR1 - 209), IDLE(NEAR1)}},
+     {ACTION_ATTACK, ACTION_RIGHT},
+     {{{NEAR1 - 209, 1, MAX_HP, 0, ON_ATTACK_CD, ATTACK_CD},
+       IDLE(NEAR1 + MOVEMENT_SPEED)}}},
+    {"both directions stand still",
+     {{IDLE(NEAR0), IDLE(NEAR1)}},
+     {ACTION_LEFT | ACTION_RIGHT, ACTION_LEFT},
+     {{IDLE(NEAR0), IDLE(NEAR1 - MOVEMENT_SPEED)}}},
+    {"movement is clamped at the edge",
+     {{IDLE(MOVEMENT_SPEED - 2), IDLE(NEAR1)}},
+     {ACTION_LEFT, 0},
+     {{IDLE(MOVEMENT_SPEED), IDLE(NEAR1)}}},
+    {"knockout restarts",
+     {{IDLE(NEAR0), {NEAR1, 0, 1, 0, ON_NORMAL_CD, 0}}},
+     {ACTION_ATTACK, 0},
+     {{RESET0, RESET1}}},
+    {"double knockout restarts",
+     {{{NEAR0, 0, 1, 0, ON_NORMAL_CD, 0}, {NEAR1, 0, 1, 0, ON_NORMAL_CD, 0}}},
+     {ACTION_ATTACK, ACTION_ATTACK},
+     {{RESET0, RESET1}}},
+};
+
+// swaps the players and mirrors the field, the same tick must come out
+// mirrored whichever player is processed first
+static void mirror_state(const GameState *in, GameState *out) {
+  for (int i = 0; i < 2; i++) {
+    out->players[i] = in->players[1 - i];
+    out->players[i].x = WINDOW_WIDTH - PLAYER_WIDTH - in->players[1 - i].x;
+  }
+}
+
+static unsigned mirror_actions(unsigned actions) {
+  unsigned move = actions & (ACTION_LEFT | ACTION_RIGHT);
+  actions &= ~move;
+  if (move & ACTION_LEFT)
+    actions |= ACTION_RIGHT;
+  if (move & ACTION_RIGHT)
+    actions |= ACTION_LEFT;
+  return actions;
+}
+
+// 1 if one tick from before gives after, including the flags that are not
+// hashed, and leaves before alone
+static int check_step(const char *name, const char *side,
+                      const GameState *before, const unsigned actions[2],
+                      const GameState *after) {
+  GameState prev = *before, next;
+  int ok = 1;
+
+  memset(&next, 0xa5, sizeof(next));
+  game_step(&prev, actions, &next);
+
+  for (int i = 0; i < 2; i++)
+    ok &= next.players[i].hitting == after->players[i].hitting &&
+          next.players[i].hp_dirty == after->players[i].hp_dirty;
+  ok &= memcmp(&prev, before, sizeof(prev)) == 0;
+  ok &= game_hash(GAME_HASH_INIT, &next) == game_hash(GAME_HASH_INIT, after);
+
+  ok &= game_diff(&next, after, stdout) == 0;
+  printf("step: %-46s %-8s %s\n", name, side, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+// two states and how many hashed fields tell them apart
+typedef struct {
+  const char *name;
+  GameState a;
+  GameState b;
+  int diffs;
+} HashCase;
+
+static const HashCase hash_cases[] = {
+    {"same state", {{IDLE(NEAR0), IDLE(NEAR1)}}, {{IDLE(NEAR0), IDLE(NEAR1)}},
+     0},
+    {"hitting is not hashed",
+     {{IDLE(NEAR0), IDLE(NEAR1)}},
+     {{{NEAR0, 1, MAX_HP, 0, ON_NORMAL_CD, 0}, IDLE(NEAR1)}},
+     0},
+    {"hp_dirty is not hashed",
+     {{IDLE(NEAR0), IDLE(NEAR1)}},
+     {{IDLE(NEAR0), {NEAR1, 0, MAX_HP, 1, ON_NORMAL_CD, 0}}},
+     0},
+    {"x", {{IDLE(NEAR0), IDLE(NEAR1)}}, {{IDLE(NEAR0 + 1), IDLE(NEAR1)}}, 1},
+    {"hp",
+     {{IDLE(NEAR0), IDLE(NEAR1)}},
+     {{IDLE(NEAR0), {NEAR1, 0, MAX_HP - 1, 0, ON_NORMAL_CD, 0}}},
+     1},
+    {"state",
+     {{IDLE(NEAR0), IDLE(NEAR1)}},
+     {{{NEAR0, 0, MAX_HP, 0, ON_PARRY_CD, 0}, IDLE(NEAR1)}},
+     1},
+    {"cooldown_ms",
+     {{IDLE(NEAR0), IDLE(NEAR1)}},
+     {{IDLE(NEAR0), {NEAR1, 0, MAX_HP, 0, ON_NORMAL_CD, 1}}},
+     1},
+    {"players swapped", {{IDLE(NEAR0), IDLE(NEAR1)}},
+     {{IDLE(NEAR1), IDLE(NEAR0)}}, 2},
+};
+
+// 1 if the hashes of a and b differ exactly when game_diff finds a field that
+// differs, and chaining the two in either order tells the orders apart
+static int check_hash(const HashCase *c) {
+  FILE *null = fopen("/dev/null", "w");
+  int diffs = game_diff(&c->a, &c->b, null);
+  fclose(null);
+
+  uint64_t ha = game_hash(GAME_HASH_INIT, &c->a);
+  uint64_t hb = game_hash(GAME_HASH_INIT, &c->b);
+  uint64_t ab = game_hash(ha, &c->b);
+  uint64_t ba = game_hash(hb, &c->a);
+  int ok = diffs == c->diffs && (ha == hb) == (c->diffs == 0) &&
+           (ab == ba) == (c->diffs == 0);
+
+  printf("hash: %-46s %d fields %s\n", c->name, diffs, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+// the same actions from the same state must end on the same hash
+static int check_run() {
+  uint64_t hash[2];
+
+  for (int run = 0; run < 2; run++) {
+    GameState state, next;
+    srand(1);
+    game_reset(&state);
+    hash[run] = GAME_HASH_INIT;
+    for (int tick = 0; tick < 100000; tick++) {
+      unsigned actions[2] = {rand() & 0xf, rand() & 0xf};
+      game_step(&state, actions, &next);
+      hash[run] = game_hash(hash[run], &next);
+      state = next;
+    }
+  }
+
+  printf("run: 100000 random ticks twice, hash %016llx %016llx %s\n",
+         (unsigned long long)hash[0], (unsigned long long)hash[1],
+         hash[0] == hash[1] ? "ok" : "FAILED");
+  return hash[0] == hash[1];
+}
+
+int main() {
+  int ok = 1;
+
+  for (size_t i = 0; i < sizeof(step_cases) / sizeof(step_cases[0]); i++) {
+    const StepCase *c = &step_cases[i];
+    GameState before, after;
+    unsigned actions[2] = {mirror_actions(c->actions[1]),
+                           mirror_actions(c->actions[0])};
+
+    ok &= check_step(c->name, "", &c->before, c->actions, &c->after);
+    mirror_state(&c->before, &before);
+    mirror_state(&c->after, &after);
+    ok &= check_step(c->name, "mirrored", &before, actions, &after);
+  }
+  for (size_t i = 0; i < sizeof(hash_cases) / sizeof(hash_cases[0]); i++)
+    ok &= check_hash(&hash_cases[i]);
+  ok &= check_run();
+
+  printf("%s\n", ok ? "ok" : "FAILED");
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,650 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/rpi_gpio.h>
+#include "public/gpio_mock.h"
+#include "rpi_gpio_priv.h"
+
+// Interrupts raised by the storm
+#define STORM_INTERRUPTS 50000
+
+// Edges raised one at a time by the doorbell check
+#define DOORBELL_EDGES 3
+
+// Edges raised by the wakeup check, the second while the client reads the first
+#define WAKEUP_EDGES 2
+
+// Records read at a time, and the pause after each read in the first half of the storm, slower
+// than the storm so that the queue overflows. The reader catches up in the second half.
+#define READ_RECORDS 16
+#define READ_PAUSE_US 100
+
+#define QUEUED_RCVID 1
+#define PULSED_RCVID 2
+
+// Interrupts timed for each number of subscribers
+#define LATENCY_INTERRUPTS 20000
+
+// Interrupts raised while subscribers come and go
+#define CHURN_INTERRUPTS 20000
+
+// Time each event delivery to the subscriber that stays takes during churn
+#define CHURN_DELAY_US 20
+
+int verbose;
+
+static const unsigned storm_pins[] = {4, 5, 17, 27, 40, 53};
+#define STORM_PINS (sizeof(storm_pins) / sizeof(storm_pins[0]))
+
+// What the IST should record for each sequence number
+typedef struct
+{
+    uint8_t gpio;
+    uint8_t level;
+    uint64_t raised;                             //< ClockCycles() before the interrupt was raised
+} expected_t;
+
+#define MAX_EXPECTED (STORM_INTERRUPTS * STORM_PINS + DOORBELL_EDGES + WAKEUP_EDGES)
+
+static expected_t expected[MAX_EXPECTED];
+static uint32_t expected_count;
+
+typedef struct
+{
+    uint64_t records;
+    uint64_t dropped;
+    uint64_t mismatched;
+    uint64_t doorbells;
+    uint32_t next_seq;
+    uint64_t last_cycles;
+} reader_result_t;
+
+static reader_result_t result;
+static atomic_int storming;
+static atomic_int raising;
+static atomic_int reading_slowly;
+
+static int add_event(rcvid_t rcvid, unsigned gpio, unsigned detect, unsigned match)
+{
+    rpi_gpio_event_t msg = {
+        .hdr.type = _IO_MSG,
+        .hdr.mgrid = RPI_GPIO_IOMGR,
+        .hdr.subtype = RPI_GPIO_ADD_EVENT,
+        .gpio = gpio,
+        .detect = detect,
+        .match = match,
+    };
+    msg.event.sigev_notify = SIGEV_SIGNAL;
+
+    return event_add(rcvid, &msg);
+}
+
+// Checks records against what was raised, gaps in the sequence numbers are dropped records
+static void check_records(const rpi_gpio_event_record_t *records, unsigned count)
+{
+    for (unsigned i = 0; i < count; i++)
+    {
+        const rpi_gpio_event_record_t *r = &records[i];
+
+        if (r->seq < result.next_seq || r->seq >= MAX_EXPECTED)
+        {
+            result.mismatched++;
+            continue;
+        }
+
+        const expected_t *e = &expected[r->seq];
+        if (r->gpio != e->gpio || r->level != e->level || r->cycles < e->raised ||
+            r->cycles < result.last_cycles)
+        {
+            result.mismatched++;
+        }
+
+        result.dropped += r->seq - result.next_seq;
+        result.next_seq = r->seq + 1;
+        result.last_cycles = r->cycles;
+        result.records++;
+    }
+}
+
+// Stands in for the client: waits for the doorbell, then reads until the queue is empty. Once the storm
+// is over it stops at the first wait without a doorbell, so whatever is left in the queue then was never
+// rung for.
+static void *reader_thread(void *arg)
+{
+    uint64_t seen = 0;
+
+    for (;;)
+    {
+        const int last = !atomic_load(&storming);
+        uint64_t deliveries = gpio_mock_wait_delivery(QUEUED_RCVID, seen, 10);
+        if (deliveries == seen)
+        {
+            if (last)
+            {
+                break;
+            }
+            continue;
+        }
+        result.doorbells += deliveries - seen;
+        seen = deliveries;
+
+        for (;;)
+        {
+            rpi_gpio_event_record_t records[READ_RECORDS];
+            unsigned count;
+
+            if (event_read(QUEUED_RCVID, records, READ_RECORDS, &count) != EOK || count == 0)
+            {
+                break;
+            }
+
+            check_records(records, count);
+            if (atomic_load(&reading_slowly))
+            {
+                usleep(READ_PAUSE_US);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static unsigned read_all(void)
+{
+    rpi_gpio_event_record_t records[READ_RECORDS];
+    unsigned count;
+    unsigned total = 0;
+
+    while (event_read(QUEUED_RCVID, records, READ_RECORDS, &count) == EOK && count > 0)
+    {
+        check_records(records, count);
+        total += count;
+    }
+
+    return total;
+}
+
+static uint64_t deliveries(rcvid_t rcvid)
+{
+    gpio_mock_client_t client;
+
+    gpio_mock_get_client(rcvid, &client);
+    return client.deliveries;
+}
+
+// Raises interrupts with edges on a random set of pins, each toggling its level, while the reader
+// falls behind
+static int check_storm(void)
+{
+    pthread_t reader;
+    uint64_t levels = 0;
+    uint32_t rand = 1;
+    unsigned overflow;
+
+    for (unsigned i = 0; i < STORM_PINS; i++)
+    {
+        if (add_event(QUEUED_RCVID, storm_pins[i],
+                      RPI_EVENT_EDGE_RISING | RPI_EVENT_EDGE_FALLING | RPI_EVENT_QUEUE, 0) != EOK)
+        {
+            printf("failed to add queued event\n");
+            return 0;
+        }
+    }
+
+    atomic_store(&storming, 1);
+    atomic_store(&reading_slowly, 1);
+    pthread_create(&reader, NULL, reader_thread, NULL);
+
+    uint64_t start = ClockCycles();
+    for (unsigned n = 0; n < STORM_INTERRUPTS; n++)
+    {
+        uint64_t events = 0;
+
+        if (n == STORM_INTERRUPTS / 2)
+        {
+            atomic_store(&reading_slowly, 0);
+        }
+
+        // xorshift, at least one pin per interrupt
+        rand ^= rand << 13;
+        rand ^= rand >> 17;
+        rand ^= rand << 5;
+        for (unsigned i = 0; i < STORM_PINS; i++)
+        {
+            if ((rand >> i) & 1 || i == rand % STORM_PINS)
+            {
+                events |= UINT64_C(1) << storm_pins[i];
+            }
+        }
+        levels ^= events;
+
+        uint64_t raised = ClockCycles();
+        for (unsigned i = 0; i < STORM_PINS; i++)
+        {
+            if (events & (UINT64_C(1) << storm_pins[i]))
+            {
+                expected_t *e = &expected[expected_count++];
+                e->gpio = storm_pins[i];
+                e->level = (levels >> storm_pins[i]) & 1;
+                e->raised = raised;
+            }
+        }
+
+        gpio_mock_interrupt(events, levels);
+    }
+    uint64_t storm_ns = ClockCycles() - start;
+
+    atomic_store(&storming, 0);
+    pthread_join(reader, NULL);
+
+    // the last doorbell has been handled, a record left now would wait for the next edge
+    const unsigned left = read_all();
+    result.dropped += expected_count - result.next_seq;
+
+    if (event_overflow(QUEUED_RCVID, &overflow) != EOK)
+    {
+        overflow = -1;
+    }
+
+    printf("storm: %u interrupts, %u edges in %.1f ms (%.2f us per interrupt)\n", STORM_INTERRUPTS,
+           expected_count, storm_ns / 1e6, storm_ns / 1e3 / STORM_INTERRUPTS);
+    printf("storm: %llu read, %llu dropped, overflow %u, %llu doorbells, %llu mismatched, %u left unrung\n",
+           (unsigned long long)result.records, (unsigned long long)result.dropped, overflow,
+           (unsigned long long)result.doorbells, (unsigned long long)result.mismatched, left);
+
+    return left == 0 && result.mismatched == 0 && result.records + result.dropped == expected_count &&
+           result.dropped == overflow && overflow > 0 && result.doorbells > 0 &&
+           result.doorbells <= result.records;
+}
+
+// The doorbell rings when a record lands in an empty queue, and not again until it is read empty
+static int check_doorbell(void)
+{
+    uint64_t before = deliveries(QUEUED_RCVID);
+    uint64_t levels = 0;
+    int ok = 1;
+
+    result.next_seq = expected_count;
+    for (unsigned n = 0; n < DOORBELL_EDGES; n++)
+    {
+        levels ^= UINT64_C(1) << 17;
+        expected_t *e = &expected[expected_count++];
+        e->gpio = 17;
+        e->level = (levels >> 17) & 1;
+        e->raised = ClockCycles();
+        gpio_mock_interrupt(UINT64_C(1) << 17, levels);
+
+        if (n == 1)
+        {
+            ok &= read_all() == 2;
+        }
+    }
+
+    ok &= read_all() == 1;
+    ok &= deliveries(QUEUED_RCVID) - before == 2 && result.mismatched == 0;
+    if (!ok)
+    {
+        printf("doorbell: %llu deliveries for 3 edges read in 2 goes\n",
+               (unsigned long long)(deliveries(QUEUED_RCVID) - before));
+    }
+
+    return ok;
+}
+
+static unsigned hook_read;
+
+// Stands in for the client reading the queue empty on another CPU while the IST adds a record
+static void drain_in_ist(void)
+{
+    gpio_mock_set_queue_hook(NULL);
+    hook_read = read_all();
+}
+
+// The client reads the queue empty after the IST read the tail and before it publishes the next record,
+// then waits for the doorbell. The IST must ring for that record, or it waits for the next edge.
+static int check_wakeup(void)
+{
+    uint64_t levels = 0;
+    uint64_t rung = 0;
+    int ok = 1;
+
+    read_all();
+    result.next_seq = expected_count;
+
+    for (unsigned n = 0; n < WAKEUP_EDGES; n++)
+    {
+        uint64_t before = deliveries(QUEUED_RCVID);
+
+        if (n == 1)
+        {
+            gpio_mock_set_queue_hook(drain_in_ist);
+        }
+
+        levels ^= UINT64_C(1) << 4;
+        expected_t *e = &expected[expected_count++];
+        e->gpio = 4;
+        e->level = (levels >> 4) & 1;
+        e->raised = ClockCycles();
+        gpio_mock_interrupt(UINT64_C(1) << 4, levels);
+
+        // the first record lands in an empty queue, the second behind the first while it is read
+        ok &= deliveries(QUEUED_RCVID) - before == 1;
+        rung += deliveries(QUEUED_RCVID) - before;
+    }
+
+    ok &= hook_read == 1 && read_all() == 1 && result.mismatched == 0;
+    if (!ok)
+    {
+        printf("wakeup: %llu doorbells for %u edges, %u read by the hook\n", (unsigned long long)rung,
+               WAKEUP_EDGES, hook_read);
+    }
+
+    return ok;
+}
+
+// Clients without a queue still get +gpio/-gpio with the new level
+static int check_pulse(void)
+{
+    gpio_mock_client_t client;
+    int ok = 1;
+
+    if (add_event(PULSED_RCVID, 6, RPI_EVENT_EDGE_RISING | RPI_EVENT_EDGE_FALLING, 0) != EOK)
+    {
+        printf("failed to add pulsed event\n");
+        return 0;
+    }
+
+    gpio_mock_interrupt(UINT64_C(1) << 6, UINT64_C(1) << 6);
+    gpio_mock_get_client(PULSED_RCVID, &client);
+    ok &= client.deliveries == 1 && client.value == 6;
+
+    gpio_mock_interrupt(UINT64_C(1) << 6, 0);
+    gpio_mock_get_client(PULSED_RCVID, &client);
+    ok &= client.deliveries == 2 && client.value == -6;
+
+    unsigned count;
+    ok &= event_read(PULSED_RCVID, NULL, 0, &count) == ENXIO;
+
+    if (!ok)
+    {
+        printf("pulse: %llu deliveries, last value %d\n", (unsigned long long)client.deliveries,
+               client.value);
+    }
+
+    return ok;
+}
+
+// The queue goes away with the client
+static int check_remove(void)
+{
+    unsigned count;
+
+    event_remove_rcvid(QUEUED_RCVID);
+    uint64_t before = deliveries(QUEUED_RCVID);
+    gpio_mock_interrupt(UINT64_C(1) << 17, 0);
+
+    return event_read(QUEUED_RCVID, NULL, 0, &count) == ENXIO &&
+           deliveries(QUEUED_RCVID) == before;
+}
+
+static void remove_clients(void)
+{
+    for (rcvid_t rcvid = 1; rcvid <= GPIO_MOCK_MAX_RCVID; rcvid++)
+    {
+        event_remove_rcvid(rcvid);
+    }
+    gpio_mock_reset_clients();
+}
+
+// Clients on the same GPIO each get the changes they asked for, every match changes
+static int check_subscribers(void)
+{
+    gpio_mock_client_t rising, falling, both;
+    unsigned const gpio = 22;
+    int ok = 1;
+
+    remove_clients();
+    ok &= add_event(3, gpio, RPI_EVENT_EDGE_RISING, 0) == EOK;
+    ok &= add_event(4, gpio, RPI_EVENT_EDGE_FALLING, 0) == EOK;
+    ok &= add_event(5, gpio, RPI_EVENT_EDGE_RISING | RPI_EVENT_EDGE_FALLING, 2) == EOK;
+    if (!ok)
+    {
+        printf("subscribers: failed to add events\n");
+        return 0;
+    }
+
+    for (unsigned n = 0; n < 4; n++)
+    {
+        gpio_mock_interrupt(UINT64_C(1) << gpio, (uint64_t)(~n & 1) << gpio);
+    }
+
+    gpio_mock_get_client(3, &rising);
+    gpio_mock_get_client(4, &falling);
+    gpio_mock_get_client(5, &both);
+    ok &= rising.deliveries == 2 && rising.value == (int)gpio;
+    ok &= falling.deliveries == 2 && falling.value == -(int)gpio;
+    ok &= both.deliveries == 2;
+
+    // registering again replaces the registration
+    ok &= add_event(3, gpio, RPI_EVENT_EDGE_FALLING, 0) == EOK;
+    gpio_mock_interrupt(UINT64_C(1) << gpio, 0);
+    gpio_mock_get_client(3, &rising);
+    ok &= rising.deliveries == 3 && rising.value == -(int)gpio;
+
+    if (!ok)
+    {
+        printf("subscribers: %llu rising, %llu falling, %llu every other change\n",
+               (unsigned long long)rising.deliveries, (unsigned long long)falling.deliveries,
+               (unsigned long long)both.deliveries);
+    }
+
+    return ok;
+}
+
+// A client failing to take its event only loses its own, and the number of clients on a GPIO is
+// bounded
+static int check_isolation(void)
+{
+    gpio_mock_client_t client;
+    unsigned const gpio = 23;
+    int ok = 1;
+
+    remove_clients();
+    for (rcvid_t rcvid = 1; rcvid <= RPI_GPIO_EVENT_SUBSCRIBERS; rcvid++)
+    {
+        ok &= add_event(rcvid, gpio, RPI_EVENT_EDGE_RISING | RPI_EVENT_EDGE_FALLING, 0) == EOK;
+    }
+    ok &= add_event(RPI_GPIO_EVENT_SUBSCRIBERS + 1, gpio, RPI_EVENT_EDGE_RISING, 0) == EBUSY;
+    ok &= add_event(1, gpio, RPI_EVENT_EDGE_RISING | RPI_EVENT_EDGE_FALLING, 0) == EOK;
+
+    gpio_mock_fail_client(2, 1);
+    for (unsigned n = 0; n < 3; n++)
+    {
+        gpio_mock_interrupt(UINT64_C(1) << gpio, (uint64_t)(~n & 1) << gpio);
+        gpio_mock_fail_client(2, 0);
+    }
+
+    for (rcvid_t rcvid = 1; rcvid <= RPI_GPIO_EVENT_SUBSCRIBERS; rcvid++)
+    {
+        gpio_mock_get_client(rcvid, &client);
+        if (rcvid == 2)
+        {
+            ok &= client.deliveries == 0 && client.failures == 1;
+        }
+        else
+        {
+            ok &= client.deliveries == 3;
+        }
+    }
+
+    if (!ok)
+    {
+        printf("isolation: a failed client affected the others\n");
+    }
+
+    return ok;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void print_latency(const char *name, unsigned subscribers, uint64_t *ns)
+{
+    uint64_t sum = 0;
+
+    qsort(ns, LATENCY_INTERRUPTS, sizeof(ns[0]), compare_u64);
+    for (unsigned i = 0; i < LATENCY_INTERRUPTS; i++)
+    {
+        sum += ns[i];
+    }
+
+    printf("latency: %2u subscribers, to %s: min %.1f avg %.1f p99 %.1f us\n", subscribers, name,
+           ns[0] / 1e3, sum / 1e3 / LATENCY_INTERRUPTS, ns[LATENCY_INTERRUPTS * 99 / 100] / 1e3);
+}
+
+// Time from raising the interrupt to the event reaching the first and the last subscriber. The
+// first includes waking the IST, the difference is what each extra subscriber costs.
+static int check_latency(unsigned subscribers)
+{
+    static uint64_t first_ns[LATENCY_INTERRUPTS];
+    static uint64_t last_ns[LATENCY_INTERRUPTS];
+    unsigned const gpio = 24;
+    int ok = 1;
+
+    remove_clients();
+    for (rcvid_t rcvid = 1; rcvid <= subscribers; rcvid++)
+    {
+        ok &= add_event(rcvid, gpio, RPI_EVENT_EDGE_RISING | RPI_EVENT_EDGE_FALLING, 0) == EOK;
+    }
+
+    rpi_gpio_ist_stats_t stats = {.reset = 1};
+    event_get_stats(&stats);
+
+    for (unsigned n = 0; n < LATENCY_INTERRUPTS; n++)
+    {
+        uint64_t raised = gpio_mock_interrupt(UINT64_C(1) << gpio, (uint64_t)(n & 1) << gpio);
+        uint64_t first = UINT64_MAX;
+        uint64_t last = 0;
+
+        for (rcvid_t rcvid = 1; rcvid <= subscribers; rcvid++)
+        {
+            gpio_mock_client_t client;
+
+            gpio_mock_get_client(rcvid, &client);
+            ok &= client.deliveries == n + 1;
+            first = client.delivered_cycles < first ? client.delivered_cycles : first;
+            last = client.delivered_cycles > last ? client.delivered_cycles : last;
+        }
+
+        first_ns[n] = first - raised;
+        last_ns[n] = last - raised;
+    }
+
+    print_latency("first", subscribers, first_ns);
+    print_latency("last", subscribers, last_ns);
+
+    stats.reset = 0;
+    event_get_stats(&stats);
+    printf("ist:     %2u subscribers, %llu interrupts: min %.2f avg %.2f p99 %.2f max %.2f us\n",
+           subscribers, (unsigned long long)stats.interrupts, stats.min_ns / 1e3,
+           stats.avg_ns / 1e3, stats.p99_ns / 1e3, stats.max_ns / 1e3);
+
+    return ok && stats.interrupts == LATENCY_INTERRUPTS && stats.min_ns <= stats.avg_ns &&
+           stats.avg_ns <= stats.max_ns && stats.p99_ns <= stats.max_ns;
+}
+
+static void *raiser_thread(void *arg)
+{
+    unsigned gpio = *(unsigned *)arg;
+
+    for (unsigned n = 0; n < CHURN_INTERRUPTS; n++)
+    {
+        gpio_mock_interrupt(UINT64_C(1) << gpio, (uint64_t)(n & 1) << gpio);
+    }
+    atomic_store(&raising, 0);
+
+    return NULL;
+}
+
+// Subscribers come and go, with and without queues, while interrupts are serviced. A client that
+// stays must get every event, and nothing may be freed while the IST still uses it.
+static int check_churn(void)
+{
+    pthread_t raiser;
+    gpio_mock_client_t client;
+    unsigned gpio = 26;
+    unsigned changes = 0;
+
+    // slow deliveries to the first subscriber keep the IST in the table while it is replaced
+    remove_clients();
+    gpio_mock_delay_client(1, CHURN_DELAY_US);
+    if (add_event(1, gpio, RPI_EVENT_EDGE_RISING | RPI_EVENT_EDGE_FALLING, 0) != EOK)
+    {
+        printf("churn: failed to add event\n");
+        return 0;
+    }
+
+    atomic_store(&raising, 1);
+    pthread_create(&raiser, NULL, raiser_thread, &gpio);
+
+    while (atomic_load(&raising))
+    {
+        rcvid_t rcvid = 2 + changes % (GPIO_MOCK_MAX_RCVID - 1);
+
+        if ((changes / (GPIO_MOCK_MAX_RCVID - 1)) % 3 == 2)
+        {
+            event_remove_rcvid(rcvid);
+        }
+        else if (add_event(rcvid, gpio,
+                           changes & 1 ? RPI_EVENT_EDGE_RISING
+                                       : RPI_EVENT_EDGE_FALLING | RPI_EVENT_QUEUE,
+                           changes % 3) != EOK)
+        {
+            printf("churn: failed to add event\n");
+        }
+        changes++;
+    }
+
+    pthread_join(raiser, NULL);
+    gpio_mock_get_client(1, &client);
+    printf("churn: %u table changes during %u interrupts, %llu delivered\n", changes,
+           CHURN_INTERRUPTS, (unsigned long long)client.deliveries);
+
+    return client.deliveries == CHURN_INTERRUPTS;
+}
+
+int main()
+{
+    int ok = 1;
+
+    if (!event_init(0, 0))
+    {
+        return EXIT_FAILURE;
+    }
+
+    ok &= check_storm();
+    ok &= check_doorbell();
+    ok &= check_wakeup();
+    ok &= check_pulse();
+    ok &= check_remove();
+    ok &= check_subscribers();
+    ok &= check_isolation();
+    ok &= check_latency(1);
+    ok &= check_latency(4);
+    ok &= check_latency(RPI_GPIO_EVENT_SUBSCRIBERS);
+    ok &= check_churn();
+    remove_clients();
+
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
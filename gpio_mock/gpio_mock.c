@@ -0,0 +1,225 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/neutrino.h>
+#include <aarch64/rpi_gpio.h>
+#include "public/gpio_mock.h"
+
+// Covers every register up to GPPUD0..3
+#define MOCK_REGS 64
+
+static uint32_t regs[MOCK_REGS];
+uint32_t volatile *rpi_gpio_regs = regs;
+
+static gpio_mock_client_t clients[GPIO_MOCK_MAX_RCVID + 1];
+
+// Protects the interrupt state and the clients
+static pthread_mutex_t mock_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mock_cond = PTHREAD_COND_INITIALIZER;
+
+// Signalled on every delivery, apart from mock_cond so as not to wake the interrupt's raiser
+static pthread_cond_t delivery_cond = PTHREAD_COND_INITIALIZER;
+
+// Set when the interrupt is raised, cleared when the IST wakes up for it
+static int pending;
+
+// Set when the IST wakes up, the interrupt stays masked until InterruptUnmask
+static int masked;
+
+uint64_t gpio_mock_interrupt(uint64_t events, uint64_t levels)
+{
+    pthread_mutex_lock(&mock_mutex);
+
+    while (pending || masked)
+    {
+        pthread_cond_wait(&mock_cond, &mock_mutex);
+    }
+
+    uint64_t raised = ClockCycles();
+    rpi_gpio_regs[RPI_GPIO_REG_GPEDS0] = (uint32_t)events;
+    rpi_gpio_regs[RPI_GPIO_REG_GPEDS1] = (uint32_t)(events >> 32);
+    rpi_gpio_regs[RPI_GPIO_REG_GPLEV0] = (uint32_t)levels;
+    rpi_gpio_regs[RPI_GPIO_REG_GPLEV0 + 1] = (uint32_t)(levels >> 32);
+    pending = 1;
+    pthread_cond_broadcast(&mock_cond);
+
+    while (pending || masked)
+    {
+        pthread_cond_wait(&mock_cond, &mock_mutex);
+    }
+
+    pthread_mutex_unlock(&mock_mutex);
+
+    return raised;
+}
+
+int gpio_mock_get_client(rcvid_t rcvid, gpio_mock_client_t *client)
+{
+    if (rcvid < 1 || rcvid > GPIO_MOCK_MAX_RCVID)
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&mock_mutex);
+    *client = clients[rcvid];
+    pthread_mutex_unlock(&mock_mutex);
+
+    return 0;
+}
+
+int gpio_mock_fail_client(rcvid_t rcvid, int fail)
+{
+    if (rcvid < 1 || rcvid > GPIO_MOCK_MAX_RCVID)
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&mock_mutex);
+    clients[rcvid].fail = fail;
+    pthread_mutex_unlock(&mock_mutex);
+
+    return 0;
+}
+
+int gpio_mock_delay_client(rcvid_t rcvid, unsigned delay_us)
+{
+    if (rcvid < 1 || rcvid > GPIO_MOCK_MAX_RCVID)
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&mock_mutex);
+    clients[rcvid].delay_us = delay_us;
+    pthread_mutex_unlock(&mock_mutex);
+
+    return 0;
+}
+
+static void (*_Atomic queue_hook)(void);
+
+void gpio_mock_set_queue_hook(void (*hook)(void))
+{
+    atomic_store(&queue_hook, hook);
+}
+
+void gpio_mock_queue_hook(void)
+{
+    void (*hook)(void) = atomic_load(&queue_hook);
+
+    if (hook != NULL)
+    {
+        hook();
+    }
+}
+
+void gpio_mock_reset_clients(void)
+{
+    pthread_mutex_lock(&mock_mutex);
+    memset(clients, 0, sizeof(clients));
+    pthread_mutex_unlock(&mock_mutex);
+}
+
+uint64_t gpio_mock_wait_delivery(rcvid_t rcvid, uint64_t seen, unsigned timeout_ms)
+{
+    if (rcvid < 1 || rcvid > GPIO_MOCK_MAX_RCVID)
+    {
+        return seen;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&mock_mutex);
+
+    while (clients[rcvid].deliveries == seen)
+    {
+        if (pthread_cond_timedwait(&delivery_cond, &mock_mutex, &deadline) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+
+    uint64_t deliveries = clients[rcvid].deliveries;
+    pthread_mutex_unlock(&mock_mutex);
+
+    return deliveries;
+}
+
+int InterruptAttachEvent(int intr, const struct sigevent *event, unsigned flags)
+{
+    return 1;
+}
+
+int InterruptWait(int flags, const uint64_t *timeout)
+{
+    pthread_mutex_lock(&mock_mutex);
+
+    while (!pending)
+    {
+        pthread_cond_wait(&mock_cond, &mock_mutex);
+    }
+
+    pending = 0;
+    masked = 1;
+    pthread_mutex_unlock(&mock_mutex);
+
+    return 0;
+}
+
+int InterruptUnmask(int intr, int id)
+{
+    pthread_mutex_lock(&mock_mutex);
+    masked = 0;
+    pthread_cond_broadcast(&mock_cond);
+    pthread_mutex_unlock(&mock_mutex);
+
+    return 0;
+}
+
+int MsgDeliverEvent(rcvid_t rcvid, const struct sigevent *event)
+{
+    if (rcvid < 1 || rcvid > GPIO_MOCK_MAX_RCVID)
+    {
+        errno = ESRCH;
+        return -1;
+    }
+
+    pthread_mutex_lock(&mock_mutex);
+    unsigned delay_us = clients[rcvid].delay_us;
+    pthread_mutex_unlock(&mock_mutex);
+
+    if (delay_us != 0)
+    {
+        struct timespec delay = {.tv_sec = 0, .tv_nsec = delay_us * 1000L};
+        nanosleep(&delay, NULL);
+    }
+
+    uint64_t delivered = ClockCycles();
+    pthread_mutex_lock(&mock_mutex);
+
+    if (clients[rcvid].fail)
+    {
+        clients[rcvid].failures++;
+        pthread_mutex_unlock(&mock_mutex);
+        errno = ESRCH;
+        return -1;
+    }
+
+    clients[rcvid].deliveries++;
+    clients[rcvid].delivered_cycles = delivered;
+    clients[rcvid].value = event->sigev_value.sival_int;
+    pthread_cond_broadcast(&delivery_cond);
+    pthread_mutex_unlock(&mock_mutex);
+
+    return 0;
+}
@@ -0,0 +1,8 @@
+/*
+ * Host stand-in for the QNX <aarch64/inline.h>, nothing from it is used.
+ */
+
+#ifndef GPIO_MOCK_INLINE_H
+#define GPIO_MOCK_INLINE_H
+
+#endif
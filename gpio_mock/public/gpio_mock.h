@@ -0,0 +1,101 @@
+#ifndef GPIO_MOCK_H
+#define GPIO_MOCK_H
+
+#include <stdint.h>
+#include <sys/neutrino.h>
+
+/*
+ * Host stand-in for the GPIO interrupt and event delivery the resource manager's IST relies on.
+ * The GPIO registers are a block in memory, an interrupt is raised by latching events and levels
+ * in it, and every event delivered to a client is counted.
+ */
+
+// Highest client identifier events can be delivered to
+#define GPIO_MOCK_MAX_RCVID 16
+
+typedef struct gpio_mock_client_t
+{
+    uint64_t deliveries;                         //< Number of events delivered
+    uint64_t failures;                           //< Number of deliveries failed on purpose
+    uint64_t delivered_cycles;                   //< ClockCycles() when the last event was delivered
+    int value;                                   //< sigev_value of the last event delivered
+    int fail;                                    //< Set by gpio_mock_fail_client
+    unsigned delay_us;                           //< Set by gpio_mock_delay_client
+} gpio_mock_client_t;
+
+/**
+ * Raise the GPIO interrupt, then wait until the IST has serviced it and unmasked the interrupt
+ *
+ * @param    events          bit n set for an event detected on GPIO n, latched in GPEDS0/1
+ * @param    levels          bit n set if GPIO n is high, latched in GPLEV0/1
+ *
+ * @returns  ClockCycles() when the interrupt was raised
+ */
+uint64_t gpio_mock_interrupt(uint64_t events, uint64_t levels);
+
+/**
+ * Read the events delivered to a client
+ *
+ * @param    rcvid           client identifier, 1 to GPIO_MOCK_MAX_RCVID
+ * @param    client          delivery state (output)
+ *
+ * @returns  0 on success, -1 for an unknown client
+ */
+int gpio_mock_get_client(rcvid_t rcvid, gpio_mock_client_t *client);
+
+/**
+ * Make event deliveries to a client fail, as if it had gone away
+ *
+ * @param    rcvid           client identifier, 1 to GPIO_MOCK_MAX_RCVID
+ * @param    fail            1 to fail deliveries, 0 to deliver them again
+ *
+ * @returns  0 on success, -1 for an unknown client
+ */
+int gpio_mock_fail_client(rcvid_t rcvid, int fail);
+
+/**
+ * Make event deliveries to a client take a while, holding up the IST
+ *
+ * @param    rcvid           client identifier, 1 to GPIO_MOCK_MAX_RCVID
+ * @param    delay_us        time each delivery takes, 0 for none
+ *
+ * @returns  0 on success, -1 for an unknown client
+ */
+int gpio_mock_delay_client(rcvid_t rcvid, unsigned delay_us);
+
+/**
+ * Forget every event delivered
+ *
+ * @returns  None
+ */
+void gpio_mock_reset_clients(void);
+
+/**
+ * Wait for an event to be delivered to a client
+ *
+ * @param    rcvid           client identifier, 1 to GPIO_MOCK_MAX_RCVID
+ * @param    seen            number of deliveries already handled
+ * @param    timeout_ms      how long to wait for more
+ *
+ * @returns  Number of events delivered to the client, seen if none came in time
+ */
+uint64_t gpio_mock_wait_delivery(rcvid_t rcvid, uint64_t seen, unsigned timeout_ms);
+
+/**
+ * Run a function in the IST each time it adds a record to an event queue, after it read the queue's
+ * tail and before it publishes the record, as a client reading on another CPU right then would
+ *
+ * @param    hook            function to run, NULL for none
+ *
+ * @returns  None
+ */
+void gpio_mock_set_queue_hook(void (*hook)(void));
+
+/**
+ * Called by the resource manager's event.c through EVENT_QUEUE_TEST_HOOK, runs the hook set
+ *
+ * @returns  None
+ */
+void gpio_mock_queue_hook(void);
+
+#endif
@@ -0,0 +1,10 @@
+/*
+ * Host stand-in for the QNX <sys/iomgr.h>, only what <sys/rpi_gpio.h> needs.
+ */
+
+#ifndef GPIO_MOCK_IOMGR_H
+#define GPIO_MOCK_IOMGR_H
+
+#define _IOMGR_PRIVATE_BASE 0xf000
+
+#endif
@@ -0,0 +1,22 @@
+/*
+ * Host stand-in for the QNX <sys/iomsg.h>, only the types <sys/rpi_gpio.h> needs.
+ */
+
+#ifndef GPIO_MOCK_IOMSG_H
+#define GPIO_MOCK_IOMSG_H
+
+#include <signal.h>
+#include <stdint.h>
+#include <sys/neutrino.h>
+
+#define _IO_MSG 0x113
+
+struct _io_msg
+{
+    uint16_t type;
+    uint16_t combine_len;
+    uint16_t mgrid;
+    uint16_t subtype;
+};
+
+#endif
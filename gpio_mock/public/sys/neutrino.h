@@ -0,0 +1,46 @@
+/*
+ * Host stand-in for the QNX <sys/neutrino.h>, only what the rpi_gpio resource
+ * manager sources use. ClockCycles() counts CLOCK_MONOTONIC nanoseconds, and
+ * the interrupt and event calls are implemented by gpio_mock.c.
+ */
+
+#ifndef GPIO_MOCK_NEUTRINO_H
+#define GPIO_MOCK_NEUTRINO_H
+
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+
+#define __PAGESIZE 4096
+#define PROT_NOCACHE 0
+#define MAP_PHYS 0
+#define NOFD (-1)
+
+#define EOK 0
+
+#define _NTO_INTR_WAIT_FLAGS_FAST 0x2
+
+#define SIGEV_INTR_INIT(e) ((e)->sigev_notify = SIGEV_NONE)
+
+typedef long rcvid_t;
+
+int InterruptAttachEvent(int intr, const struct sigevent *event, unsigned flags);
+int InterruptWait(int flags, const uint64_t *timeout);
+int InterruptUnmask(int intr, int id);
+int MsgDeliverEvent(rcvid_t rcvid, const struct sigevent *event);
+
+static inline void nanospin_ns(unsigned long ns)
+{
+    (void)ns;
+}
+
+static inline uint64_t ClockCycles(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+#endif
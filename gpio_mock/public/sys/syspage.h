@@ -0,0 +1,20 @@
+/*
+ * Host stand-in for the QNX <sys/syspage.h>, only the ClockCycles() rate.
+ */
+
+#ifndef GPIO_MOCK_SYSPAGE_H
+#define GPIO_MOCK_SYSPAGE_H
+
+#include <stdint.h>
+
+struct qtime_entry
+{
+    uint64_t cycles_per_sec;
+};
+
+// ClockCycles() counts nanoseconds
+static const struct qtime_entry gpio_mock_qtime = {1000000000};
+
+#define SYSPAGE_ENTRY(entry) (&gpio_mock_##entry)
+
+#endif
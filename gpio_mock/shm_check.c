@@ -0,0 +1,175 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/rpi_gpio_shm.h>
+#include "rpi_gpio_priv.h"
+
+// Reads timed with the writer idle and busy
+#define READS 1000000
+
+// Readers checking snapshots while the writer runs
+#define READERS 2
+
+#define ALL_PINS ((UINT64_C(1) << RPI_GPIO_NUM) - 1)
+
+int verbose;
+
+static char path[64];
+static atomic_int writing;
+static atomic_ulong updates;
+
+// Stands in for the IST: update n is published at time n with levels n, and with
+// an edge on every pin, so every field of a consistent snapshot equals n
+static void *writer_thread(void *arg)
+{
+    uint64_t n = atomic_load(&updates);
+
+    while (atomic_load_explicit(&writing, memory_order_relaxed))
+    {
+        n++;
+        shm_update(n & ALL_PINS, ALL_PINS, n);
+        atomic_store_explicit(&updates, n, memory_order_relaxed);
+    }
+
+    return NULL;
+}
+
+typedef struct
+{
+    uint64_t snapshots;
+    uint64_t torn;
+    uint64_t backwards;
+} reader_result_t;
+
+static void *reader_thread(void *arg)
+{
+    reader_result_t *result = arg;
+    rpi_gpio_shm_t *shm = rpi_gpio_shm_open(path);
+    rpi_gpio_snapshot_t snap;
+    unsigned last_seq = 0;
+
+    if (shm == NULL)
+    {
+        perror("rpi_gpio_shm_open");
+        result->torn = 1;
+        return NULL;
+    }
+
+    while (atomic_load_explicit(&writing, memory_order_relaxed))
+    {
+        unsigned seq = rpi_gpio_shm_read(shm, &snap);
+        uint64_t n = snap.update_cycles;
+        int ok = snap.levels == (n & ALL_PINS);
+
+        for (int gpio = 0; gpio < RPI_GPIO_NUM; gpio++)
+        {
+            ok &= snap.edge_cycles[gpio] == n && snap.edge_count[gpio] == (uint32_t)n;
+        }
+
+        result->torn += !ok;
+        result->backwards += (int)(seq - last_seq) < 0;
+        result->snapshots++;
+        last_seq = seq;
+    }
+
+    rpi_gpio_shm_close(shm);
+    return NULL;
+}
+
+// ns per call of rpi_gpio_shm_levels and rpi_gpio_shm_read
+static void time_reads(rpi_gpio_shm_t *shm, const char *name)
+{
+    rpi_gpio_snapshot_t snap;
+    uint64_t sum = 0;
+
+    uint64_t start = ClockCycles();
+    for (int i = 0; i < READS; i++)
+    {
+        sum += rpi_gpio_shm_levels(shm);
+    }
+    uint64_t levels_ns = ClockCycles() - start;
+
+    start = ClockCycles();
+    for (int i = 0; i < READS; i++)
+    {
+        rpi_gpio_shm_read(shm, &snap);
+        sum += snap.levels;
+    }
+    uint64_t read_ns = ClockCycles() - start;
+
+    printf("%s writer: levels %.1f ns, snapshot %.1f ns (%llx)\n", name, (double)levels_ns / READS,
+           (double)read_ns / READS, (unsigned long long)(sum & 0xf));
+}
+
+int main()
+{
+    pthread_t writer;
+    pthread_t readers[READERS];
+    reader_result_t results[READERS] = {{0}};
+    int ok = 1;
+
+    snprintf(path, sizeof(path), "/rpi_gpio_check.%d", (int)getpid());
+
+    if (!shm_init(path, 1000000000, 0, 0))
+    {
+        return EXIT_FAILURE;
+    }
+
+    rpi_gpio_shm_t *shm = rpi_gpio_shm_open(path);
+    if (shm == NULL)
+    {
+        perror("rpi_gpio_shm_open");
+        shm_unlink(path);
+        return EXIT_FAILURE;
+    }
+
+    time_reads(shm, "idle");
+
+    atomic_store(&writing, 1);
+    pthread_create(&writer, NULL, writer_thread, NULL);
+    time_reads(shm, "busy");
+
+    for (int i = 0; i < READERS; i++)
+    {
+        pthread_create(&readers[i], NULL, reader_thread, &results[i]);
+    }
+    sleep(1);
+    atomic_store(&writing, 0);
+    pthread_join(writer, NULL);
+
+    for (int i = 0; i < READERS; i++)
+    {
+        pthread_join(readers[i], NULL);
+        printf("reader %d: %llu snapshots, %llu torn, %llu out of order\n", i,
+               (unsigned long long)results[i].snapshots, (unsigned long long)results[i].torn,
+               (unsigned long long)results[i].backwards);
+        ok &= results[i].snapshots > 0 && results[i].torn == 0 && results[i].backwards == 0;
+    }
+    printf("%llu updates\n", (unsigned long long)atomic_load(&updates));
+    rpi_gpio_shm_close(shm);
+
+    // a fresh object carries exactly the updates made to it
+    if (!shm_init(path, 2000000000, 1, 10) || (shm = rpi_gpio_shm_open(path)) == NULL)
+    {
+        shm_unlink(path);
+        return EXIT_FAILURE;
+    }
+    shm_update(UINT64_C(1) << 53 | 1, UINT64_C(1) << 53, 1000);
+    rpi_gpio_snapshot_t snap;
+    unsigned seq = rpi_gpio_shm_read(shm, &snap);
+    if (seq != 2 || snap.levels != (UINT64_C(1) << 53 | 1) || snap.update_cycles != 1000 ||
+        snap.edge_cycles[53] != 1000 || snap.edge_count[53] != 1 || snap.edge_count[0] != 0 ||
+        snap.edge_cycles[0] != 0 || rpi_gpio_shm_cycles_to_ns(shm, 3000) != 1500)
+    {
+        printf("snapshot does not match the update\n");
+        ok = 0;
+    }
+    rpi_gpio_shm_close(shm);
+    shm_unlink(path);
+
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
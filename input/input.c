@@ -0,0 +1,151 @@
+#include <string.h>
+
+#include "public/input.h"
+
+void input_reset(Input *input, const int pins[2][ACTION_COUNT]) {
+  memset(input, 0, sizeof(*input));
+  input->debouncer.samples = DEBOUNCE_SAMPLES;
+  memcpy(input->pins, pins, sizeof(input->pins));
+}
+
+void input_use_events(Input *input, uint64_t levels) {
+  input->events = 1;
+  input->levels = levels;
+  input->raw = levels;
+  // edges are debounced as they come in, every tick's sample is taken as is
+  input->debouncer.samples = 1;
+}
+
+uint64_t debounce(Debouncer *d, uint64_t sample) {
+  uint64_t delta = sample ^ d->state;
+
+  // count consecutive disagreeing samples, reset the pins that agree
+  d->cnt1 = (d->cnt1 ^ d->cnt0) & delta;
+  d->cnt0 = ~d->cnt0 & delta;
+
+  uint64_t toggle = delta & (d->samples & 1 ? d->cnt0 : ~d->cnt0) &
+                    (d->samples & 2 ? d->cnt1 : ~d->cnt1);
+  d->state ^= toggle;
+  d->cnt0 &= ~toggle;
+  d->cnt1 &= ~toggle;
+  return toggle;
+}
+
+void input_inject_edge(Input *input, unsigned gpio, unsigned level,
+                       uint64_t ns) {
+  InputQueue *q = &input->queue;
+  unsigned head = atomic_load_explicit(&q->head, memory_order_relaxed);
+  unsigned tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+  if (head - tail == INPUT_QUEUE_SIZE) {
+    input->stats.dropped++;
+    return;
+  }
+
+  InputEdge *e = &q->edges[head % INPUT_QUEUE_SIZE];
+  e->ns = ns;
+  e->gpio = gpio;
+  e->level = level;
+  atomic_store_explicit(&q->head, head + 1, memory_order_release);
+}
+
+// makes an edge a pin's level and holds the level for DEBOUNCE_EDGE_NS, the
+// edges that follow in that time are bounce
+static void accept_edge(Input *input, unsigned gpio, unsigned level,
+                        uint64_t ns) {
+  uint64_t bit = (uint64_t)1 << gpio;
+
+  if (level) {
+    input->levels |= bit;
+    if (input->presses[gpio] < UINT8_MAX)
+      input->presses[gpio]++;
+    input->pending |= bit;
+  } else {
+    input->levels &= ~bit;
+  }
+  input->edge_ns[gpio] = ns;
+  input->settling |= bit;
+}
+
+// ends the bounce window of a pin if it is over by time ns. The level of the
+// last edge inside the window, held back so far, becomes the pin's level and
+// starts a window of its own.
+static void settle(Input *input, unsigned gpio, uint64_t ns) {
+  uint64_t bit = (uint64_t)1 << gpio;
+
+  while ((input->settling & bit) &&
+         ns - input->edge_ns[gpio] >= DEBOUNCE_EDGE_NS) {
+    input->settling &= ~bit;
+    if ((input->raw ^ input->levels) & bit)
+      accept_edge(input, gpio, (input->raw & bit) != 0,
+                  input->edge_ns[gpio] + DEBOUNCE_EDGE_NS);
+  }
+}
+
+// applies the edges pushed since the previous tick to the tracked levels
+static void consume_edges(Input *input, uint64_t now) {
+  InputQueue *q = &input->queue;
+  unsigned tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  unsigned head = atomic_load_explicit(&q->head, memory_order_acquire);
+
+  for (; tail != head; tail++) {
+    InputEdge *e = &q->edges[tail % INPUT_QUEUE_SIZE];
+    uint64_t bit = (uint64_t)1 << e->gpio;
+
+    settle(input, e->gpio, e->ns);
+    if (e->level)
+      input->raw |= bit;
+    else
+      input->raw &= ~bit;
+
+    if (input->settling & bit) {
+      if (e->level)
+        input->stats.bounced++;
+    } else if (((input->levels & bit) != 0) != (e->level != 0)) {
+      accept_edge(input, e->gpio, e->level, e->ns);
+    }
+
+    input->stats.edges++;
+    if (now - e->ns > input->stats.max_latency_ns)
+      input->stats.max_latency_ns = now - e->ns;
+  }
+  atomic_store_explicit(&q->tail, tail, memory_order_release);
+
+  for (uint64_t bits = input->settling; bits; bits &= bits - 1)
+    settle(input, __builtin_ctzll(bits), now);
+}
+
+void input_poll(Input *input, uint64_t sample, uint64_t now,
+                InputState *state) {
+  if (input->events) {
+    consume_edges(input, now);
+    sample = input->levels;
+
+    // every press gets a tick of its own, shown released first if the
+    // previous tick still saw the pin held
+    for (uint64_t bits = input->pending; bits; bits &= bits - 1) {
+      unsigned gpio = __builtin_ctzll(bits);
+      uint64_t bit = (uint64_t)1 << gpio;
+
+      if (input->debouncer.state & bit) {
+        sample &= ~bit;
+      } else {
+        sample |= bit;
+        if (--input->presses[gpio] == 0)
+          input->pending &= ~bit;
+      }
+    }
+  }
+
+  uint64_t toggle = debounce(&input->debouncer, sample);
+  state->held = input->debouncer.state;
+  state->pressed = toggle & state->held;
+  state->released = toggle & ~state->held;
+
+  for (int p = 0; p < 2; p++) {
+    state->actions[p] = 0;
+    for (int a = 0; a < ACTION_COUNT; a++) {
+      if (state->held & (uint64_t)1 << input->pins[p][a])
+        state->actions[p] |= 1u << a;
+    }
+  }
+}
@@ -0,0 +1,160 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include <game.h>
+
+/*
+ * Button input stage, independent of the screen and of how the pins are read.
+ *
+ * Pins are either polled, one sample of all of them per tick, or reported as
+ * timestamped edges pushed from another thread. Either way every tick gets the
+ * debounced level of every pin, the pins pressed and released since the
+ * previous tick and both players' ACTION_* bits.
+ */
+
+// pins covered, one bit each
+#define INPUT_PINS 64
+// edges buffered between ticks, must be a power of 2
+#define INPUT_QUEUE_SIZE 256
+// consecutive polled samples a pin must disagree with its debounced level
+// before the level changes, 1 to 3
+#define DEBOUNCE_SAMPLES 2
+// edges closer than this to the last edge that changed a pin's level are
+// contact bounce, the pin keeps its level until then
+#define DEBOUNCE_EDGE_NS 5000000
+
+// a button edge
+typedef struct {
+  uint64_t ns;
+  uint32_t gpio;
+  uint32_t level;
+} InputEdge;
+
+// single producer (pulse thread), single consumer (simulation) ring
+typedef struct {
+  InputEdge edges[INPUT_QUEUE_SIZE];
+  atomic_uint head;
+  atomic_uint tail;
+} InputQueue;
+
+// bit-parallel debouncer over all pins
+typedef struct {
+  // debounced levels
+  uint64_t state;
+  // 2-bit vertical counter of consecutive samples disagreeing with state
+  uint64_t cnt0;
+  uint64_t cnt1;
+  // samples needed to change a level, 1 to 3
+  unsigned samples;
+} Debouncer;
+
+// buttons as seen by one tick
+typedef struct {
+  // debounced pin levels
+  uint64_t held;
+  // pins whose debounced level went high/low this tick
+  uint64_t pressed;
+  uint64_t released;
+  // ACTION_* bitmask of each player
+  unsigned actions[2];
+} InputState;
+
+typedef struct {
+  unsigned long edges;
+  // edges lost to a full queue, here or wherever they came from
+  unsigned long dropped;
+  // presses ignored as contact bounce
+  unsigned long bounced;
+  // longest time between an edge and the tick consuming it
+  uint64_t max_latency_ns;
+} InputStats;
+
+typedef struct {
+  InputQueue queue;
+  InputStats stats;
+  Debouncer debouncer;
+  // 0 when pins are polled, 1 when their edges are pushed
+  int events;
+  // pin levels tracked from the edges consumed so far, bounce left out
+  uint64_t levels;
+  // level reported by the last edge of each pin, bounce included
+  uint64_t raw;
+  // pins within DEBOUNCE_EDGE_NS of the edge that last changed their level
+  uint64_t settling;
+  // presses not shown to a tick yet, per pin
+  uint8_t presses[INPUT_PINS];
+  // pins with presses not shown to a tick yet
+  uint64_t pending;
+  // time of the edge that last changed each pin's level
+  uint64_t edge_ns[INPUT_PINS];
+  // pin of each action bit for each player
+  int pins[2][ACTION_COUNT];
+} Input;
+
+/**
+ * Start over with polled pins, all low.
+ *
+ * @param    input   input stage to reset
+ * @param    pins    pin of each action bit for each player
+ */
+void input_reset(Input *input, const int pins[2][ACTION_COUNT]);
+
+/**
+ * Switch to edges pushed with input_inject_edge. Edges are debounced as they
+ * are consumed, so every tick's levels are taken as they are.
+ *
+ * @param    input   input stage, reset
+ * @param    levels  bit n set if pin n is high before the first edge
+ */
+void input_use_events(Input *input, uint64_t levels);
+
+/**
+ * Feed one sample of every pin to a debouncer.
+ *
+ * @param    d       debouncer
+ * @param    sample  bit n set if pin n is high
+ * @returns  pins whose debounced level toggled
+ */
+uint64_t debounce(Debouncer *d, uint64_t sample);
+
+/**
+ * Push an edge, from the one thread producing edges only. An edge that does
+ * not fit in the queue is counted as dropped.
+ *
+ * @param    input   input stage using events
+ * @param    gpio    pin, below INPUT_PINS
+ * @param    level   new level of the pin
+ * @param    ns      CLOCK_MONOTONIC time of the edge
+ */
+void input_inject_edge(Input *input, unsigned gpio, unsigned level,
+                       uint64_t ns);
+
+/**
+ * Collect the buttons for the next tick. Polled pins go through the
+ * debouncer. With edges every press shows up as held for a tick, in the
+ * pressed bits of that tick, even if the button was already released:
+ * presses of a pin that come faster than that are queued, a tick showing the
+ * pin released between two of them. An edge that changes a pin's level
+ * holds it for DEBOUNCE_EDGE_NS: the edges that follow in that time are
+ * bounce, and only the level they leave the pin at counts once it is over.
+ *
+ * @param    input   input stage
+ * @param    sample  levels of all pins when polling, ignored with edges
+ * @param    now     CLOCK_MONOTONIC time of the tick
+ * @param    state   buttons of the tick (output)
+ */
+void input_poll(Input *input, uint64_t sample, uint64_t now,
+                InputState *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,186 @@
+#include <game.h>
+#include <input.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// pin the traces are played on
+#define PIN 26
+// traces start here, well away from the zeroed edge times of a reset stage
+#define START_NS ((uint64_t)1000000000)
+
+static const int pins[2][ACTION_COUNT] = {
+    {26, 17, 22, 27},
+    {18, 25, 5, 6},
+};
+
+typedef struct {
+  uint32_t us;
+  uint32_t level;
+} TraceEdge;
+
+// edges of one button and the ticks looking at it, times in microseconds from
+// the start of the trace, both lists ending at a 0 time
+typedef struct {
+  const char *name;
+  TraceEdge edges[16];
+  uint32_t ticks[8];
+  // held level each tick must see, X for pressed and _ for released
+  const char *held;
+  // presses that must be counted as bounce
+  unsigned long bounced;
+} Trace;
+
+static const Trace traces[] = {
+    {"clean press",
+     {{20000, 1}, {80000, 0}},
+     {15000, 30000, 45000, 60000, 75000, 90000, 105000},
+     "_XXXX__",
+     0},
+    // closing contacts chatter for about a millisecond before they settle
+    {"press bounce",
+     {{20000, 1}, {20300, 0}, {20500, 1}, {21200, 0}, {21300, 1}, {80000, 0}},
+     {15000, 30000, 45000, 60000, 75000, 90000, 105000},
+     "_XXXX__",
+     2},
+    // opening contacts touch again right after they part
+    {"release bounce",
+     {{20000, 1}, {80000, 0}, {80400, 1}, {80700, 0}, {81500, 1}, {81600, 0}},
+     {15000, 30000, 45000, 60000, 75000, 90000, 105000},
+     "_XXXX__",
+     2},
+    // a tick lands between the edges of the bounce on either side
+    {"bounce across ticks",
+     {{14800, 1}, {14900, 0}, {15100, 1}, {15600, 0}, {16000, 1}, {60000, 0},
+      {60400, 1}, {60700, 0}},
+     {15000, 30000, 45000, 60500, 75000},
+     "XXX__",
+     3},
+    // catch-up ticks run back to back: the first sees the release, the next
+    // one lands in its bounce
+    {"release bounce on catch-up tick",
+     {{10000, 1}, {30000, 0}, {30500, 1}, {31000, 0}},
+     {15000, 30200, 30600, 45000},
+     "X___",
+     1},
+    // a tap shorter than a tick, bouncing on both edges
+    {"bouncing tap",
+     {{20000, 1}, {20200, 0}, {20400, 1}, {26000, 0}, {26300, 1}, {26500, 0}},
+     {15000, 30000, 45000},
+     "_X_",
+     2},
+    // pressed again past the bounce time of the release
+    {"double press",
+     {{10000, 1}, {40000, 0}, {47000, 1}, {80000, 0}},
+     {15000, 30000, 45000, 60000, 75000, 90000},
+     "XX_XX_",
+     0},
+    // pressed again within the bounce time of the release and held: the
+    // press counts once the bounce time is over
+    {"press within bounce time",
+     {{10000, 1}, {40000, 0}, {42000, 1}, {80000, 0}},
+     {15000, 41000, 44000, 46000, 90000},
+     "X__X_",
+     1},
+};
+
+// plays a trace through input_poll, 1 if every tick saw what it should
+static int check_trace(const Trace *t) {
+  Input input;
+  InputState state;
+  char held[8 + 1];
+  unsigned long pressed = 0, released = 0, expect_pressed = 0,
+                expect_released = 0;
+  int ok = 1, e = 0, n;
+
+  input_reset(&input, pins);
+  input_use_events(&input, 0);
+
+  for (n = 0; t->ticks[n]; n++) {
+    for (; t->edges[e].us && t->edges[e].us <= t->ticks[n]; e++)
+      input_inject_edge(&input, PIN, t->edges[e].level,
+                        START_NS + t->edges[e].us * (uint64_t)1000);
+    input_poll(&input, 0, START_NS + t->ticks[n] * (uint64_t)1000, &state);
+
+    int was = n > 0 && t->held[n - 1] == 'X';
+    int is = t->held[n] == 'X';
+    held[n] = state.held >> PIN & 1 ? 'X' : '_';
+    pressed += state.pressed >> PIN & 1;
+    released += state.released >> PIN & 1;
+    expect_pressed += !was && is;
+    expect_released += was && !is;
+
+    // only the pin of the trace moves, and its action follows it
+    ok &= (state.held & ~((uint64_t)1 << PIN)) == 0;
+    ok &= state.actions[0] == (held[n] == 'X' ? ACTION_LEFT : 0u) &&
+          state.actions[1] == 0;
+  }
+  held[n] = '\0';
+
+  ok &= strcmp(held, t->held) == 0 && pressed == expect_pressed &&
+        released == expect_released && input.stats.bounced == t->bounced &&
+        input.stats.dropped == 0;
+  printf("bounce: %-32s %s, expected %s, %lu bounced %s\n", t->name, held,
+         t->held, input.stats.bounced, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+typedef struct {
+  unsigned samples;
+  // one polled sample per tick, 1 for high
+  const char *sample;
+  // debounced level after each sample
+  const char *held;
+} PollTrace;
+
+static const PollTrace poll_traces[] = {
+    {1, "0101110110001", "0101110110001"},
+    {2, "0101110110001", "0000111111000"},
+    {3, "0101110110001", "0000011111100"},
+    // a 2-sample glitch gets through 2 samples but not 3
+    {2, "0001100000111", "0000110000011"},
+    {3, "0001100000111", "0000000000001"},
+};
+
+// plays polled samples through input_poll, on one pin and inverted on another
+// so that the bit-parallel counters are seen not to mix pins
+static int check_poll(const PollTrace *t) {
+  Input input;
+  InputState state;
+  char held[16 + 1], other[16 + 1];
+  int ok = 1, n;
+
+  input_reset(&input, pins);
+  input.debouncer.samples = t->samples;
+  // the other pin starts high, settled
+  input.debouncer.state = (uint64_t)1 << pins[1][0];
+
+  for (n = 0; t->sample[n]; n++) {
+    uint64_t sample = t->sample[n] == '1' ? (uint64_t)1 << PIN
+                                          : (uint64_t)1 << pins[1][0];
+    input_poll(&input, sample, 0, &state);
+    held[n] = state.held >> PIN & 1 ? '1' : '0';
+    other[n] = state.held >> pins[1][0] & 1 ? '0' : '1';
+    ok &= ((state.pressed | state.released) & ~((uint64_t)1 << PIN |
+                                                (uint64_t)1 << pins[1][0])) ==
+          0;
+  }
+  held[n] = other[n] = '\0';
+
+  ok &= strcmp(held, t->held) == 0 && strcmp(other, t->held) == 0;
+  printf("poll: %u samples %s -> %s, expected %s %s\n", t->samples, t->sample,
+         held, t->held, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+int main() {
+  int ok = 1;
+
+  for (size_t i = 0; i < sizeof(traces) / sizeof(traces[0]); i++)
+    ok &= check_trace(&traces[i]);
+  for (size_t i = 0; i < sizeof(poll_traces) / sizeof(poll_traces[0]); i++)
+    ok &= check_poll(&poll_traces[i]);
+
+  printf("%s\n", ok ? "ok" : "FAILED");
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,202 @@
+#include <game.h>
+#include <input.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// presses made on the player pins
+#define PRESSES 2000
+#define TICK_NS ((uint64_t)GAME_CLOCK_DELAY * 1000000)
+// presses are held MIN_EDGE_MS to MAX_HOLD_MS, taps shorter than a tick
+// included
+#define MAX_HOLD_MS 30
+// a button rests MIN_EDGE_MS to MAX_REST_MS between its presses, so a pin is
+// often pressed twice between two ticks
+#define MAX_REST_MS 20
+// edges of a pin closer than DEBOUNCE_EDGE_NS are bounce, real presses and
+// releases are further apart
+#define MIN_EDGE_MS (DEBOUNCE_EDGE_NS / 1000000 + 1)
+// most time between two presses on any pin
+#define MAX_GAP_MS 4
+
+static const int pins[2][ACTION_COUNT] = {
+    {26, 17, 22, 27},
+    {18, 25, 5, 6},
+};
+
+typedef struct {
+  uint64_t ns;
+  unsigned gpio;
+  unsigned level;
+  // press this edge belongs to
+  int press;
+} ScheduledEdge;
+
+typedef struct {
+  unsigned gpio;
+  uint64_t ns;
+  // tick that saw it, -1 until then
+  long tick;
+} Press;
+
+static ScheduledEdge schedule[2 * PRESSES];
+static Press presses[PRESSES];
+
+static int by_time(const void *a, const void *b) {
+  const ScheduledEdge *x = a, *y = b;
+  return x->ns < y->ns ? -1 : x->ns > y->ns;
+}
+
+static uint64_t random_ms(unsigned min, unsigned max) {
+  return (min + rand() % (max - min + 1)) * (uint64_t)1000000;
+}
+
+// presses on random pins, each pin resting between its presses
+static void make_schedule() {
+  uint64_t free_at[ACTION_COUNT * 2] = {0};
+  uint64_t t = TICK_NS;
+
+  for (int k = 0; k < PRESSES; k++) {
+    int p;
+    do {
+      p = rand() % (ACTION_COUNT * 2);
+      if (free_at[p] > t)
+        t += 1000000;
+    } while (free_at[p] > t);
+
+    uint64_t hold = random_ms(MIN_EDGE_MS, MAX_HOLD_MS);
+    unsigned gpio = pins[p / ACTION_COUNT][p % ACTION_COUNT];
+    presses[k] = (Press){gpio, t, -1};
+    schedule[2 * k] = (ScheduledEdge){t, gpio, 1, k};
+    schedule[2 * k + 1] = (ScheduledEdge){t + hold, gpio, 0, -1};
+    free_at[p] = t + hold + random_ms(MIN_EDGE_MS, MAX_REST_MS);
+    t += random_ms(0, MAX_GAP_MS);
+  }
+
+  qsort(schedule, 2 * PRESSES, sizeof(schedule[0]), by_time);
+}
+
+// a queue filled between two ticks keeps every edge, the next one is dropped,
+// and every press kept comes out of the following ticks
+static int check_burst() {
+  Input burst;
+  InputState state;
+  uint64_t ns = 0;
+  unsigned long pressed = 0;
+  unsigned first[2];
+
+  input_reset(&burst, pins);
+  input_use_events(&burst, 0);
+  for (int i = 0; i <= INPUT_QUEUE_SIZE; i++) {
+    int p = i / 2 % (ACTION_COUNT * 2);
+    ns += DEBOUNCE_EDGE_NS;
+    input_inject_edge(&burst, pins[p / ACTION_COUNT][p % ACTION_COUNT], ~i & 1,
+                      ns);
+  }
+  for (int tick = 0; tick < INPUT_QUEUE_SIZE; tick++) {
+    input_poll(&burst, 0, ns + tick * TICK_NS, &state);
+    if (tick == 0)
+      memcpy(first, state.actions, sizeof(first));
+    pressed += __builtin_popcountll(state.pressed);
+  }
+
+  printf("burst: %lu edges, %lu dropped, %lu pressed, first actions %x %x\n",
+         burst.stats.edges, burst.stats.dropped, pressed, first[0], first[1]);
+  return burst.stats.edges == INPUT_QUEUE_SIZE && burst.stats.dropped == 1 &&
+         pressed == INPUT_QUEUE_SIZE / 2 && first[0] == (1u << ACTION_COUNT) - 1 &&
+         first[1] == (1u << ACTION_COUNT) - 1;
+}
+
+int main() {
+  // next press expected on each pin
+  int next[INPUT_PINS];
+  // tick that saw the previous press of each pin
+  long shown[INPUT_PINS];
+  // last two ticks that saw each pin released
+  long released[INPUT_PINS][2];
+  uint64_t max_latency = 0, sum_latency = 0;
+  long seen = 0, spurious = 0, late = 0, queued = 0;
+  long tick = 0;
+  Input input;
+
+  srand(1);
+  make_schedule();
+  for (int g = 0; g < INPUT_PINS; g++) {
+    next[g] = 0;
+    shown[g] = -1;
+    released[g][0] = released[g][1] = -1;
+  }
+
+  input_reset(&input, pins);
+  input_use_events(&input, 0);
+
+  // ticks on a synthetic clock, each taking the edges up to its time, until a
+  // second after the last edge
+  uint64_t end = schedule[2 * PRESSES - 1].ns + 1000000000;
+  for (int e = 0; tick * TICK_NS < end; tick++) {
+    uint64_t now = (tick + 1) * TICK_NS;
+    InputState state;
+
+    for (; e < 2 * PRESSES && schedule[e].ns <= now; e++)
+      input_inject_edge(&input, schedule[e].gpio, schedule[e].level,
+                        schedule[e].ns);
+    input_poll(&input, 0, now, &state);
+
+    for (uint64_t bits = state.pressed; bits; bits &= bits - 1) {
+      unsigned gpio = __builtin_ctzll(bits);
+
+      // presses on a pin come out in the order they went in
+      while (next[gpio] < PRESSES && presses[next[gpio]].gpio != gpio)
+        next[gpio]++;
+      if (next[gpio] == PRESSES || presses[next[gpio]].ns > now) {
+        spurious++;
+        continue;
+      }
+
+      // seen by the first tick after it, unless the pin was held then or its
+      // previous press was not shown yet: each press needs a tick that saw the
+      // pin released before it, and the one before this tick must be the
+      // first such tick since the press and the previous one were seen
+      Press *p = &presses[next[gpio]++];
+      long first = (long)((p->ns + TICK_NS - 1) / TICK_NS) - 1;
+      long since = first > shown[gpio] + 1 ? first : shown[gpio] + 1;
+      p->tick = tick;
+      late += released[gpio][1] >= since;
+      queued += tick > first;
+      shown[gpio] = tick;
+      seen++;
+      sum_latency += now - p->ns;
+      if (now - p->ns > max_latency)
+        max_latency = now - p->ns;
+    }
+
+    for (int p = 0; p < ACTION_COUNT * 2; p++) {
+      unsigned gpio = pins[p / ACTION_COUNT][p % ACTION_COUNT];
+      if (!(state.held >> gpio & 1)) {
+        released[gpio][1] = released[gpio][0];
+        released[gpio][0] = tick;
+      }
+    }
+  }
+
+  long missed = 0;
+  for (int k = 0; k < PRESSES; k++)
+    missed += presses[k].tick == -1;
+
+  printf("inject: %d presses over %ld ticks, %ld seen, %ld missed, %ld late, "
+         "%ld spurious\n",
+         PRESSES, tick, seen, missed, late, spurious);
+  printf("inject: %lu edges, %lu dropped, %lu bounced, %ld presses queued "
+         "behind another of their pin\n",
+         input.stats.edges, input.stats.dropped, input.stats.bounced, queued);
+  printf("inject: press to tick latency avg %.2f max %.2f ms, tick %.2f ms\n",
+         seen ? sum_latency / 1e6 / seen : 0, max_latency / 1e6,
+         TICK_NS / 1e6);
+
+  int ok = check_burst();
+  ok &= seen == PRESSES && missed == 0 && late == 0 && spurious == 0 &&
+        queued > 0 && input.stats.edges == 2 * PRESSES &&
+        input.stats.dropped == 0 && input.stats.bounced == 0;
+  printf("%s\n", ok ? "ok" : "FAILED");
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,268 @@
+#include <errno.h>
+#include <game.h>
+#include <game_record.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// ticks between two hashes printed, 1000 ticks is 15s of play
+#define DEFAULT_HASH_TICKS 1000
+
+#define TRACE_MAGIC 0x52544651 // "QFTR"
+#define TRACE_VERSION 1
+
+// a trace is a TraceHeader followed by a TraceTick for every tick replayed
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  // layout check, a trace is only comparable with one from the same layout
+  uint32_t tick_size;
+} TraceHeader;
+
+typedef struct {
+  uint64_t hash;
+  GameState state;
+} TraceTick;
+
+uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [-c ticks] [-f] [-n runs] [-t trace] recording\n"
+          "       %s -d trace trace\n"
+          "  -c ticks  print the state hash every n ticks, 0 for the last only\n"
+          "  -d        report the first tick where two traces differ\n"
+          "  -f        replay even if the recording's constants differ\n"
+          "  -n runs   replay the recording n times and report the best run\n"
+          "  -t trace  write the hash and state of every tick to a trace\n",
+          name, name);
+}
+
+// whether the recording was made with the constants this build uses
+int check_header(const GameRecordHeader *header) {
+  GameRecordHeader ours;
+  game_record_header(&ours, header->seed);
+  if (memcmp(&ours, header, sizeof(ours)) == 0)
+    return 1;
+
+  printf("recording constants differ from this build:\n");
+  printf("  tick %u/%u ms, hp %u/%u, speed %u/%u, radius %u/%u\n",
+         header->tick_ms, ours.tick_ms, header->max_hp, ours.max_hp,
+         header->movement_speed, ours.movement_speed, header->attack_radius,
+         ours.attack_radius);
+  printf("  cooldowns attack %u/%u hit %u/%u parry %u/%u counter %u/%u\n",
+         header->attack_cd, ours.attack_cd, header->hit_cd, ours.hit_cd,
+         header->parry_cd, ours.parry_cd, header->parry_counter_cd,
+         ours.parry_counter_cd);
+  return 0;
+}
+
+// reads every tick of the recording into memory so the replay itself does no
+// I/O
+uint8_t *load_ticks(GameRecord *rec, size_t *count) {
+  size_t capacity = 1 << 16;
+  uint8_t *ticks = malloc(capacity);
+  *count = 0;
+
+  while (ticks != NULL) {
+    *count += game_record_read(rec, ticks + *count, capacity - *count);
+    if (*count < capacity)
+      return ticks;
+
+    capacity *= 2;
+    uint8_t *grown = realloc(ticks, capacity);
+    if (grown == NULL)
+      free(ticks);
+    ticks = grown;
+  }
+
+  return NULL;
+}
+
+FILE *trace_create(const char *path) {
+  FILE *file = fopen(path, "wb");
+  if (file == NULL)
+    return NULL;
+
+  TraceHeader header = {TRACE_MAGIC, TRACE_VERSION, sizeof(TraceTick)};
+  if (fwrite(&header, sizeof(header), 1, file) != 1) {
+    fclose(file);
+    return NULL;
+  }
+  return file;
+}
+
+FILE *trace_open(const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return NULL;
+
+  TraceHeader header;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      header.magic != TRACE_MAGIC || header.version != TRACE_VERSION ||
+      header.tick_size != sizeof(TraceTick)) {
+    fclose(file);
+    errno = EINVAL;
+    return NULL;
+  }
+  return file;
+}
+
+// runs the whole recording from a fresh game, returns the hash of the last
+// tick
+uint64_t replay(const uint8_t *ticks, size_t count, unsigned long interval,
+                int verbose, FILE *trace) {
+  GameState states[2];
+  game_reset(&states[0]);
+  uint64_t hash = GAME_HASH_INIT;
+
+  for (size_t i = 0; i < count; i++) {
+    unsigned actions[2];
+    GAME_RECORD_UNPACK(ticks[i], actions);
+    GameState *next = &states[~i & 1];
+    game_step(&states[i & 1], actions, next);
+    hash = game_hash(hash, next);
+
+    if (verbose && interval != 0 && (i + 1) % interval == 0)
+      printf("tick %zu hash %016llx\n", i + 1, (unsigned long long)hash);
+
+    if (trace != NULL) {
+      TraceTick t = {hash, *next};
+      fwrite(&t, sizeof(t), 1, trace);
+    }
+  }
+
+  return hash;
+}
+
+// compares two traces tick by tick, prints the first tick they disagree on
+int compare_traces(const char *path_a, const char *path_b) {
+  FILE *a = trace_open(path_a);
+  if (a == NULL) {
+    fprintf(stderr, "%s: %s\n", path_a, strerror(errno));
+    return EXIT_FAILURE;
+  }
+  FILE *b = trace_open(path_b);
+  if (b == NULL) {
+    fprintf(stderr, "%s: %s\n", path_b, strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  for (size_t tick = 1;; tick++) {
+    TraceTick ta, tb;
+    int got_a = fread(&ta, sizeof(ta), 1, a);
+    int got_b = fread(&tb, sizeof(tb), 1, b);
+
+    if (got_a == 0 && got_b == 0) {
+      printf("traces agree on all %zu ticks\n", tick - 1);
+      return EXIT_SUCCESS;
+    }
+    if (got_a == 0 || got_b == 0) {
+      printf("traces agree on %zu ticks, %s is longer\n", tick - 1,
+             got_a == 0 ? path_b : path_a);
+      return EXIT_FAILURE;
+    }
+
+    if (ta.hash != tb.hash) {
+      printf("first divergent tick %zu: hash %016llx != %016llx\n", tick,
+             (unsigned long long)ta.hash, (unsigned long long)tb.hash);
+      if (game_diff(&ta.state, &tb.state, stdout) == 0)
+        printf("  states are identical, a previous tick hashed differently\n");
+      return EXIT_FAILURE;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  unsigned long interval = DEFAULT_HASH_TICKS;
+  int compare = 0;
+  int force = 0;
+  int runs = 1;
+  const char *trace_path = NULL;
+
+  while (1) {
+    int opt = getopt(argc, argv, "c:dfn:t:");
+    if (opt == -1) {
+      break;
+    } else if (opt == 'c') {
+      interval = strtoul(optarg, NULL, 0);
+    } else if (opt == 'd') {
+      compare = 1;
+    } else if (opt == 'f') {
+      force = 1;
+    } else if (opt == 'n') {
+      runs = strtol(optarg, NULL, 0);
+    } else if (opt == 't') {
+      trace_path = optarg;
+    } else {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (compare) {
+    if (optind != argc - 2) {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+    return compare_traces(argv[optind], argv[optind + 1]);
+  }
+
+  if (optind != argc - 1 || runs < 1) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  GameRecord rec;
+  if (game_record_open(&rec, argv[optind]) == -1) {
+    fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  if (check_header(&rec.header) == 0 && force == 0)
+    return EXIT_FAILURE;
+
+  size_t count;
+  uint8_t *ticks = load_ticks(&rec, &count);
+  if (ticks == NULL)
+    perror("malloc"), exit(EXIT_FAILURE);
+  game_record_close(&rec);
+
+  FILE *trace = NULL;
+  if (trace_path != NULL) {
+    trace = trace_create(trace_path);
+    if (trace == NULL) {
+      fprintf(stderr, "%s: %s\n", trace_path, strerror(errno));
+      return EXIT_FAILURE;
+    }
+  }
+
+  uint64_t best_ns = UINT64_MAX;
+  uint64_t hash = 0;
+  for (int run = 0; run < runs; run++) {
+    uint64_t start = now_ns();
+    hash = replay(ticks, count, interval, run == 0, run == 0 ? trace : NULL);
+    uint64_t ns = now_ns() - start;
+    if (ns < best_ns)
+      best_ns = ns;
+  }
+
+  if (trace != NULL && fclose(trace) != 0) {
+    perror(trace_path);
+    return EXIT_FAILURE;
+  }
+
+  printf("final tick %zu hash %016llx\n", count, (unsigned long long)hash);
+  printf("%zu ticks (%.1f s of play) in %.3f ms, %.0f ticks/s\n", count,
+         count * GAME_CLOCK_DELAY / 1000.0, best_ns / 1e6,
+         best_ns == 0 ? 0.0 : count * 1e9 / best_ns);
+
+  free(ticks);
+  return EXIT_SUCCESS;
+}
@@ -185,20 +185,82 @@ client_set_gpio_func(int const gpio, int const func)
     }
 
     if (func == RPI_GPIO_FUNC_IN) {
-        // Request a notification when an input GPIO changes its value.
-        rpi_gpio_event_t    notify = {
-            .hdr.type = _IO_MSG,
-            .hdr.mgrid = RPI_GPIO_IOMGR,
-            .hdr.subtype = RPI_GPIO_ADD_EVENT,
-            .gpio = gpio,
-            .detect = RPI_EVENT_EDGE_FALLING | RPI_EVENT_EDGE_RISING,
-            .event = notify_event
-        };
-
-        if (MsgSend(server_fd, &notify, sizeof(notify), NULL, 0) == -1) {
-            perror("MsgSend(RPI_GPIO_ADD_EVENT)");
-            return -1;
-        }
+        return client_watch_gpio(gpio);
+    }
+
+    return 0;
+}
+
+/**
+ * Request a notification when an input GPIO changes its value.
+ * @param   gpio    The GPIO number
+ * @return  0 if successful, -1 otherwise
+ */
+int
+client_watch_gpio(int const gpio)
+{
+    if (server_fd == -1) {
+        errno = EBADF;
+        return -1;
+    }
+
+    rpi_gpio_event_t    notify = {
+        .hdr.type = _IO_MSG,
+        .hdr.mgrid = RPI_GPIO_IOMGR,
+        .hdr.subtype = RPI_GPIO_ADD_EVENT,
+        .gpio = gpio,
+        .detect = RPI_EVENT_EDGE_FALLING | RPI_EVENT_EDGE_RISING,
+        .event = notify_event
+    };
+
+    if (MsgSend(server_fd, &notify, sizeof(notify), NULL, 0) == -1) {
+        perror("MsgSend(RPI_GPIO_ADD_EVENT)");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Determine the functions of a list of GPIOs in one message.
+ * @param   gpio    The GPIO numbers
+ * @param   func    Receives one of the RPI_GPIO_FUNC* constants per GPIO
+ * @param   count   Number of GPIOs, up to RPI_GPIO_NUM
+ * @return  0 if successful, -1 otherwise
+ */
+int
+client_get_gpio_funcs(int const * const gpio, int * const func,
+                      unsigned const count)
+{
+    if (server_fd == -1) {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (count > RPI_GPIO_NUM) {
+        errno = ERANGE;
+        return -1;
+    }
+
+    rpi_gpio_select_list_t  msg = {
+        .hdr.type = _IO_MSG,
+        .hdr.mgrid = RPI_GPIO_IOMGR,
+        .hdr.subtype = RPI_GPIO_GET_SELECT_LIST,
+        .count = count
+    };
+
+    for (unsigned i = 0; i < count; i++) {
+        msg.list[i].gpio = gpio[i];
+    }
+
+    size_t const    size = RPI_GPIO_SELECT_LIST_SIZE(count);
+    if (MsgSend(server_fd, &msg, size, &msg, size) == -1) {
+        perror("MsgSend(RPI_GPIO_GET_SELECT_LIST)");
+        return -1;
+    }
+
+    for (unsigned i = 0; i < count; i++) {
+        func[i] = msg.list[i].value;
     }
 
     return 0;
@@ -260,3 +322,61 @@ client_set_gpio_value(int const gpio, int const value)
 
     return 0;
 }
+
+/**
+ * Determine the values of all GPIOs in one message.
+ * @param   levels  Receives a mask with bit n set if GPIO n is on
+ * @return  0 if successful, -1 otherwise
+ */
+int
+client_get_gpio_values(uint64_t * const levels)
+{
+    if (server_fd == -1) {
+        errno = EBADF;
+        return -1;
+    }
+
+    rpi_gpio_mask_t msg = {
+        .hdr.type = _IO_MSG,
+        .hdr.mgrid = RPI_GPIO_IOMGR,
+        .hdr.subtype = RPI_GPIO_READ_ALL
+    };
+
+    if (MsgSend(server_fd, &msg, sizeof(msg), &msg, sizeof(msg)) == -1) {
+        perror("MsgSend(RPI_GPIO_READ_ALL)");
+        return -1;
+    }
+
+    *levels = msg.levels;
+    return 0;
+}
+
+/**
+ * Change the values of several output GPIOs in one message.
+ * @param   set     Mask of GPIOs to turn on
+ * @param   clear   Mask of GPIOs to turn off
+ * @return  0 if successful, -1 otherwise
+ */
+int
+client_set_gpio_values(uint64_t const set, uint64_t const clear)
+{
+    if (server_fd == -1) {
+        errno = EBADF;
+        return -1;
+    }
+
+    rpi_gpio_mask_t msg = {
+        .hdr.type = _IO_MSG,
+        .hdr.mgrid = RPI_GPIO_IOMGR,
+        .hdr.subtype = RPI_GPIO_WRITE_MASK,
+        .set = set,
+        .clear = clear
+    };
+
+    if (MsgSend(server_fd, &msg, sizeof(msg), NULL, 0) == -1) {
+        perror("MsgSend(RPI_GPIO_WRITE_MASK)");
+        return -1;
+    }
+
+    return 0;
+}
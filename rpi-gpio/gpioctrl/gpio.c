@@ -201,28 +201,49 @@ gpio_init()
         y += ROW_HEIGHT;
     }
 
-    // Get the current function and value for each GPIO.
+    // Get the current function of all GPIOs in one message, and their values
+    // in another.
+    int         ids[NUM_PINS];
+    int         funcs[NUM_PINS];
+    unsigned    count = 0;
+    for (unsigned i = 0; i < NUM_PINS; i++) {
+        if (gpios[i].id != -1) {
+            ids[count++] = gpios[i].id;
+        }
+    }
+
+    uint64_t    levels;
+    if ((client_get_gpio_funcs(ids, funcs, count) == -1) ||
+        (client_get_gpio_values(&levels) == -1)) {
+        return false;
+    }
+
+    uint64_t    outputs = 0;
+    count = 0;
     for (unsigned i = 0; i < NUM_PINS; i++) {
         if (gpios[i].id == -1) {
             continue;
         }
 
-        gpios[i].func = client_get_gpio_func(gpios[i].id);
+        gpios[i].func = funcs[count++];
         if (gpios[i].func == RPI_GPIO_FUNC_IN) {
-            // Read input value.
-            gpios[i].value = client_get_gpio_value(gpios[i].id);
+            gpios[i].value = (levels >> gpios[i].id) & 1;
 
             // Enable value change notifications.
-            client_set_gpio_func(gpios[i].id, RPI_GPIO_FUNC_IN);
+            client_watch_gpio(gpios[i].id);
         } else if (gpios[i].func == RPI_GPIO_FUNC_OUT) {
-            // Set output to low.
+            // Set output to low, all outputs at once below.
             gpios[i].value = 0;
-            client_set_gpio_value(gpios[i].id, 0);
+            outputs |= UINT64_C(1) << gpios[i].id;
         } else {
             // ALT func, not supported.
         }
     }
 
+    if (outputs != 0) {
+        client_set_gpio_values(0, outputs);
+    }
+
     return true;
 }
 
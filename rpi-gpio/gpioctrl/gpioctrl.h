@@ -28,6 +28,7 @@
 #define GPIOCTRL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <screen/screen.h>
 #include <cairo/cairo.h>
 
@@ -44,6 +45,10 @@ int  client_get_gpio_func(int gpio);
 int  client_set_gpio_func(int gpio, int func);
 int  client_get_gpio_value(int gpio);
 int  client_set_gpio_value(int gpio, int value);
+int  client_watch_gpio(int gpio);
+int  client_get_gpio_funcs(int const *gpio, int *func, unsigned count);
+int  client_get_gpio_values(uint64_t *levels);
+int  client_set_gpio_values(uint64_t set, uint64_t clear);
 void send_event(screen_event_t event);
 
 #endif
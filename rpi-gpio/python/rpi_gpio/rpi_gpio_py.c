@@ -204,8 +204,9 @@ event_thread(void *arg)
             continue;
         }
 
-        // Extract GPIO number.
-        unsigned    gpio = pulse.value.sival_int;
+        // Extract GPIO number, the value is negative when the level is low.
+        int const   value = pulse.value.sival_int;
+        unsigned    gpio = value < 0 ? -value : value;
 
         if (gpio >= RPI_GPIO_NUM) {
             continue;
@@ -214,7 +215,7 @@ event_thread(void *arg)
         // Run callbacks for this GPIO.
         pthread_mutex_lock(&callback_table_lock);
 
-        callback_t  *cb = callback_table[pulse.value.sival_int];
+        callback_t  *cb = callback_table[gpio];
         while (cb != NULL) {
             exec_cb(cb->func, cb->gpio_num);
             cb = cb->next;
@@ -25,8 +25,11 @@
 #include <string.h>
 #include <semaphore.h>
 #include <pthread.h>
+#include <sched.h>
 #include <errno.h>
+#include <stdatomic.h>
 #include <sys/neutrino.h>
+#include <sys/syspage.h>
 #include <sys/rpi_gpio.h>
 #include <aarch64/inline.h>
 #include <aarch64/rpi_gpio.h>
@@ -34,8 +37,42 @@
 
 extern int  verbose;
 
+// Host checks define this to act as the client between the IST reading the
+// tail of a queue and publishing a record, see gpio_mock.
+#ifndef EVENT_QUEUE_TEST_HOOK
+#define EVENT_QUEUE_TEST_HOOK()
+#endif
+
 typedef struct event_entry  event_entry_t;
+typedef struct event_queue  event_queue_t;
+
+/**
+ * Records of the events detected for a client, see RPI_EVENT_QUEUE.
+ * The IST is the only producer, and the main thread, reading the records back
+ * for the client, the only consumer.
+ */
+struct event_queue
+{
+    /** Next queue in the list. */
+    event_queue_t           *next;
+    /** Client identifier. */
+    rcvid_t                 rcvid;
+    /** Index of the next record to add. */
+    atomic_uint             head;
+    /** Index of the next record to read. */
+    atomic_uint             tail;
+    /** Sequence number of the next record. */
+    uint32_t                seq;
+    /** Number of records dropped because the queue was full. */
+    atomic_uint             overflow;
+    rpi_gpio_event_record_t records[RPI_GPIO_EVENT_QUEUE_SIZE];
+};
 
+/**
+ * A client subscribed to the events of a GPIO.
+ * The registration is fixed once the entry is in a table, a new registration
+ * gets a new entry. The counts and the event value are only used by the IST.
+ */
 struct event_entry
 {
     /** Client identifier. */
@@ -48,61 +85,274 @@ struct event_entry
     uint32_t        match;
     /** Number of detected changes towards the match value. */
     uint32_t        match_count;
+    /** Set once an event could not be delivered. */
+    uint32_t        failed;
     /** Event to deliver to the client. */
     struct sigevent sigev;
+    /** Queue for the records of the events, NULL if not requested. */
+    event_queue_t   *queue;
 };
 
-static pthread_t            ist_tid;
-static sem_t                ist_sem;
-static int                  ist_status;
-static pthread_mutex_t      event_mutex = PTHREAD_MUTEX_INITIALIZER;
-static event_entry_t        event_table[RPI_GPIO_NUM];
+/**
+ * Subscribers of every GPIO.
+ * A published table is never modified. The main thread builds each change in
+ * the other table and swaps it in, so that the IST reads the current one
+ * without locking.
+ */
+typedef struct
+{
+    /** Detection types asked for by the subscribers of each GPIO. */
+    unsigned        detect[RPI_GPIO_NUM];
+    /** Number of subscribers of each GPIO. */
+    unsigned        count[RPI_GPIO_NUM];
+    /** Subscribers of each GPIO, in the order they registered. */
+    event_entry_t   *entries[RPI_GPIO_NUM][RPI_GPIO_EVENT_SUBSCRIBERS];
+} event_table_t;
+
+// Width and number of the buckets of the service time histogram, the last one
+// taking all longer times.
+#define IST_BUCKET_NS       RPI_GPIO_IST_STATS_RES
+#define IST_BUCKETS         512
+
+/**
+ * Service times of the IST.
+ * Only written by the IST, so updates need no read-modify-write.
+ */
+typedef struct
+{
+    atomic_uint_fast64_t    count;
+    atomic_uint_fast64_t    sum_ns;
+    atomic_uint_fast64_t    min_ns;
+    atomic_uint_fast64_t    max_ns;
+    atomic_uint             buckets[IST_BUCKETS];
+} ist_stats_t;
+
+static pthread_t                ist_tid;
+static sem_t                    ist_sem;
+static int                      ist_status;
+static uint64_t                 ist_cycles_per_sec;
+static ist_stats_t              ist_stats;
+static atomic_int               ist_stats_reset;
+static event_table_t            event_tables[2];
+static event_table_t * _Atomic  event_table = &event_tables[0];
+static event_table_t * _Atomic  ist_table;
+static event_queue_t           *event_queues;
 
 /**
- * Deliver a GPIO event to a registered client.
+ * Add a record to an event queue.
+ * The record is dropped if the queue is full.
+ * @param   queue   The queue to add to
  * @param   gpio    The gpio for which the event occurred
+ * @param   level   The level of the gpio
+ * @param   cycles  Time at which the event was detected
+ * @return  1 if the client may have read the queue empty before the record
+ *          was added, 0 otherwise
  */
-static void
-dispatch_event(unsigned const gpio)
+static int
+queue_event(event_queue_t * const queue, unsigned const gpio,
+            unsigned const level, uint64_t const cycles)
 {
-    if (event_table[gpio].detect == RPI_EVENT_NONE) {
-        return;
+    unsigned const  head = atomic_load_explicit(&queue->head,
+                                                memory_order_relaxed);
+    unsigned const  tail = atomic_load_explicit(&queue->tail,
+                                                memory_order_acquire);
+    uint32_t const  seq = queue->seq++;
+
+    if (head - tail == RPI_GPIO_EVENT_QUEUE_SIZE) {
+        atomic_fetch_add_explicit(&queue->overflow, 1, memory_order_relaxed);
+        return 0;
     }
 
-    // Get the GPIO value.
-    unsigned const  value = rpi_gpio_read(gpio);
-    if (value) {
-        event_table[gpio].sigev.sigev_value.sival_int = gpio;
+    rpi_gpio_event_record_t * const record =
+        &queue->records[head % RPI_GPIO_EVENT_QUEUE_SIZE];
+    record->cycles = cycles;
+    record->seq = seq;
+    record->gpio = gpio;
+    record->level = level;
+    record->reserved = 0;
+    EVENT_QUEUE_TEST_HOOK();
+
+    // Publish the record to the main thread.
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+    // The client may have read the queue empty since tail was loaded above,
+    // and now waits for the doorbell. Look again after the record is
+    // published; event_read() fences the same way between storing tail and
+    // loading head, so either it sees the record or this sees its tail.
+    atomic_thread_fence(memory_order_seq_cst);
+    return atomic_load_explicit(&queue->tail, memory_order_relaxed) == head;
+}
+
+/**
+ * Deliver a GPIO event to a subscriber.
+ * @param   entry   The subscriber
+ * @param   gpio    The gpio for which the event occurred
+ * @param   value   The level of the gpio
+ * @param   cycles  Time at which the event was detected
+ */
+static void
+deliver_event(event_entry_t * const entry, unsigned const gpio,
+              unsigned const value, uint64_t const cycles)
+{
+    entry->count++;
+
+    if (entry->queue != NULL) {
+        // The event only tells the client to read the queue, which it does
+        // until empty.
+        if (!queue_event(entry->queue, gpio, value, cycles)) {
+            return;
+        }
     } else {
-        event_table[gpio].sigev.sigev_value.sival_int = -gpio;
-    }
+        if (value) {
+            entry->sigev.sigev_value.sival_int = gpio;
+        } else {
+            entry->sigev.sigev_value.sival_int = -gpio;
+        }
 
-    // Update counts.
-    event_table[gpio].count++;
-    event_table[gpio].match_count++;
-    if (event_table[gpio].match_count < event_table[gpio].match) {
-        return;
-    }
+        // Update counts.
+        entry->match_count++;
+        if (entry->match_count < entry->match) {
+            return;
+        }
 
-    event_table[gpio].match_count = 0;
+        entry->match_count = 0;
+    }
 
-    if (event_table[gpio].sigev.sigev_notify == SIGEV_NONE) {
+    if (entry->sigev.sigev_notify == SIGEV_NONE) {
         return;
     }
 
     // Deliver the event to the client thread.
-    if (MsgDeliverEvent(event_table[gpio].rcvid,
-                        &event_table[gpio].sigev) == -1) {
-        // Disable future event deliveries to this receive ID.
-        event_table[gpio].detect = RPI_EVENT_NONE;
+    if (MsgDeliverEvent(entry->rcvid, &entry->sigev) == -1) {
+        // Disable future event deliveries to this subscriber only, the others
+        // keep theirs.
+        entry->failed = 1;
         if (verbose) {
             fprintf(stderr, "Failed to deliver event to %lx: %s\n",
-                    event_table[gpio].rcvid,
-                    strerror(errno));
+                    entry->rcvid, strerror(errno));
+        }
+    }
+}
+
+/**
+ * Deliver a GPIO event to every subscriber that asked for it.
+ * The hardware detects what any of the subscribers asked for, so the level
+ * after the change tells which of them the change is for: a high level
+ * follows a rising edge or comes with a high level event, a low level the
+ * opposite. A change nobody asked for, from a pulse too short to read back,
+ * goes to all of them.
+ * @param   table   The current subscribers
+ * @param   gpio    The gpio for which the event occurred
+ * @param   cycles  Time at which the event was detected
+ */
+static void
+dispatch_event(event_table_t const * const table, unsigned const gpio,
+               uint64_t const cycles)
+{
+    unsigned const  count = table->count[gpio];
+    if (count == 0) {
+        return;
+    }
+
+    // Get the GPIO value.
+    unsigned const  value = rpi_gpio_read(gpio);
+    unsigned const  wanted = value
+        ? (RPI_EVENT_EDGE_RISING | RPI_EVENT_LEVEL_HIGH)
+        : (RPI_EVENT_EDGE_FALLING | RPI_EVENT_LEVEL_LOW);
+    int const       unwanted = (table->detect[gpio] & wanted) == 0;
+
+    for (unsigned i = 0; i < count; i++) {
+        event_entry_t * const   entry = table->entries[gpio][i];
+        if (entry->failed) {
+            continue;
+        }
+
+        if ((entry->detect & wanted) ||
+            (unwanted && (entry->detect != RPI_EVENT_NONE))) {
+            deliver_event(entry, gpio, value, cycles);
         }
     }
 }
 
+/**
+ * Get the current table of subscribers for the IST.
+ * The main thread does not reuse the table before ist_leave().
+ * @return  The current table
+ */
+static event_table_t const *
+ist_enter(void)
+{
+    event_table_t   *table = atomic_load(&event_table);
+
+    // Make sure the table announced is still current, otherwise the main
+    // thread may have missed the announcement.
+    for (;;) {
+        atomic_store(&ist_table, table);
+
+        event_table_t * const   current = atomic_load(&event_table);
+        if (current == table) {
+            return table;
+        }
+
+        table = current;
+    }
+}
+
+/**
+ * Let the main thread reuse the table returned by ist_enter().
+ */
+static void
+ist_leave(void)
+{
+    atomic_store_explicit(&ist_table, NULL, memory_order_release);
+}
+
+/**
+ * Account for the time taken to service an interrupt.
+ * @param   cycles  Service time
+ */
+static void
+ist_record(uint64_t const cycles)
+{
+    if (atomic_load_explicit(&ist_stats_reset, memory_order_acquire)) {
+        atomic_store_explicit(&ist_stats.count, 0, memory_order_relaxed);
+        atomic_store_explicit(&ist_stats.sum_ns, 0, memory_order_relaxed);
+        for (unsigned i = 0; i < IST_BUCKETS; i++) {
+            atomic_store_explicit(&ist_stats.buckets[i], 0,
+                                  memory_order_relaxed);
+        }
+        atomic_store_explicit(&ist_stats_reset, 0, memory_order_relaxed);
+    }
+
+    uint64_t const  ns = cycles * 1000000000 / ist_cycles_per_sec;
+    uint64_t const  count = atomic_load_explicit(&ist_stats.count,
+                                                 memory_order_relaxed);
+
+    if ((count == 0) ||
+        (ns < atomic_load_explicit(&ist_stats.min_ns, memory_order_relaxed))) {
+        atomic_store_explicit(&ist_stats.min_ns, ns, memory_order_relaxed);
+    }
+    if ((count == 0) ||
+        (ns > atomic_load_explicit(&ist_stats.max_ns, memory_order_relaxed))) {
+        atomic_store_explicit(&ist_stats.max_ns, ns, memory_order_relaxed);
+    }
+
+    unsigned        bucket = ns / IST_BUCKET_NS;
+    if (bucket >= IST_BUCKETS) {
+        bucket = IST_BUCKETS - 1;
+    }
+
+    atomic_store_explicit(&ist_stats.buckets[bucket],
+                          atomic_load_explicit(&ist_stats.buckets[bucket],
+                                               memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    atomic_store_explicit(&ist_stats.sum_ns,
+                          atomic_load_explicit(&ist_stats.sum_ns,
+                                               memory_order_relaxed) + ns,
+                          memory_order_relaxed);
+    atomic_store_explicit(&ist_stats.count, count + 1, memory_order_relaxed);
+}
+
 /**
  * Service thread for GPIO interrupts.
  * Waits for the interrupt, detects which GPIOs have changed state and then
@@ -140,6 +390,8 @@ gpio_ist(void *arg)
             abort();
         }
 
+        uint64_t const  cycles = ClockCycles();
+
         // Clear any detected events before unmasking the interrupt.
         unsigned const  events1 = rpi_gpio_regs[RPI_GPIO_REG_GPEDS0];
         unsigned const  events2 = rpi_gpio_regs[RPI_GPIO_REG_GPEDS1];
@@ -150,30 +402,23 @@ gpio_ist(void *arg)
             fprintf(stderr, "Event detected: %.8x %.8x\n", events1, events2);
         }
 
-        int const   rc = pthread_mutex_lock(&event_mutex);
-        if (rc != EOK) {
-            // Should never happen.
-            abort();
-        }
+        uint64_t const  events = (events1 | ((uint64_t)events2 << 32))
+                                 & ((UINT64_C(1) << RPI_GPIO_NUM) - 1);
 
-        // Dispatch events.
-        if (events1 != 0) {
-            for (unsigned i = 0; i < 32; i++) {
-                if (events1 & (1 << i)) {
-                    dispatch_event(i);
-                }
-            }
+        // Dispatch events, visiting only the GPIOs that changed.
+        event_table_t const * const table = ist_enter();
+        for (uint64_t pending = events; pending != 0; pending &= pending - 1) {
+            dispatch_event(table, __builtin_ctzll(pending), cycles);
         }
+        ist_leave();
 
-        if (events2 != 0) {
-            for (unsigned i = 0; i < 32; i++) {
-                if (events2 & (1 << i)) {
-                    dispatch_event(i + 32);
-                }
-            }
-        }
+        // Publish the new levels and the edges to shared memory.
+        uint64_t const  levels = rpi_gpio_regs[RPI_GPIO_REG_GPLEV0] |
+            ((uint64_t)rpi_gpio_regs[RPI_GPIO_REG_GPLEV0 + 1] << 32);
+        shm_update(levels & ((UINT64_C(1) << RPI_GPIO_NUM) - 1), events,
+                   cycles);
 
-        pthread_mutex_unlock(&event_mutex);
+        ist_record(ClockCycles() - cycles);
 
         // Unmask the interrupt to get the next event.
         if (InterruptUnmask(intr, intid) == -1) {
@@ -185,6 +430,24 @@ gpio_ist(void *arg)
     return NULL;
 }
 
+/**
+ * Find the event queue of a client.
+ * @param   rcvid   Client identifier
+ * @return  The queue, NULL if the client has none
+ */
+static event_queue_t *
+find_queue(rcvid_t const rcvid)
+{
+    for (event_queue_t *queue = event_queues; queue != NULL;
+         queue = queue->next) {
+        if (queue->rcvid == rcvid) {
+            return queue;
+        }
+    }
+
+    return NULL;
+}
+
 int
 event_init(unsigned const priority, int const intr)
 {
@@ -200,6 +463,7 @@ event_init(unsigned const priority, int const intr)
     rpi_gpio_regs[RPI_GPIO_REG_GPLEN0] = 0;
     rpi_gpio_regs[RPI_GPIO_REG_GPLEN1] = 0;
 
+    ist_cycles_per_sec = SYSPAGE_ENTRY(qtime)->cycles_per_sec;
     sem_init(&ist_sem, 0, 0);
 
     // Create a high-priority IST.
@@ -228,8 +492,76 @@ event_init(unsigned const priority, int const intr)
     return 1;
 }
 
+/**
+ * Start the next table of subscribers as a copy of the current one.
+ * Only the main thread changes the table.
+ * @return  The table not in use, to be published with publish_table()
+ */
+static event_table_t *
+next_table(void)
+{
+    event_table_t * const   current = atomic_load_explicit(&event_table,
+                                                           memory_order_relaxed);
+    event_table_t * const   next = (current == &event_tables[0])
+                                   ? &event_tables[1] : &event_tables[0];
+
+    memcpy(next, current, sizeof(*next));
+    return next;
+}
+
+/**
+ * Make a table of subscribers current.
+ * Returns once the IST no longer reads the previous table, so that the next
+ * change can be built in it, and the entries removed by this change freed.
+ * @param   table   The table returned by next_table()
+ */
+static void
+publish_table(event_table_t * const table)
+{
+    event_table_t * const   prev = atomic_exchange(&event_table, table);
+
+    // The IST only holds on to a table while servicing an interrupt.
+    while (atomic_load(&ist_table) == prev) {
+        sched_yield();
+    }
+}
+
+/**
+ * Program the detection of the events of a GPIO for all of its subscribers.
+ * @param   table   The current table
+ * @param   gpio    The gpio to program
+ */
+static void
+update_detect(event_table_t const * const table, unsigned const gpio)
+{
+    unsigned const  detect = table->detect[gpio];
+
+    rpi_gpio_detect_rising_edge(gpio, (detect & RPI_EVENT_EDGE_RISING) != 0);
+    rpi_gpio_detect_falling_edge(gpio, (detect & RPI_EVENT_EDGE_FALLING) != 0);
+    rpi_gpio_detect_level_high(gpio, (detect & RPI_EVENT_LEVEL_HIGH) != 0);
+    rpi_gpio_detect_level_low(gpio, (detect & RPI_EVENT_LEVEL_LOW) != 0);
+}
+
+/**
+ * Compute the detection types asked for by the subscribers of a GPIO.
+ * @param   table   A table being built
+ * @param   gpio    The gpio to compute for
+ */
+static void
+merge_detect(event_table_t * const table, unsigned const gpio)
+{
+    unsigned    detect = RPI_EVENT_NONE;
+    for (unsigned i = 0; i < table->count[gpio]; i++) {
+        detect |= table->entries[gpio][i]->detect;
+    }
+
+    table->detect[gpio] = detect;
+}
+
 /**
  * Register an event to be delivered to the client thread.
+ * A client registering again for the same GPIO replaces its previous
+ * registration.
  * @param   rcvid   Client identifier
  * @param   msg     An event message
  * @return  EOK if successful, error code otherwise
@@ -241,50 +573,69 @@ event_add(rcvid_t const rcvid, rpi_gpio_event_t const * const msg)
     unsigned const  detect = msg->detect;
 
     // Only the main thread can update the table, so we can examine it without
-    // locking.
-    if ((event_table[gpio].rcvid != 0) && (event_table[gpio].rcvid != rcvid)) {
-        // Only one event per GPIO for now.
+    // further synchronization.
+    event_table_t const * const current =
+        atomic_load_explicit(&event_table, memory_order_relaxed);
+    unsigned    index = current->count[gpio];
+    for (unsigned i = 0; i < current->count[gpio]; i++) {
+        if (current->entries[gpio][i]->rcvid == rcvid) {
+            index = i;
+            break;
+        }
+    }
+
+    if (index == RPI_GPIO_EVENT_SUBSCRIBERS) {
+        // Keep the time the IST spends on a GPIO bounded.
         return EBUSY;
     }
 
-    // Disable all event detection for this GPIO.
-    rpi_gpio_detect_rising_edge(gpio, false);
-    rpi_gpio_detect_falling_edge(gpio, false);
-    rpi_gpio_detect_level_high(gpio, false);
-    rpi_gpio_detect_level_low(gpio, false);
+    // Find or create the queue for the records of the client's events. The
+    // IST never walks the list, so it can be updated without locking.
+    event_queue_t   *queue = NULL;
+    if (detect & RPI_EVENT_QUEUE) {
+        queue = find_queue(rcvid);
+        if (queue == NULL) {
+            queue = calloc(1, sizeof(*queue));
+            if (queue == NULL) {
+                return ENOMEM;
+            }
 
-    // Update the table.
-    int const   rc = pthread_mutex_lock(&event_mutex);
-    if (rc != 0) {
-        abort();
+            queue->rcvid = rcvid;
+            queue->next = event_queues;
+            event_queues = queue;
+        }
     }
 
-    event_table[gpio].rcvid = rcvid;
-    event_table[gpio].detect = detect;
-    event_table[gpio].count = 0;
-    event_table[gpio].match = msg->match == 0 ? 1 : msg->match;
-    event_table[gpio].match_count = 0;
-    memcpy(&event_table[gpio].sigev, &msg->event, sizeof(struct sigevent));
+    event_entry_t * const   entry = calloc(1, sizeof(*entry));
+    if (entry == NULL) {
+        return ENOMEM;
+    }
 
-    pthread_mutex_unlock(&event_mutex);
+    entry->rcvid = rcvid;
+    entry->detect = detect;
+    entry->match = msg->match == 0 ? 1 : msg->match;
+    memcpy(&entry->sigev, &msg->event, sizeof(struct sigevent));
+    entry->queue = queue;
 
-    // Enable events.
-    if (detect & RPI_EVENT_EDGE_RISING) {
-        rpi_gpio_detect_rising_edge(gpio, true);
-    }
-    if (detect & RPI_EVENT_EDGE_FALLING) {
-        rpi_gpio_detect_falling_edge(gpio, true);
-    }
-    if (detect & RPI_EVENT_LEVEL_HIGH) {
-        rpi_gpio_detect_level_high(gpio, true);
-    }
-    if (detect & RPI_EVENT_LEVEL_LOW) {
-        rpi_gpio_detect_level_low(gpio, true);
+    // Update the table.
+    event_table_t * const   table = next_table();
+    event_entry_t * const   prev = index < table->count[gpio]
+                                   ? table->entries[gpio][index] : NULL;
+    table->entries[gpio][index] = entry;
+    if (prev == NULL) {
+        table->count[gpio]++;
     }
+    merge_detect(table, gpio);
+
+    publish_table(table);
+    free(prev);
+
+    // Enable events.
+    update_detect(table, gpio);
 
     if (verbose) {
         fprintf(stderr, "%lx added event %u/%u for GPIO %u\n",
-                rcvid, detect, event_table[gpio].sigev.sigev_notify, gpio);
+                rcvid, detect, entry->sigev.sigev_notify, gpio);
     }
 
     return 0;
@@ -293,32 +644,188 @@ event_add(rcvid_t const rcvid, rpi_gpio_event_t const * const msg)
 void
 event_remove_rcvid(rcvid_t const rcvid)
 {
-    // Disable all events registered by this receive ID.
-    // We don't need the mutex for that.
+    event_table_t const * const current =
+        atomic_load_explicit(&event_table, memory_order_relaxed);
+    uint64_t                    changed = 0;
+
     for (unsigned gpio = 0; gpio < RPI_GPIO_NUM; gpio++) {
-        if (event_table[gpio].rcvid == rcvid) {
-            rpi_gpio_detect_rising_edge(gpio, false);
-            rpi_gpio_detect_falling_edge(gpio, false);
-            rpi_gpio_detect_level_high(gpio, false);
-            rpi_gpio_detect_level_low(gpio, false);
+        for (unsigned i = 0; i < current->count[gpio]; i++) {
+            if (current->entries[gpio][i]->rcvid == rcvid) {
+                changed |= UINT64_C(1) << gpio;
+            }
         }
     }
 
-    // Remove events from the table.
-    int const   rc = pthread_mutex_lock(&event_mutex);
-    if (rc != 0) {
-        abort();
-    }
+    // Remove events from the table, and stop detecting those only this
+    // receive ID asked for.
+    event_entry_t   *removed[RPI_GPIO_NUM];
+    unsigned        nremoved = 0;
+    if (changed != 0) {
+        event_table_t * const   table = next_table();
+        for (unsigned gpio = 0; gpio < RPI_GPIO_NUM; gpio++) {
+            if (!(changed & (UINT64_C(1) << gpio))) {
+                continue;
+            }
 
-    for (unsigned gpio = 0; gpio< RPI_GPIO_NUM; gpio++) {
-        if (event_table[gpio].rcvid == rcvid) {
-            event_table[gpio].rcvid = 0;
+            unsigned    count = 0;
+            for (unsigned i = 0; i < table->count[gpio]; i++) {
+                event_entry_t * const   entry = table->entries[gpio][i];
+                if (entry->rcvid == rcvid) {
+                    removed[nremoved++] = entry;
+                } else {
+                    table->entries[gpio][count++] = entry;
+                }
+            }
+
+            table->count[gpio] = count;
+            merge_detect(table, gpio);
+        }
+
+        publish_table(table);
+
+        for (unsigned gpio = 0; gpio < RPI_GPIO_NUM; gpio++) {
+            if (changed & (UINT64_C(1) << gpio)) {
+                update_detect(table, gpio);
+            }
         }
     }
 
-    pthread_mutex_unlock(&event_mutex);
+    // The IST no longer has access to the client's entries and queue.
+    for (unsigned i = 0; i < nremoved; i++) {
+        free(removed[i]);
+    }
+
+    for (event_queue_t **prevp = &event_queues; *prevp != NULL;
+         prevp = &(*prevp)->next) {
+        event_queue_t * const   queue = *prevp;
+        if (queue->rcvid == rcvid) {
+            *prevp = queue->next;
+            free(queue);
+            break;
+        }
+    }
 
     if (verbose) {
         fprintf(stderr, "Removed events for %lx\n", rcvid);
     }
 }
+
+/**
+ * Report the service times of the IST.
+ * @param   stats   Set to the statistics, which restart afterwards if its
+ *                  reset field is set
+ */
+void
+event_get_stats(rpi_gpio_ist_stats_t * const stats)
+{
+    uint64_t const  count = atomic_load_explicit(&ist_stats.count,
+                                                 memory_order_relaxed);
+
+    stats->interrupts = count;
+    stats->min_ns = 0;
+    stats->avg_ns = 0;
+    stats->p99_ns = 0;
+    stats->max_ns = 0;
+
+    if (count != 0) {
+        stats->min_ns = atomic_load_explicit(&ist_stats.min_ns,
+                                             memory_order_relaxed);
+        stats->max_ns = atomic_load_explicit(&ist_stats.max_ns,
+                                             memory_order_relaxed);
+        stats->avg_ns = atomic_load_explicit(&ist_stats.sum_ns,
+                                             memory_order_relaxed) / count;
+
+        // The IST may count more while the buckets are read, so find the
+        // percentile in what the buckets hold.
+        uint32_t    buckets[IST_BUCKETS];
+        uint64_t    total = 0;
+        for (unsigned i = 0; i < IST_BUCKETS; i++) {
+            buckets[i] = atomic_load_explicit(&ist_stats.buckets[i],
+                                              memory_order_relaxed);
+            total += buckets[i];
+        }
+
+        uint64_t const  rank = total - (total / 100);
+        uint64_t        seen = 0;
+        for (unsigned i = 0; i < IST_BUCKETS; i++) {
+            seen += buckets[i];
+            if (seen >= rank) {
+                stats->p99_ns = (uint64_t)(i + 1) * IST_BUCKET_NS;
+                break;
+            }
+        }
+
+        if (stats->p99_ns > stats->max_ns) {
+            stats->p99_ns = stats->max_ns;
+        }
+    }
+
+    if (stats->reset) {
+        atomic_store_explicit(&ist_stats_reset, 1, memory_order_release);
+    }
+}
+
+/**
+ * Read the event records queued for a client, oldest first.
+ * @param   rcvid   Client identifier
+ * @param   records Buffer for the records
+ * @param   max     Number of records the buffer can hold
+ * @param   countp  Set to the number of records read
+ * @return  EOK if successful, error code otherwise
+ */
+int
+event_read(rcvid_t const rcvid, rpi_gpio_event_record_t * const records,
+           unsigned const max, unsigned * const countp)
+{
+    event_queue_t * const   queue = find_queue(rcvid);
+    if (queue == NULL) {
+        return ENXIO;
+    }
+
+    unsigned const  tail = atomic_load_explicit(&queue->tail,
+                                                memory_order_relaxed);
+    unsigned const  head = atomic_load_explicit(&queue->head,
+                                                memory_order_acquire);
+    unsigned        count = head - tail;
+    if (count > max) {
+        count = max;
+    }
+
+    // Copy up to the end of the ring, then from its start.
+    unsigned const  first = tail % RPI_GPIO_EVENT_QUEUE_SIZE;
+    unsigned        part = RPI_GPIO_EVENT_QUEUE_SIZE - first;
+    if (part > count) {
+        part = count;
+    }
+
+    memcpy(records, &queue->records[first], part * sizeof(*records));
+    memcpy(records + part, queue->records, (count - part) * sizeof(*records));
+
+    // Hand the slots back to the IST. The fence pairs with the one in
+    // queue_event(), so that a record published after this read is either
+    // returned by the next one or rung for.
+    atomic_store_explicit(&queue->tail, tail + count, memory_order_release);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    *countp = count;
+    return EOK;
+}
+
+/**
+ * Get the number of event records dropped for a client because its queue was
+ * full.
+ * @param   rcvid       Client identifier
+ * @param   overflowp   Set to the number of records dropped
+ * @return  EOK if successful, error code otherwise
+ */
+int
+event_overflow(rcvid_t const rcvid, unsigned * const overflowp)
+{
+    event_queue_t * const   queue = find_queue(rcvid);
+    if (queue == NULL) {
+        return ENXIO;
+    }
+
+    *overflowp = atomic_load_explicit(&queue->overflow, memory_order_relaxed);
+    return EOK;
+}
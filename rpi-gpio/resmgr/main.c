@@ -40,6 +40,8 @@
 #include <sys/procmgr.h>
 #include <sys/mman.h>
 #include <sys/rpi_gpio.h>
+#include <sys/rpi_gpio_shm.h>
+#include <sys/syspage.h>
 #include <aarch64/mmu.h>
 #include <aarch64/rpi_gpio.h>
 #include <secpol/secpol.h>
@@ -61,13 +63,20 @@ struct gpio_entry
 uint64_t                        base_paddr = 0xfe000000;
 uint32_t volatile              *rpi_gpio_regs;
 int                             verbose;
-static char const              *shm_path = SHM_ANON;
+static int                      standin;
+static char const              *shm_path = RPI_GPIO_SHM_PATH;
 static resmgr_connect_funcs_t   connect_funcs;
 static resmgr_io_funcs_t        io_funcs;
 static iofunc_attr_t            io_attr;
 
 static gpio_entry_t             gpio_entries[RPI_GPIO_NUM + 1];
 
+// Bits for all GPIOs in a 64-bit mask.
+#define GPIO_MASK_ALL       ((UINT64_C(1) << RPI_GPIO_NUM) - 1)
+
+// Number of function select registers, each covering 10 GPIOs.
+#define GPIO_FSEL_REGS      ((RPI_GPIO_NUM + 9) / 10)
+
 /**
  * Handles an _IO_CONNECT message.
  * This message can be sent for the directory, as a result of an opendir() call,
@@ -198,9 +207,42 @@ read_directory(resmgr_context_t *ctp, io_read_t *msg, iofunc_ocb_t *ocb)
     return reply_len == 0 ? EOK : _RESMGR_PTR(ctp, msg, reply_len);
 }
 
+/**
+ * Handles an _IO_READ message on the 'msg' node.
+ * The reply holds as many of the event records queued for the client as fit,
+ * see RPI_EVENT_QUEUE, and is empty once the queue is.
+ * @param   ctp     Message context
+ * @param   msg     Read message
+ * @return  Value encoding the reply IOV
+ */
+static int
+read_events(resmgr_context_t *ctp, io_read_t *msg)
+{
+    size_t  max_reply_len = msg->i.nbytes;
+
+    // Never go beyond the end of the resource manager buffer.
+    if (max_reply_len > (ctp->msg_max_size - ctp->offset)) {
+        max_reply_len = ctp->msg_max_size - ctp->offset;
+    }
+
+    unsigned    count;
+    int const   rc = event_read(ctp->rcvid, (rpi_gpio_event_record_t *)msg,
+                                max_reply_len / sizeof(rpi_gpio_event_record_t),
+                                &count);
+    if (rc != EOK) {
+        return rc;
+    }
+
+    // Reply to the caller.
+    size_t const    reply_len = count * sizeof(rpi_gpio_event_record_t);
+    _IO_SET_READ_NBYTES(ctp, reply_len);
+    return reply_len == 0 ? EOK : _RESMGR_PTR(ctp, msg, reply_len);
+}
+
 /**
  * Handles an _IO_READ message.
- * If the OCB refers to the directory, the function calls read_directory().
+ * If the OCB refers to the directory, the function calls read_directory(), and
+ * for the 'msg' node read_events().
  * Otherwise, the data from the referenced node is copied into the reply buffer,
  * starting from the last offset (typically 0).
  * @param   ctp     Message context
@@ -217,8 +259,7 @@ read_gpio(resmgr_context_t *ctp, io_read_t *msg, iofunc_ocb_t *ocb)
 
     gpio_entry_t   *entry = (gpio_entry_t *)ocb->attr;
     if (entry->gpio == -1) {
-        // Can't read the message node.
-        return ENXIO;
+        return read_events(ctp, msg);
     }
 
     if (rpi_gpio_get_select(entry->gpio) & 1) {
@@ -319,6 +360,193 @@ write_gpio(resmgr_context_t *ctp, io_write_t *msg, iofunc_ocb_t *ocb)
     return EOK;
 }
 
+/**
+ * Builds a mask of the GPIOs configured as outputs.
+ * @return  Bit n set if GPIO n is an output
+ */
+static uint64_t
+output_mask(void)
+{
+    uint64_t    mask = 0;
+
+    for (unsigned reg = 0; reg < GPIO_FSEL_REGS; reg++) {
+        uint32_t const  fsel = rpi_gpio_regs[reg];
+        for (unsigned i = 0; (i < 10) && ((reg * 10) + i < RPI_GPIO_NUM); i++) {
+            if (((fsel >> (i * 3)) & 7) == RPI_GPIO_FUNC_OUT) {
+                mask |= UINT64_C(1) << ((reg * 10) + i);
+            }
+        }
+    }
+
+    return mask;
+}
+
+/**
+ * Handles the _IO_MSG subtypes that act on several GPIOs at once.
+ * All levels are read with two register reads, and all outputs written with
+ * at most two GPSET and two GPCLR writes. Select lists are applied to a copy of
+ * the function select registers, each of which is then written once.
+ * @param   ctp     Message context
+ * @param   msg     rpi_gpio_mask_t or rpi_gpio_select_list_t message
+ * @param   ocb     Control block for the open file
+ * @return  For input messages, EOK if successful, error code otherwise
+ *          For output messages, _RESMGR_PTR if successful, error code otherwise
+ */
+static int
+msg_gpio_multi(resmgr_context_t *ctp, io_msg_t *msg, iofunc_ocb_t *ocb)
+{
+    gpio_entry_t    *entry = (gpio_entry_t *)ocb->attr;
+    if (entry->gpio != -1) {
+        // Can only send this message to the 'msg' node.
+        return ENXIO;
+    }
+
+    rpi_gpio_mask_t * const         mmsg = (void *)&msg->i;
+    rpi_gpio_select_list_t * const  lmsg = (void *)&msg->i;
+
+    switch (msg->i.subtype) {
+    case RPI_GPIO_READ_ALL:
+        if (ctp->size < sizeof(*mmsg)) {
+            return EBADMSG;
+        }
+
+        mmsg->levels = (rpi_gpio_regs[RPI_GPIO_REG_GPLEV0] |
+                        ((uint64_t)rpi_gpio_regs[RPI_GPIO_REG_GPLEV0 + 1] << 32))
+                       & GPIO_MASK_ALL;
+        mmsg->clear = 0;
+        return _RESMGR_PTR(ctp, mmsg, sizeof(*mmsg));
+
+    case RPI_GPIO_WRITE_MASK:
+    {
+        if (ctp->size < sizeof(*mmsg)) {
+            return EBADMSG;
+        }
+
+        uint64_t const  set = mmsg->set;
+        uint64_t const  clear = mmsg->clear;
+
+        if (verbose) {
+            printf("msg_gpio: write set=%.16llx clear=%.16llx\n",
+                   (unsigned long long)set, (unsigned long long)clear);
+        }
+
+        if ((set | clear) & ~GPIO_MASK_ALL) {
+            return ERANGE;
+        }
+
+        if (set & clear) {
+            return EINVAL;
+        }
+
+        if ((set | clear) & ~output_mask()) {
+            return ENXIO;
+        }
+
+        if ((uint32_t)set != 0) {
+            rpi_gpio_regs[RPI_GPIO_REG_GPSET0] = (uint32_t)set;
+        }
+        if ((set >> 32) != 0) {
+            rpi_gpio_regs[RPI_GPIO_REG_GPSET0 + 1] = (uint32_t)(set >> 32);
+        }
+        if ((uint32_t)clear != 0) {
+            rpi_gpio_regs[RPI_GPIO_REG_GPCLR0] = (uint32_t)clear;
+        }
+        if ((clear >> 32) != 0) {
+            rpi_gpio_regs[RPI_GPIO_REG_GPCLR0 + 1] = (uint32_t)(clear >> 32);
+        }
+        return EOK;
+    }
+
+    case RPI_GPIO_SET_SELECT_LIST:
+    case RPI_GPIO_GET_SELECT_LIST:
+    {
+        if (ctp->size < RPI_GPIO_SELECT_LIST_SIZE(0)) {
+            return EBADMSG;
+        }
+
+        unsigned const  count = lmsg->count;
+        if (count > RPI_GPIO_NUM) {
+            return ERANGE;
+        }
+
+        if (ctp->size < RPI_GPIO_SELECT_LIST_SIZE(count)) {
+            return EBADMSG;
+        }
+
+        if (verbose) {
+            printf("msg_gpio: type=%u count=%u\n", msg->i.subtype, count);
+        }
+
+        // Validate the whole list before changing anything.
+        for (unsigned i = 0; i < count; i++) {
+            if (lmsg->list[i].gpio >= RPI_GPIO_NUM) {
+                return ERANGE;
+            }
+
+            if ((msg->i.subtype == RPI_GPIO_SET_SELECT_LIST) &&
+                (lmsg->list[i].value > 7)) {
+                return ERANGE;
+            }
+        }
+
+        uint32_t    fsel[GPIO_FSEL_REGS];
+        unsigned    dirty = 0;
+        for (unsigned reg = 0; reg < GPIO_FSEL_REGS; reg++) {
+            fsel[reg] = rpi_gpio_regs[reg];
+        }
+
+        for (unsigned i = 0; i < count; i++) {
+            unsigned const  reg = lmsg->list[i].gpio / 10;
+            unsigned const  off = (lmsg->list[i].gpio % 10) * 3;
+            unsigned const  prev = (fsel[reg] >> off) & 7;
+
+            if (msg->i.subtype == RPI_GPIO_SET_SELECT_LIST) {
+                fsel[reg] &= ~(7 << off);
+                fsel[reg] |= lmsg->list[i].value << off;
+                dirty |= 1 << reg;
+            }
+            lmsg->list[i].value = prev;
+        }
+
+        for (unsigned reg = 0; reg < GPIO_FSEL_REGS; reg++) {
+            if (dirty & (1 << reg)) {
+                rpi_gpio_regs[reg] = fsel[reg];
+            }
+        }
+
+        return _RESMGR_PTR(ctp, lmsg, RPI_GPIO_SELECT_LIST_SIZE(count));
+    }
+
+    default:
+        return EINVAL;
+    }
+}
+
+/**
+ * Handles the RPI_GPIO_IST_STATS _IO_MSG subtype.
+ * @param   ctp     Message context
+ * @param   msg     rpi_gpio_ist_stats_t message
+ * @param   ocb     Control block for the open file
+ * @return  _RESMGR_PTR if successful, error code otherwise
+ */
+static int
+msg_ist_stats(resmgr_context_t *ctp, io_msg_t *msg, iofunc_ocb_t *ocb)
+{
+    gpio_entry_t    *entry = (gpio_entry_t *)ocb->attr;
+    if (entry->gpio != -1) {
+        // Can only send this message to the 'msg' node.
+        return ENXIO;
+    }
+
+    if (ctp->size < sizeof(rpi_gpio_ist_stats_t)) {
+        return EBADMSG;
+    }
+
+    rpi_gpio_ist_stats_t * const    smsg = (void *)&msg->i;
+    event_get_stats(smsg);
+    return _RESMGR_PTR(ctp, smsg, sizeof(*smsg));
+}
+
 /**
  * Handles an _IO_MSG message.
  * This message allows a client to control any GPIO pin, using the various
@@ -343,6 +571,32 @@ msg_gpio(resmgr_context_t *ctp, io_msg_t *msg, iofunc_ocb_t *ocb)
         return EBADMSG;
     }
 
+    switch (msg->i.subtype) {
+    case RPI_GPIO_READ_ALL:
+    case RPI_GPIO_WRITE_MASK:
+    case RPI_GPIO_SET_SELECT_LIST:
+    case RPI_GPIO_GET_SELECT_LIST:
+        // These messages carry their own GPIO numbers.
+        return msg_gpio_multi(ctp, msg, ocb);
+    case RPI_GPIO_IST_STATS:
+        // There is no IST without the GPIO interrupt.
+        if (standin) {
+            return ENODEV;
+        }
+        return msg_ist_stats(ctp, msg, ocb);
+    case RPI_GPIO_PWM_SETUP:
+    case RPI_GPIO_PWM_DUTY:
+    case RPI_GPIO_SPI_INIT:
+    case RPI_GPIO_SPI_WRITE_READ:
+        // The stand-in register block has no PWM or SPI controller behind it.
+        if (standin) {
+            return ENODEV;
+        }
+        break;
+    default:
+        break;
+    }
+
 	// Make sure we have a complete message.
     // Note that the frameworks guarantees that at list sizeof(io_msg_t) is
     // available.
@@ -428,6 +682,12 @@ msg_gpio(resmgr_context_t *ctp, io_msg_t *msg, iofunc_ocb_t *ocb)
     case RPI_GPIO_ADD_EVENT:
         rc = event_add(ctp->rcvid, (rpi_gpio_event_t *)msg);
         break;
+    case RPI_GPIO_EVENT_OVERFLOW:
+        rc = event_overflow(ctp->rcvid, &rmsg->value);
+        if (rc == EOK) {
+            rc = _RESMGR_PTR(ctp, rmsg, sizeof(*rmsg));
+        }
+        break;
     case RPI_GPIO_PWM_SETUP:
         rc = pwm_setup(ctp->rcvid, (void *)msg);
         break;
@@ -517,7 +777,7 @@ main(int argc, char **argv)
 
     // Parse command-line options.
     for (;;) {
-        int opt = getopt(argc, argv, ":a:i:m:o:p:s:u:v");
+        int opt = getopt(argc, argv, ":a:i:m:o:p:rs:u:v");
         if (opt == -1) {
             break;
         } else if (opt == 'a') {
@@ -530,6 +790,8 @@ main(int argc, char **argv)
             mode = strtoul(optarg, NULL, 0);
         } else if (opt == 'p') {
             priority = strtoul(optarg, NULL, 0);
+        } else if (opt == 'r') {
+            standin = 1;
         } else if (opt == 's') {
             shm_path = optarg;
         } else if (opt == 'u') {
@@ -542,18 +804,42 @@ main(int argc, char **argv)
         }
     }
 
-    // Map the GPIO registers.
-    if (!rpi_gpio_map_regs(base_paddr)) {
+    if (standin) {
+        // Serve clients from a register block in memory, so that they can be
+        // exercised and timed without the GPIO hardware. There are no
+        // interrupts, PWM or SPI.
+        void * const ptr = mmap(0, __PAGESIZE, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANON, NOFD, 0);
+        if (ptr == MAP_FAILED) {
+            perror("mmap");
+            return 1;
+        }
+
+        rpi_gpio_regs = ptr;
+    } else if (!rpi_gpio_map_regs(base_paddr)) {
+        // Map the GPIO registers.
         perror("Failed to map GPIOs");
         return 0;
     }
 
-    if (!event_init(priority, intr)) {
+    // Publish the GPIO state before the IST starts updating it.
+    uint64_t const  levels = (rpi_gpio_regs[RPI_GPIO_REG_GPLEV0] |
+                              ((uint64_t)rpi_gpio_regs[RPI_GPIO_REG_GPLEV0 + 1]
+                               << 32))
+                             & GPIO_MASK_ALL;
+    if (!shm_init(shm_path, SYSPAGE_ENTRY(qtime)->cycles_per_sec, levels,
+                  ClockCycles())) {
         return 1;
     }
 
-    if (!pwm_init()) {
-        return 1;
+    if (!standin) {
+        if (!event_init(priority, intr)) {
+            return 1;
+        }
+
+        if (!pwm_init()) {
+            return 1;
+        }
     }
 
     // Initialize the GPIO nodes.
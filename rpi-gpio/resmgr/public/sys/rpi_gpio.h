@@ -23,6 +23,7 @@
 #ifndef RPI_GPIO_H
 #define RPI_GPIO_H
 
+#include <stddef.h>
 #include <sys/iomsg.h>
 #include <sys/iomgr.h>
 #include <aarch64/rpi_gpio.h>
@@ -56,6 +57,18 @@ enum
     RPI_GPIO_SPI_INIT,
     /** Write/read data to/from the SPI interface. */
     RPI_GPIO_SPI_WRITE_READ,
+    /** Read the levels of all GPIO PINs */
+    RPI_GPIO_READ_ALL,
+    /** Turn a mask of GPIO PINs on and another off */
+    RPI_GPIO_WRITE_MASK,
+    /** Select the configuration of a list of GPIOs */
+    RPI_GPIO_SET_SELECT_LIST,
+    /** Read the configuration of a list of GPIOs */
+    RPI_GPIO_GET_SELECT_LIST,
+    /** Read the number of queued events dropped */
+    RPI_GPIO_EVENT_OVERFLOW,
+    /** Read the service times of the interrupt service thread */
+    RPI_GPIO_IST_STATS,
 };
 
 /**
@@ -67,9 +80,17 @@ enum
     RPI_EVENT_EDGE_RISING   = 0x1,
     RPI_EVENT_EDGE_FALLING  = 0x2,
     RPI_EVENT_LEVEL_HIGH    = 0x4,
-    RPI_EVENT_LEVEL_LOW     = 0x8
+    RPI_EVENT_LEVEL_LOW     = 0x8,
+    /** Queue a record of each event, see rpi_gpio_event_record_t */
+    RPI_EVENT_QUEUE         = 0x10
 };
 
+/** Number of event records queued for a client before new ones are dropped. */
+#define RPI_GPIO_EVENT_QUEUE_SIZE   256
+
+/** Number of clients that can register events for the same GPIO. */
+#define RPI_GPIO_EVENT_SUBSCRIBERS  16
+
 /**
  * PWM channel operation mode.
  */
@@ -89,6 +110,8 @@ enum
  * RPI_GPIO_SET: Ignored
  * RPI_GPIO_CLEAR: Ignored
  * RPI_GPIO_LEVEL: [out] PIN state
+ * RPI_GPIO_EVENT_OVERFLOW: [out] number of event records dropped since the
+ *                          client registered its first queued event
  */
 typedef struct
 {
@@ -97,8 +120,61 @@ typedef struct
     unsigned        value;
 } rpi_gpio_msg_t;
 
+/**
+ * Message structure used with the RPI_GPIO_READ_ALL and RPI_GPIO_WRITE_MASK
+ * message subtypes. Bit n of a mask stands for GPIO n.
+ * RPI_GPIO_READ_ALL: [out] levels, the state of every PIN
+ * RPI_GPIO_WRITE_MASK: [in] set, PINs to turn on [in] clear, PINs to turn off
+ * All PINs written must be outputs, and no PIN can be both set and cleared.
+ * PINs 0-31 and 32-53 are written by separate registers, so only PINs in the
+ * same half change at the same instant.
+ */
+typedef struct
+{
+    struct _io_msg  hdr;
+    unsigned        reserved;
+    union {
+        uint64_t    levels;
+        uint64_t    set;
+    };
+    uint64_t        clear;
+} rpi_gpio_mask_t;
+
+/**
+ * Message structure used with the RPI_GPIO_SET_SELECT_LIST and
+ * RPI_GPIO_GET_SELECT_LIST message subtypes. Only the first count entries of
+ * the list need to be sent, see RPI_GPIO_SELECT_LIST_SIZE().
+ * RPI_GPIO_SET_SELECT_LIST: [in] new configuration values [out] previous values
+ * RPI_GPIO_GET_SELECT_LIST: [out] current configuration values
+ * Nothing is changed unless every entry is valid.
+ */
+typedef struct
+{
+    struct _io_msg  hdr;
+    unsigned        count;
+    struct {
+        uint8_t     gpio;
+        uint8_t     value;
+    }               list[RPI_GPIO_NUM];
+} rpi_gpio_select_list_t;
+
+#define RPI_GPIO_SELECT_LIST_SIZE(count)                            \
+    (offsetof(rpi_gpio_select_list_t, list) +                       \
+     (count) * sizeof(((rpi_gpio_select_list_t *)0)->list[0]))
+
 /**
  * Message structure used with the RPI_GPIO_ADD_EVENT message subtype.
+ * Up to RPI_GPIO_EVENT_SUBSCRIBERS clients can register for the same GPIO,
+ * each with its own detect and match values, and a client registering again
+ * replaces its previous registration for that GPIO.
+ * By default the event is delivered every match changes, with a value of gpio
+ * for a high level and -gpio for a low one.
+ * With RPI_EVENT_QUEUE in detect, every change is instead recorded in a queue
+ * kept for the client, which read() on the 'msg' node returns in bulk. The
+ * event is then only a doorbell, delivered as registered whenever a record is
+ * added to a queue that is, or is being read, empty, and match is ignored. A client should read after
+ * each event until read() returns 0, so that no record is left without an
+ * event to announce it.
  */
 typedef struct
 {
@@ -110,6 +186,48 @@ typedef struct
     unsigned        reserved;
 } rpi_gpio_event_t;
 
+/**
+ * Record of a GPIO event queued for a client, see RPI_EVENT_QUEUE.
+ * Changes of several GPIOs detected by the same interrupt share a time, and
+ * are queued in GPIO order. The sequence number counts every record made for
+ * the client, so a gap shows where records were dropped because the queue
+ * was full.
+ */
+typedef struct
+{
+    /** ClockCycles() value when the interrupt was serviced. */
+    uint64_t        cycles;
+    /** Sequence number of the record. */
+    uint32_t        seq;
+    /** GPIO that changed. */
+    uint8_t         gpio;
+    /** GPIO level after the change. */
+    uint8_t         level;
+    uint16_t        reserved;
+} rpi_gpio_event_record_t;
+
+/** Resolution of rpi_gpio_ist_stats_t::p99_ns. */
+#define RPI_GPIO_IST_STATS_RES      100
+
+/**
+ * Message structure used with the RPI_GPIO_IST_STATS message subtype.
+ * A service time runs from the interrupt service thread waking up for a GPIO
+ * interrupt to it unmasking the interrupt again, which covers reading the
+ * events, delivering them and publishing the state in shared memory.
+ * [in] reset, non-zero to restart the statistics once read
+ * [out] the number of interrupts serviced, and their service times in ns
+ */
+typedef struct
+{
+    struct _io_msg  hdr;
+    unsigned        reset;
+    uint64_t        interrupts;
+    uint64_t        min_ns;
+    uint64_t        avg_ns;
+    uint64_t        p99_ns;
+    uint64_t        max_ns;
+} rpi_gpio_ist_stats_t;
+
 typedef struct
 {
     struct _io_msg  hdr;
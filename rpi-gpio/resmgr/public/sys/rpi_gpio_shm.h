@@ -0,0 +1,177 @@
+/**
+ * @file    rpi_gpio_shm.h
+ * @brief   Shared-memory GPIO state published by the resource manager
+ *
+ * The resource manager keeps a copy of the GPIO level registers, along with
+ * the time and number of edges detected on each pin, in a shared-memory
+ * object that any process can map read-only. Sampling inputs this way takes
+ * neither a message to the resource manager nor access to the physical
+ * registers.
+ *
+ * The state is updated by the interrupt service thread, so levels only change
+ * when an event is detected on some pin. Pins without edge or level detection
+ * (see RPI_GPIO_ADD_EVENT) may read stale, update_cycles tells how old the
+ * copy is.
+ *
+ * The functions below make up the reader side.
+ */
+
+#ifndef RPI_GPIO_SHM_H
+#define RPI_GPIO_SHM_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/** Default name of the shared-memory object, see the -s option. */
+#define RPI_GPIO_SHM_PATH       "/rpi_gpio"
+
+#define RPI_GPIO_SHM_MAGIC      0x53475052
+#define RPI_GPIO_SHM_VERSION    1
+
+/** Number of pins covered, same as RPI_GPIO_NUM. */
+#define RPI_GPIO_SHM_PINS       54
+
+/**
+ * GPIO state at the time of the last update.
+ * Times are ClockCycles() values, see rpi_gpio_shm_t::cycles_per_sec.
+ */
+typedef struct
+{
+    /** Bit n set if GPIO n was high. */
+    uint64_t        levels;
+    /** Time of the last update. */
+    uint64_t        update_cycles;
+    /** Time of the last edge detected on each pin, 0 if none. */
+    uint64_t        edge_cycles[RPI_GPIO_SHM_PINS];
+    /** Number of edges detected on each pin. */
+    uint32_t        edge_count[RPI_GPIO_SHM_PINS];
+} rpi_gpio_snapshot_t;
+
+/**
+ * Layout of the shared-memory object.
+ * The state is protected by a sequence lock: seq is odd while the resource
+ * manager is updating it, and changes with every update.
+ */
+typedef struct
+{
+    uint32_t            magic;
+    uint32_t            version;
+    /** Rate of ClockCycles(), for converting times. */
+    uint64_t            cycles_per_sec;
+    atomic_uint         seq;
+    uint32_t            reserved;
+    rpi_gpio_snapshot_t state;
+} rpi_gpio_shm_t;
+
+/**
+ * Map the GPIO state published by the resource manager.
+ * @param   path    Name of the shared-memory object, RPI_GPIO_SHM_PATH unless
+ *                  the resource manager was started with -s
+ * @return  Read-only mapping if successful, NULL otherwise
+ */
+static inline rpi_gpio_shm_t *
+rpi_gpio_shm_open(char const * const path)
+{
+    int const   fd = shm_open(path, O_RDONLY, 0);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    void * const    ptr = mmap(0, sizeof(rpi_gpio_shm_t), PROT_READ,
+                               MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        return NULL;
+    }
+
+    rpi_gpio_shm_t * const  shm = ptr;
+    if ((shm->magic != RPI_GPIO_SHM_MAGIC) ||
+        (shm->version != RPI_GPIO_SHM_VERSION)) {
+        munmap(ptr, sizeof(rpi_gpio_shm_t));
+        return NULL;
+    }
+
+    return shm;
+}
+
+/**
+ * Unmap the GPIO state.
+ * @param   shm     Mapping returned by rpi_gpio_shm_open()
+ */
+static inline void
+rpi_gpio_shm_close(rpi_gpio_shm_t * const shm)
+{
+    munmap(shm, sizeof(rpi_gpio_shm_t));
+}
+
+/**
+ * Copy a consistent snapshot of the GPIO state.
+ * Retries while the resource manager is updating the state, which only holds
+ * the reader up for the duration of one update.
+ * @param   shm     Mapping returned by rpi_gpio_shm_open()
+ * @param   snap    Receives the state
+ * @return  Sequence number of the snapshot, changes whenever the state does
+ */
+static inline unsigned
+rpi_gpio_shm_read(rpi_gpio_shm_t * const shm, rpi_gpio_snapshot_t * const snap)
+{
+    for (;;) {
+        unsigned const  seq = atomic_load_explicit(&shm->seq,
+                                                   memory_order_acquire);
+        if (seq & 1) {
+            continue;
+        }
+
+        memcpy(snap, (void const *)&shm->state, sizeof(*snap));
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&shm->seq, memory_order_relaxed) == seq) {
+            return seq;
+        }
+    }
+}
+
+/**
+ * Read the levels of all GPIOs.
+ * Cheaper than rpi_gpio_shm_read() when the edge information is not needed.
+ * @param   shm     Mapping returned by rpi_gpio_shm_open()
+ * @return  Bit n set if GPIO n was high
+ */
+static inline uint64_t
+rpi_gpio_shm_levels(rpi_gpio_shm_t * const shm)
+{
+    for (;;) {
+        unsigned const  seq = atomic_load_explicit(&shm->seq,
+                                                   memory_order_acquire);
+        if (seq & 1) {
+            continue;
+        }
+
+        uint64_t const  levels = *(uint64_t volatile *)&shm->state.levels;
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&shm->seq, memory_order_relaxed) == seq) {
+            return levels;
+        }
+    }
+}
+
+/**
+ * Convert a time difference in ClockCycles() units to nanoseconds.
+ * @param   shm     Mapping returned by rpi_gpio_shm_open()
+ * @param   cycles  Time difference
+ * @return  Time difference in nanoseconds
+ */
+static inline uint64_t
+rpi_gpio_shm_cycles_to_ns(rpi_gpio_shm_t const * const shm,
+                          uint64_t const cycles)
+{
+    return (uint64_t)(((unsigned __int128)cycles * 1000000000)
+                      / shm->cycles_per_sec);
+}
+
+#endif
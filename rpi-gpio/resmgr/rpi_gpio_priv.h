@@ -51,11 +51,18 @@ rpi_version(void)
 int     event_init(unsigned priority, int intr);
 int     event_add(rcvid_t rcvid, rpi_gpio_event_t const *msg);
 void    event_remove_rcvid(rcvid_t rcvid);
+int     event_read(rcvid_t rcvid, rpi_gpio_event_record_t *records,
+                   unsigned max, unsigned *countp);
+int     event_overflow(rcvid_t rcvid, unsigned *overflowp);
+void    event_get_stats(rpi_gpio_ist_stats_t *stats);
 int     pwm_init(void);
 int     pwm_setup(rcvid_t rcvid, rpi_gpio_pwm_t const *msg);
 int     pwm_set_duty_cycle(rcvid_t rcvid, unsigned gpio, unsigned duty);
 void    pwm_remove_rcvid(rcvid_t rcvid);
 void    pwm_debug(unsigned gpio);
+int     shm_init(char const *path, uint64_t cycles_per_sec, uint64_t levels,
+                 uint64_t cycles);
+void    shm_update(uint64_t levels, uint64_t edges, uint64_t cycles);
 int     spi_init(rpi_gpio_spi_t const *msg);
 int     spi_write_read(rpi_gpio_spi_t *msg, unsigned srclen, unsigned dstlen,
                        unsigned *replylenp);
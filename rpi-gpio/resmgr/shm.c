@@ -0,0 +1,108 @@
+/**
+ * @file    shm.c
+ * @brief   Shared-memory GPIO state
+ *
+ * Publishes the GPIO levels and per-pin edge times and counts in a
+ * shared-memory object, see sys/rpi_gpio_shm.h. The interrupt service thread
+ * is the only writer once the object has been created.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/rpi_gpio_shm.h>
+#include "rpi_gpio_priv.h"
+
+_Static_assert(RPI_GPIO_SHM_PINS == RPI_GPIO_NUM, "GPIO count mismatch");
+
+static rpi_gpio_shm_t   *shm;
+
+/**
+ * Create the shared-memory object and publish the initial state.
+ * Other users can only map the object read-only.
+ * @param   path            Name of the shared-memory object
+ * @param   cycles_per_sec  Rate of ClockCycles()
+ * @param   levels          Current levels
+ * @param   cycles          Current time
+ * @return  1 if successful, 0 otherwise
+ */
+int
+shm_init(char const * const path, uint64_t const cycles_per_sec,
+         uint64_t const levels, uint64_t const cycles)
+{
+    // Start from a fresh object, owned by the resource manager.
+    shm_unlink(path);
+    int const   fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd == -1) {
+        perror("shm_open");
+        return 0;
+    }
+
+    if (ftruncate(fd, sizeof(rpi_gpio_shm_t)) == -1) {
+        perror("ftruncate");
+        close(fd);
+        return 0;
+    }
+
+    void * const    ptr = mmap(0, sizeof(rpi_gpio_shm_t),
+                               PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        perror("mmap");
+        return 0;
+    }
+
+    rpi_gpio_shm_t * const  new_shm = ptr;
+    memset(new_shm, 0, sizeof(*new_shm));
+    new_shm->cycles_per_sec = cycles_per_sec;
+    new_shm->state.levels = levels;
+    new_shm->state.update_cycles = cycles;
+    new_shm->version = RPI_GPIO_SHM_VERSION;
+
+    // Readers check the magic value last.
+    atomic_thread_fence(memory_order_release);
+    new_shm->magic = RPI_GPIO_SHM_MAGIC;
+
+    shm = new_shm;
+
+    if (verbose) {
+        printf("Publishing GPIO state on %s\n", path);
+    }
+
+    return 1;
+}
+
+/**
+ * Update the published state with the result of an interrupt.
+ * Only called from the interrupt service thread.
+ * @param   levels  Current levels
+ * @param   edges   Mask of pins on which an event was detected
+ * @param   cycles  Time at which the events were detected
+ */
+void
+shm_update(uint64_t const levels, uint64_t edges, uint64_t const cycles)
+{
+    if (shm == NULL) {
+        return;
+    }
+
+    // Make the sequence number odd before touching the state, and even again
+    // once the state is complete.
+    unsigned const  seq = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+    atomic_store_explicit(&shm->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    shm->state.levels = levels;
+    shm->state.update_cycles = cycles;
+
+    while (edges != 0) {
+        unsigned const  gpio = __builtin_ctzll(edges);
+        shm->state.edge_cycles[gpio] = cycles;
+        shm->state.edge_count[gpio]++;
+        edges &= edges - 1;
+    }
+
+    atomic_store_explicit(&shm->seq, seq + 2, memory_order_release);
+}
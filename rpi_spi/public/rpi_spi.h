@@ -19,6 +19,9 @@
  #define RPI_SPI_API_H
  
 #include <hw/io-spi.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/uio.h>
 
 // SPI GPIO pins for RaspBerry PI 4 / 5
 #define SPI0_CE0 8
@@ -43,6 +46,72 @@
 #define SPI_ERROR_NOT_CONNECTED -1
 #define SPI_ERROR_BAD_ARGUMENT -2
 #define SPI_ERROR_OPERATION_FAILED -3
+#define SPI_ERROR_QUEUE_FULL -4
+#define SPI_ERROR_PENDING -5
+#define SPI_ERROR_CANCELLED -6
+
+/* Bus numbers go up to RPI_SPI_MAX_BUSES - 1 */
+#define RPI_SPI_MAX_BUSES 6
+
+/* Async requests queued or running on a bus at once */
+#define RPI_SPI_QUEUE_DEPTH 8
+
+/* Exchange buffers per bus/device, so one can be filled while another is sent */
+#define RPI_SPI_BUFFERS 2
+
+/* Most iov parts rpi_spi_write_read_datav accepts */
+#define RPI_SPI_MAX_PARTS 16
+
+/* Most segments a batch holds */
+#define RPI_SPI_BATCH_SEGMENTS 64
+
+/* Keep chip select asserted after the segment, the next segment is sent in the same exchange */
+#define RPI_SPI_SEGMENT_CS_HOLD 0x1
+
+typedef enum
+{
+    RPI_SPI_SEGMENT_CONFIGURE,
+    RPI_SPI_SEGMENT_WRITE,
+    RPI_SPI_SEGMENT_WRITE_READ,
+} rpi_spi_segment_type_t;
+
+/* One step of a batch, filled by the rpi_spi_batch_* calls */
+typedef struct
+{
+    rpi_spi_segment_type_t type;
+    unsigned device_number;                      // chip select of the segment
+    unsigned flags;                              // RPI_SPI_SEGMENT_*
+    unsigned mode;                               // configure only
+    uint32_t speed_hz;                           // 0 keeps the device's speed
+    uint8_t *data;
+    uint32_t size;
+} rpi_spi_segment_t;
+
+/* Segments queued on one bus and sent by a single rpi_spi_batch_submit */
+typedef struct
+{
+    unsigned bus_number;
+    int count;
+    int completed;                               // segments done by the last submit
+    rpi_spi_segment_t segments[RPI_SPI_BATCH_SEGMENTS];
+} rpi_spi_batch_t;
+
+/* An async operation, owned by the caller and left alone until it completes or is cancelled.
+   Set up with rpi_spi_request_init before its first use. */
+typedef struct rpi_spi_request_t
+{
+    // filled by the rpi_spi_*_async calls
+    int type;
+    unsigned bus_number;
+    unsigned device_number;
+    unsigned mode;
+    uint32_t speed_hz;
+    uint8_t *data;
+    uint32_t size;
+    rpi_spi_batch_t *batch;
+    struct sigevent event;
+    atomic_int result;                           // SPI_ERROR_PENDING until the request is done
+} rpi_spi_request_t;
 
 /**
  * Query the SPI driver
@@ -87,11 +156,11 @@ int rpi_spi_get_device_info(unsigned bus_number, unsigned device_number, spi_dev
 int rpi_spi_configure_device(unsigned bus_number, unsigned device_number, unsigned mode, uint32_t spi_device_speed_hz);
 
 /**
- * Write/read data to/from the SPI interface
+ * Write/read data to/from the SPI interface, the data read back replaces the data written
  *
  * @param    bus_number          SPI bus number
  * @param    device_number       SPI device number
- * @param    data_buffer         pointer to buffer of data to write
+ * @param    data_buffer         pointer to buffer of data to write, receives the data read (output)
  * @param    data_size           data buffer size
  *
  * @returns  SPI_SUCCESS                on success,
@@ -101,7 +170,241 @@ int rpi_spi_configure_device(unsigned bus_number, unsigned device_number, unsign
 int rpi_spi_write_read_data(unsigned bus_number, unsigned device_number, uint8_t *data_buffer, uint32_t data_size);
 
 /**
- * Cleanup from using the SPI device
+ * Exchange data with the SPI device, full-duplex. Both buffers are used in place.
+ *
+ * @param    bus_number          SPI bus number
+ * @param    device_number       SPI device number
+ * @param    tx_buffer           data to write, NULL to write zeros
+ * @param    rx_buffer           data read (output), NULL to discard it, may be tx_buffer
+ * @param    data_size           size of each buffer
+ *
+ * @returns  SPI_SUCCESS                on success,
+ *           SPI_ERROR_NOT_CONNECTED    if the SPI device is not available to connect to
+ *           SPI_ERROR_BAD_ARGUMENT     no data or both buffers NULL
+ *           SPI_ERROR_OPERATION_FAILED SPI operation failed
+ */
+int rpi_spi_exchange(unsigned bus_number, unsigned device_number, const uint8_t *tx_buffer, uint8_t *rx_buffer,
+                     uint32_t data_size);
+
+/**
+ * Read data from the SPI device, zeros are written meanwhile
+ *
+ * @param    bus_number          SPI bus number
+ * @param    device_number       SPI device number
+ * @param    rx_buffer           data read (output)
+ * @param    data_size           data buffer size
+ *
+ * @returns  see rpi_spi_exchange
+ */
+int rpi_spi_read_data(unsigned bus_number, unsigned device_number, uint8_t *rx_buffer, uint32_t data_size);
+
+/**
+ * Write data gathered from several buffers to the SPI interface in one transfer, without copying it.
+ * The data read back is discarded.
+ *
+ * @param    bus_number          SPI bus number
+ * @param    device_number       SPI device number
+ * @param    iov                 buffers to write, in order
+ * @param    parts               number of buffers, up to RPI_SPI_MAX_PARTS
+ *
+ * @returns  SPI_SUCCESS                on success,
+ *           SPI_ERROR_NOT_CONNECTED    if the SPI device is not available to connect to
+ *           SPI_ERROR_BAD_ARGUMENT     invalid number of parts or nothing to write
+ *           SPI_ERROR_OPERATION_FAILED SPI operation failed
+ */
+int rpi_spi_write_read_datav(unsigned bus_number, unsigned device_number, const struct iovec *iov, int parts);
+
+/**
+ * Get a persistent exchange buffer of a bus/device to write the data of rpi_spi_write_read_buffer into.
+ * The buffer is allocated zeroed on first use or when it has to grow, and kept until rpi_spi_cleanup_device.
+ *
+ * @param    bus_number          SPI bus number
+ * @param    device_number       SPI device number
+ * @param    index               buffer index, below RPI_SPI_BUFFERS
+ * @param    data_size           size the buffer must hold
+ *
+ * @returns  the buffer, NULL on invalid argument or allocation failure
+ */
+uint8_t *rpi_spi_get_buffer(unsigned bus_number, unsigned device_number, unsigned index, uint32_t data_size);
+
+/**
+ * Write the start of an exchange buffer to the SPI interface, the message is sent in place.
+ * The data read back is discarded, the buffer keeps what was written.
+ *
+ * @param    bus_number          SPI bus number
+ * @param    device_number       SPI device number
+ * @param    index               buffer index from rpi_spi_get_buffer
+ * @param    data_size           bytes to write, up to the size given to rpi_spi_get_buffer
+ *
+ * @returns  SPI_SUCCESS                on success,
+ *           SPI_ERROR_NOT_CONNECTED    if the SPI device is not available to connect to
+ *           SPI_ERROR_BAD_ARGUMENT     invalid buffer or size
+ *           SPI_ERROR_OPERATION_FAILED SPI operation failed
+ */
+int rpi_spi_write_read_buffer(unsigned bus_number, unsigned device_number, unsigned index, uint32_t data_size);
+
+/**
+ * Start an empty batch on a bus
+ *
+ * @param    batch               batch to initialize
+ * @param    bus_number          SPI bus number every segment is sent on
+ *
+ * @returns  None
+ */
+void rpi_spi_batch_init(rpi_spi_batch_t *batch, unsigned bus_number);
+
+/**
+ * Queue a configuration of a device, skipped on submit if the device already has it
+ *
+ * @param    batch               batch to add to
+ * @param    device_number       SPI device number
+ * @param    mode                SPI device mode
+ * @param    spi_device_speed_hz SPI device speed in Hz
+ *
+ * @returns  SPI_SUCCESS                on success,
+ *           SPI_ERROR_BAD_ARGUMENT     the batch is full
+ */
+int rpi_spi_batch_configure(rpi_spi_batch_t *batch, unsigned device_number, unsigned mode, uint32_t spi_device_speed_hz);
+
+/**
+ * Queue a write, the data read back is discarded
+ *
+ * @param    batch               batch to add to
+ * @param    device_number       SPI device number (chip select)
+ * @param    speed_hz            speed of the segment, 0 for the device's speed
+ * @param    data_buffer         data to write, must stay valid until submit
+ * @param    data_size           data buffer size
+ * @param    flags               RPI_SPI_SEGMENT_CS_HOLD to send the next segment in the same exchange
+ *
+ * @returns  SPI_SUCCESS                on success,
+ *           SPI_ERROR_BAD_ARGUMENT     the batch is full or the size is 0
+ */
+int rpi_spi_batch_write(rpi_spi_batch_t *batch, unsigned device_number, uint32_t speed_hz, uint8_t *data_buffer,
+                        uint32_t data_size, unsigned flags);
+
+/**
+ * Queue a write whose data read back replaces the written data in data_buffer
+ *
+ * @param    batch               batch to add to
+ * @param    device_number       SPI device number (chip select)
+ * @param    speed_hz            speed of the segment, 0 for the device's speed
+ * @param    data_buffer         data to write and read back into, must stay valid until submit
+ * @param    data_size           data buffer size
+ * @param    flags               RPI_SPI_SEGMENT_CS_HOLD to send the next segment in the same exchange
+ *
+ * @returns  SPI_SUCCESS                on success,
+ *           SPI_ERROR_BAD_ARGUMENT     the batch is full or the size is 0
+ */
+int rpi_spi_batch_write_read(rpi_spi_batch_t *batch, unsigned device_number, uint32_t speed_hz, uint8_t *data_buffer,
+                             uint32_t data_size, unsigned flags);
+
+/**
+ * Send the segments of a batch back to back and return once they are all done. Configurations the
+ * device already has are skipped and segments joined with RPI_SPI_SEGMENT_CS_HOLD go out as one
+ * exchange, so a batch costs one message per exchange and configuration change.
+ * The batch can be submitted again.
+ *
+ * @param    batch               batch to send, completed is set to the number of segments done
+ *
+ * @returns  SPI_SUCCESS                on success,
+ *           SPI_ERROR_NOT_CONNECTED    if the SPI device is not available to connect to
+ *           SPI_ERROR_BAD_ARGUMENT     joined segments on different devices or speeds, a speed set
+ *                                      on a device that was never configured, or too many parts
+ *           SPI_ERROR_OPERATION_FAILED SPI operation failed
+ */
+int rpi_spi_batch_submit(rpi_spi_batch_t *batch);
+
+/**
+ * Set up a request before its first submission, rpi_spi_wait on it returns SPI_ERROR_BAD_ARGUMENT until then.
+ * A request is reused as is once it has completed or was cancelled.
+ *
+ * @param    request             request to initialize
+ *
+ * @returns  None
+ */
+void rpi_spi_request_init(rpi_spi_request_t *request);
+
+/**
+ * Queue a device configuration on the bus worker and return without waiting.
+ * Requests on a bus run one at a time in submission order.
+ *
+ * @param    request             initialized request to fill, must stay valid until it completes
+ * @param    bus_number          SPI bus number
+ * @param    device_number       SPI device number
+ * @param    mode                SPI device mode
+ * @param    spi_device_speed_hz SPI device speed in Hz
+ * @param    event               delivered on completion: SIGEV_PULSE, SIGEV_SIGNAL or NULL for none
+ *
+ * @returns  SPI_SUCCESS                queued
+ *           SPI_ERROR_QUEUE_FULL       RPI_SPI_QUEUE_DEPTH requests are already queued or running on the bus
+ *           SPI_ERROR_PENDING          the request is still queued or running, it is left untouched
+ *           SPI_ERROR_BAD_ARGUMENT     invalid bus or event
+ *           SPI_ERROR_OPERATION_FAILED the bus worker could not be started, or is being shut down
+ */
+int rpi_spi_configure_device_async(rpi_spi_request_t *request, unsigned bus_number, unsigned device_number,
+                                   unsigned mode, uint32_t spi_device_speed_hz, const struct sigevent *event);
+
+/**
+ * Queue a write/read on the bus worker and return without waiting, see rpi_spi_configure_device_async
+ *
+ * @param    request             request to fill, must stay valid until it completes
+ * @param    bus_number          SPI bus number
+ * @param    device_number       SPI device number
+ * @param    data_buffer         data to write, receives the data read, must stay valid until the request completes
+ * @param    data_size           data buffer size
+ * @param    event               delivered on completion: SIGEV_PULSE, SIGEV_SIGNAL or NULL for none
+ *
+ * @returns  see rpi_spi_configure_device_async
+ */
+int rpi_spi_write_read_data_async(rpi_spi_request_t *request, unsigned bus_number, unsigned device_number,
+                                  uint8_t *data_buffer, uint32_t data_size, const struct sigevent *event);
+
+/**
+ * Queue a batch on the worker of its bus and return without waiting, see rpi_spi_configure_device_async
+ *
+ * @param    request             request to fill, must stay valid until it completes
+ * @param    batch               batch to send, must stay valid until the request completes
+ * @param    event               delivered on completion: SIGEV_PULSE, SIGEV_SIGNAL or NULL for none
+ *
+ * @returns  see rpi_spi_configure_device_async
+ */
+int rpi_spi_batch_submit_async(rpi_spi_request_t *request, rpi_spi_batch_t *batch, const struct sigevent *event);
+
+/**
+ * Remove a request that has not started yet from its bus queue, no event is delivered for it
+ *
+ * @param    request             queued request
+ *
+ * @returns  SPI_SUCCESS                cancelled, the request's result is SPI_ERROR_CANCELLED
+ *           SPI_ERROR_PENDING          the request is running and will complete
+ *           SPI_ERROR_BAD_ARGUMENT     the request is not queued, it has completed or was cancelled
+ */
+int rpi_spi_cancel(rpi_spi_request_t *request);
+
+/**
+ * Block until a request completes
+ *
+ * @param    request             submitted request
+ *
+ * @returns  the result of the request, as the matching synchronous call would return it,
+ *           SPI_ERROR_BAD_ARGUMENT for an initialized request that was never submitted
+ */
+int rpi_spi_wait(rpi_spi_request_t *request);
+
+/**
+ * Run the requests queued on a bus and stop its worker, joining it. A later request starts a new one.
+ * Requests submitted while the worker is stopping are refused.
+ *
+ * @param    bus_number          SPI bus number
+ *
+ * @returns  SPI_SUCCESS                the bus has no worker left
+ *           SPI_ERROR_BAD_ARGUMENT     invalid bus
+ */
+int rpi_spi_async_shutdown(unsigned bus_number);
+
+/**
+ * Cleanup from using the SPI device, this frees its exchange buffers once the async requests
+ * queued on its bus are done and the bus worker has stopped (see rpi_spi_async_shutdown)
  *
  * @param    bus_number          SPI bus number
  * @param    device_number       SPI device number
@@ -19,81 +19,213 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <devctl.h>
+#include <sched.h>
+#include <sys/neutrino.h>
 #include "public/rpi_spi.h"
 
 #define SPI_DEVICE_FILENAME_FORMAT "/dev/io-spi/spi%d/dev%d"
 
-#define MAX_SPI_BUSES 6
+#define MAX_SPI_BUSES RPI_SPI_MAX_BUSES
 #define MAX_SPI_BUS_DEVICES 10 // should be good enough to start with
 
-static int spi_device_fd[MAX_SPI_BUSES][MAX_SPI_BUS_DEVICES] = {
-    {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1}};
+// Device file descriptors, opened on first use. Each slot packs the fd + 1 (0 if not open) with the
+// number of calls using it and the flags below, and is only changed by compare-exchange, so the
+// transfer path takes no lock. An fd is only closed once no call uses it any more: fd numbers are
+// reused as soon as they are closed, so closing one still in use could hand its number, and the
+// calls in flight on it, to another open.
+static atomic_uint_least64_t spi_device_fd[MAX_SPI_BUSES][MAX_SPI_BUS_DEVICES];
 
-// Mutex protecting the SPI device file descriptors
-static pthread_mutex_t spi_fd_mutex;
+#define SPI_FD_USER ((uint64_t)1 << 32) // one call using the fd
+#define SPI_FD_STALE ((uint64_t)1 << 48) // connection went stale, the last user closes it
+#define SPI_FD_BADF ((uint64_t)1 << 49) // fd was closed under us, it must not be closed again
+#define SPI_FD(slot) ((int)((slot) & 0xffffffff) - 1)
+#define SPI_FD_USERS(slot) (((slot) >> 32) & 0xffff)
 
-/* Open the SPI device */
+// Last configuration set on each device, mode in the high half and speed in the low half, 0 if unknown
+static atomic_uint_least64_t spi_device_config[MAX_SPI_BUSES][MAX_SPI_BUS_DEVICES];
+
+#define SPI_DEVICE_CFG(mode, speed_hz) (((uint64_t)(mode) << 32) | (speed_hz))
+
+// Reply bytes of write segments sent in front of a read back land here
+#define DISCARD_SIZE 256
+
+// Transmit data of reads, gathered as often as needed instead of filling a payload
+#define FILL_SIZE 1024
+static const uint8_t spi_fill[FILL_SIZE];
+
+// Exchange messages handed out by rpi_spi_get_buffer, kept until rpi_spi_cleanup_device
+static spi_xchng_t *spi_buffer[MAX_SPI_BUSES][MAX_SPI_BUS_DEVICES][RPI_SPI_BUFFERS];
+static uint32_t spi_buffer_size[MAX_SPI_BUSES][MAX_SPI_BUS_DEVICES][RPI_SPI_BUFFERS];
+
+/* Get the SPI device fd for one call, opening the device on first use. Returns -1 on failure,
+   otherwise the fd must be handed back with release_spi_device_fd */
 static int
-open_spi_device_fd(unsigned bus_number, unsigned device_number)
+acquire_spi_device_fd(unsigned bus_number, unsigned device_number)
 {
-    char spi_device_name[20] = {0};
+    char spi_device_name[32] = {0};
 
-    sprintf(spi_device_name, SPI_DEVICE_FILENAME_FORMAT, bus_number, device_number);
+    if (bus_number >= MAX_SPI_BUSES || device_number >= MAX_SPI_BUS_DEVICES)
+    {
+        fprintf(stderr, "invalid SPI bus %u device %u\n", bus_number, device_number);
+        return -1;
+    }
 
-    pthread_mutex_lock(&spi_fd_mutex);
+    atomic_uint_least64_t *slot = &spi_device_fd[bus_number][device_number];
+    uint64_t cached = atomic_load(slot);
 
-    if (spi_device_fd[bus_number][device_number] == -1)
+    for (;;)
     {
-        spi_device_fd[bus_number][device_number] = open(spi_device_name, O_RDWR);
-        if (spi_device_fd[bus_number][device_number] < 0)
+        if (cached & SPI_FD_STALE)
+        {
+            // the calls still using a stale fd finish soon, the last one closes it and empties the slot
+            sched_yield();
+            cached = atomic_load(slot);
+            continue;
+        }
+
+        if (cached != 0)
+        {
+            if (atomic_compare_exchange_weak(slot, &cached, cached + SPI_FD_USER))
+            {
+                return SPI_FD(cached);
+            }
+            continue;
+        }
+
+        snprintf(spi_device_name, sizeof(spi_device_name), SPI_DEVICE_FILENAME_FORMAT, bus_number, device_number);
+
+        int fd = open(spi_device_name, O_RDWR);
+        if (fd < 0)
         {
             perror("open");
-            return SPI_ERROR_NOT_CONNECTED;
+            return -1;
         }
+
+        // Threads opening the device at the same time race to publish their fd, the losers use the winner's
+        if (atomic_compare_exchange_strong(slot, &cached, (uint64_t)(fd + 1) | SPI_FD_USER))
+        {
+            return fd;
+        }
+        close(fd);
     }
+}
 
-    pthread_mutex_unlock(&spi_fd_mutex);
+/* Hand back an fd from acquire_spi_device_fd. err is the error of the call if its connection went
+   stale, 0 otherwise: the fd is then dropped so the next call opens the device again */
+static void
+release_spi_device_fd(unsigned bus_number, unsigned device_number, int err)
+{
+    atomic_uint_least64_t *slot = &spi_device_fd[bus_number][device_number];
+    uint64_t flags = err == 0 ? 0 : err == EBADF ? SPI_FD_STALE | SPI_FD_BADF : SPI_FD_STALE;
+    uint64_t cached = atomic_load(slot);
+    uint64_t next;
 
-    return SPI_SUCCESS;
+    do
+    {
+        next = (cached - SPI_FD_USER) | flags;
+        if ((next & SPI_FD_STALE) && SPI_FD_USERS(next) == 0)
+        {
+            next = 0;
+        }
+    } while (!atomic_compare_exchange_weak(slot, &cached, next));
+
+    if (err != 0)
+    {
+        // a restarted driver has forgotten the configuration
+        atomic_store(&spi_device_config[bus_number][device_number], 0);
+    }
+
+    // only the last user of a stale fd closes it, and EBADF means it is closed already
+    if (next == 0 && !((cached | flags) & SPI_FD_BADF))
+    {
+        close(SPI_FD(cached));
+    }
 }
 
-/* Close the SPI device */
+/* Close the SPI device, or leave it to the last call still using it */
 static int
 close_spi_device_fd(unsigned bus_number, unsigned device_number)
 {
-    pthread_mutex_lock(&spi_fd_mutex);
+    if (bus_number >= MAX_SPI_BUSES || device_number >= MAX_SPI_BUS_DEVICES)
+    {
+        return SPI_ERROR_NOT_CONNECTED;
+    }
+
+    atomic_store(&spi_device_config[bus_number][device_number], 0);
 
-    if (spi_device_fd[bus_number][device_number] != -1)
+    atomic_uint_least64_t *slot = &spi_device_fd[bus_number][device_number];
+    uint64_t cached = atomic_load(slot);
+    uint64_t next;
+
+    do
     {
-        int err = close(spi_device_fd[bus_number][device_number]);
+        if (cached == 0 || (cached & SPI_FD_STALE))
+        {
+            return SPI_SUCCESS;
+        }
+        next = SPI_FD_USERS(cached) == 0 ? 0 : cached | SPI_FD_STALE;
+    } while (!atomic_compare_exchange_weak(slot, &cached, next));
+
+    if (next == 0 && !(cached & SPI_FD_BADF))
+    {
+        int err = close(SPI_FD(cached));
         if (err != EOK)
         {
             perror("close");
             return SPI_ERROR_NOT_CONNECTED;
         }
-        spi_device_fd[bus_number][device_number] = -1;
     }
 
-    pthread_mutex_unlock(&spi_fd_mutex);
-
     return SPI_SUCCESS;
 }
 
-int rpi_spi_get_driver_info(unsigned bus_number, unsigned device_number, spi_drvinfo_t *driver_info)
+/* Send a devctl to the SPI device. If the connection went stale, e.g. io-spi was restarted,
+   the device is opened again and the message resent once */
+static int
+spi_devctlv(unsigned bus_number, unsigned device_number, int dcmd, int sparts, int rparts, const iov_t *sv, const iov_t *rv)
 {
-    int err;
-
-    if (open_spi_device_fd(bus_number, device_number))
+    for (int attempt = 0;; attempt++)
     {
-        perror("open_spi_device_fd");
-        return SPI_ERROR_NOT_CONNECTED;
+        int fd = acquire_spi_device_fd(bus_number, device_number);
+        if (fd < 0)
+        {
+            return SPI_ERROR_NOT_CONNECTED;
+        }
+
+        int err = devctlv(fd, dcmd, sparts, rparts, sv, rv, NULL);
+        int stale = err == EBADF || err == ESRCH || err == ENODEV;
+
+        release_spi_device_fd(bus_number, device_number, stale ? err : 0);
+        if (err == EOK)
+        {
+            return SPI_SUCCESS;
+        }
+
+        if (stale && attempt == 0)
+        {
+            continue;
+        }
+
+        fprintf(stderr, "devctl: %s\n", strerror(err));
+        return SPI_ERROR_OPERATION_FAILED;
     }
+}
+
+static int
+spi_devctl(unsigned bus_number, unsigned device_number, int dcmd, void *data, size_t size)
+{
+    iov_t iov;
 
+    SETIOV(&iov, data, size);
+
+    return spi_devctlv(bus_number, device_number, dcmd, 1, 1, &iov, &iov);
+}
+
+int rpi_spi_get_driver_info(unsigned bus_number, unsigned device_number, spi_drvinfo_t *driver_info)
+{
     if (driver_info == NULL)
     {
         perror("invalid driver_info");
@@ -101,120 +233,412 @@ int rpi_spi_get_driver_info(unsigned bus_number, unsigned device_number, spi_drv
     }
 
     // Send the SPI message
-    err = devctl(spi_device_fd[bus_number][device_number], DCMD_SPI_GET_DRVINFO, driver_info, sizeof(spi_drvinfo_t), NULL);
-    if (err != EOK)
+    return spi_devctl(bus_number, device_number, DCMD_SPI_GET_DRVINFO, driver_info, sizeof(spi_drvinfo_t));
+}
+
+int rpi_spi_get_device_info(unsigned bus_number, unsigned device_number, spi_devinfo_t *device_info)
+{
+    if (device_info == NULL)
     {
-        perror("devctl");
-        return SPI_ERROR_OPERATION_FAILED;
+        perror("invalid device_info");
+        return SPI_ERROR_BAD_ARGUMENT;
     }
 
-    return SPI_SUCCESS;
+    // Send the SPI message
+    return spi_devctl(bus_number, device_number, DCMD_SPI_GET_DEVINFO, device_info, sizeof(spi_devinfo_t));
 }
 
-int rpi_spi_get_device_info(unsigned bus_number, unsigned device_number, spi_devinfo_t *device_info)
+int rpi_spi_configure_device(unsigned bus_number, unsigned device_number, unsigned mode, uint32_t spi_device_speed_hz)
 {
-    int err;
+    // Configure the SPI device according to supplied parameters
+    spi_cfg_t spi_device_cfg = {
+        .mode = mode,
+        .clock_rate = spi_device_speed_hz};
 
-    if (open_spi_device_fd(bus_number, device_number))
+    // Send the SPI message
+    int err = spi_devctl(bus_number, device_number, DCMD_SPI_SET_CONFIG, &spi_device_cfg, sizeof(spi_cfg_t));
+    if (err == SPI_SUCCESS)
     {
-        perror("open_spi_device_fd");
-        return SPI_ERROR_NOT_CONNECTED;
+        atomic_store(&spi_device_config[bus_number][device_number], SPI_DEVICE_CFG(mode, spi_device_speed_hz));
     }
 
-    if (device_info == NULL)
+    return err;
+}
+
+/* Send an exchange message gathered from iov. The data read back lands in rx_buffer, or is
+   discarded if it is NULL */
+static int
+send_xchng(unsigned bus_number, unsigned device_number, spi_xchng_t *header, const struct iovec *iov, int parts,
+           uint8_t *rx_buffer)
+{
+    iov_t sv[RPI_SPI_MAX_PARTS + 1];
+    iov_t rv[2];
+
+    SETIOV(&sv[0], header, sizeof(spi_xchng_t));
+    for (int i = 0; i < parts; i++)
     {
-        perror("invalid device_info");
-        return SPI_ERROR_BAD_ARGUMENT;
+        SETIOV(&sv[i + 1], iov[i].iov_base, iov[i].iov_len);
     }
 
-    // Send the SPI message
-    err = devctl(spi_device_fd[bus_number][device_number], DCMD_SPI_GET_DEVINFO, device_info, sizeof(spi_devinfo_t), NULL);
-    if (err != EOK)
+    // io-spi reads the whole message before replying, so rx_buffer may be the transmit data
+    SETIOV(&rv[0], header, sizeof(spi_xchng_t));
+    if (rx_buffer != NULL)
     {
-        perror("devctl");
-        return SPI_ERROR_OPERATION_FAILED;
+        SETIOV(&rv[1], rx_buffer, header->nbytes);
     }
 
-    return SPI_SUCCESS;
+    return spi_devctlv(bus_number, device_number, DCMD_SPI_DATA_XCHNG, parts + 1, rx_buffer != NULL ? 2 : 1, sv, rv);
 }
 
-int rpi_spi_configure_device(unsigned bus_number, unsigned device_number, unsigned mode, uint32_t spi_device_speed_hz)
+int rpi_spi_write_read_data(unsigned bus_number, unsigned device_number, uint8_t *data_buffer, uint32_t data_size)
+{
+    return rpi_spi_exchange(bus_number, device_number, data_buffer, data_buffer, data_size);
+}
+
+int rpi_spi_write_read_datav(unsigned bus_number, unsigned device_number, const struct iovec *iov, int parts)
 {
-    int err;
+    spi_xchng_t header = {0};
 
-    if (open_spi_device_fd(bus_number, device_number))
+    if (parts < 1 || parts > RPI_SPI_MAX_PARTS)
     {
-        perror("open_spi_device_fd");
-        return SPI_ERROR_NOT_CONNECTED;
+        perror("invalid iov parts");
+        return SPI_ERROR_BAD_ARGUMENT;
     }
 
-    // Configure the SPI device according to supplied parameters
-    spi_cfg_t spi_device_cfg = {
-        .mode = mode,
-        .clock_rate = spi_device_speed_hz};
+    for (int i = 0; i < parts; i++)
+    {
+        header.nbytes += iov[i].iov_len;
+    }
 
-    // Send the SPI message
-    err = devctl(spi_device_fd[bus_number][device_number], DCMD_SPI_SET_CONFIG, &spi_device_cfg, sizeof(spi_cfg_t), NULL);
-    if (err != EOK)
+    if (header.nbytes < 1)
     {
-        perror("devctl");
-        fprintf(stderr, "error: %d\n", err);
-        return SPI_ERROR_OPERATION_FAILED;
+        perror("invalid data size");
+        return SPI_ERROR_BAD_ARGUMENT;
     }
 
-    return SPI_SUCCESS;
+    return send_xchng(bus_number, device_number, &header, iov, parts, NULL);
 }
 
-int rpi_spi_write_read_data(unsigned bus_number, unsigned device_number, uint8_t *data_buffer, uint32_t data_size)
+int rpi_spi_exchange(unsigned bus_number, unsigned device_number, const uint8_t *tx_buffer, uint8_t *rx_buffer,
+                     uint32_t data_size)
 {
-    int err;
+    spi_xchng_t header = {.nbytes = data_size};
+    struct iovec iov[RPI_SPI_MAX_PARTS];
+    int parts = 0;
 
-    if (open_spi_device_fd(bus_number, device_number))
+    if (data_size < 1 || (tx_buffer == NULL && rx_buffer == NULL))
+    {
+        perror("invalid data size");
+        return SPI_ERROR_BAD_ARGUMENT;
+    }
+
+    if (tx_buffer != NULL)
+    {
+        iov[parts].iov_base = (void *)tx_buffer;
+        iov[parts].iov_len = data_size;
+        parts++;
+    }
+    else if (data_size <= RPI_SPI_MAX_PARTS * FILL_SIZE)
+    {
+        // a read sends zeros, taken from the fill block rather than written out per transfer
+        for (uint32_t offset = 0; offset < data_size; offset += FILL_SIZE)
+        {
+            iov[parts].iov_base = (void *)spi_fill;
+            iov[parts].iov_len = data_size - offset < FILL_SIZE ? data_size - offset : FILL_SIZE;
+            parts++;
+        }
+    }
+    else
+    {
+        // too long to gather from the fill block, send the zeroed receive buffer in place
+        memset(rx_buffer, 0, data_size);
+        iov[parts].iov_base = rx_buffer;
+        iov[parts].iov_len = data_size;
+        parts++;
+    }
+
+    return send_xchng(bus_number, device_number, &header, iov, parts, rx_buffer);
+}
+
+int rpi_spi_read_data(unsigned bus_number, unsigned device_number, uint8_t *rx_buffer, uint32_t data_size)
+{
+    return rpi_spi_exchange(bus_number, device_number, NULL, rx_buffer, data_size);
+}
+
+uint8_t *rpi_spi_get_buffer(unsigned bus_number, unsigned device_number, unsigned index, uint32_t data_size)
+{
+    if (bus_number >= MAX_SPI_BUSES || device_number >= MAX_SPI_BUS_DEVICES || index >= RPI_SPI_BUFFERS)
+    {
+        return NULL;
+    }
+
+    spi_xchng_t **buffer = &spi_buffer[bus_number][device_number][index];
+    uint32_t *size = &spi_buffer_size[bus_number][device_number][index];
+
+    if (*buffer == NULL || *size < data_size)
+    {
+        free(*buffer);
+        *size = 0;
+
+        // zeroed, callers rely on the bytes they do not write staying low
+        *buffer = calloc(1, sizeof(spi_xchng_t) + data_size);
+        if (*buffer == NULL)
+        {
+            perror("alloc failed");
+            return NULL;
+        }
+        *size = data_size;
+    }
+
+    return (*buffer)->data;
+}
+
+int rpi_spi_write_read_buffer(unsigned bus_number, unsigned device_number, unsigned index, uint32_t data_size)
+{
+    if (bus_number >= MAX_SPI_BUSES || device_number >= MAX_SPI_BUS_DEVICES)
     {
-        perror("open_spi_device_fd");
         return SPI_ERROR_NOT_CONNECTED;
     }
 
+    if (index >= RPI_SPI_BUFFERS || data_size < 1 || data_size > spi_buffer_size[bus_number][device_number][index])
+    {
+        perror("invalid buffer");
+        return SPI_ERROR_BAD_ARGUMENT;
+    }
+
+    spi_xchng_t *spi_xchng_msg = spi_buffer[bus_number][device_number][index];
+    spi_xchng_msg->nbytes = data_size;
+
+    struct iovec iov = {.iov_base = spi_xchng_msg->data, .iov_len = data_size};
+
+    return send_xchng(bus_number, device_number, spi_xchng_msg, &iov, 1, NULL);
+}
+
+void rpi_spi_batch_init(rpi_spi_batch_t *batch, unsigned bus_number)
+{
+    batch->bus_number = bus_number;
+    batch->count = 0;
+    batch->completed = 0;
+}
+
+/* Append a segment to a batch */
+static int
+batch_add(rpi_spi_batch_t *batch, rpi_spi_segment_t segment)
+{
+    if (batch->count == RPI_SPI_BATCH_SEGMENTS)
+    {
+        perror("batch full");
+        return SPI_ERROR_BAD_ARGUMENT;
+    }
+
+    batch->segments[batch->count++] = segment;
+
+    return SPI_SUCCESS;
+}
+
+int rpi_spi_batch_configure(rpi_spi_batch_t *batch, unsigned device_number, unsigned mode, uint32_t spi_device_speed_hz)
+{
+    rpi_spi_segment_t segment = {
+        .type = RPI_SPI_SEGMENT_CONFIGURE,
+        .device_number = device_number,
+        .mode = mode,
+        .speed_hz = spi_device_speed_hz};
+
+    return batch_add(batch, segment);
+}
+
+int rpi_spi_batch_write(rpi_spi_batch_t *batch, unsigned device_number, uint32_t speed_hz, uint8_t *data_buffer,
+                        uint32_t data_size, unsigned flags)
+{
+    rpi_spi_segment_t segment = {
+        .type = RPI_SPI_SEGMENT_WRITE,
+        .device_number = device_number,
+        .flags = flags,
+        .speed_hz = speed_hz,
+        .data = data_buffer,
+        .size = data_size};
+
     if (data_size < 1)
     {
         perror("invalid data size");
         return SPI_ERROR_BAD_ARGUMENT;
     }
 
-    // Allocate memory for the message
-    spi_xchng_t *spi_xchng_msg = NULL;
-    spi_xchng_msg = malloc(sizeof(spi_xchng_t) + data_size); // allocate enough memory for the data
-    if (!spi_xchng_msg)
+    return batch_add(batch, segment);
+}
+
+int rpi_spi_batch_write_read(rpi_spi_batch_t *batch, unsigned device_number, uint32_t speed_hz, uint8_t *data_buffer,
+                             uint32_t data_size, unsigned flags)
+{
+    int err = rpi_spi_batch_write(batch, device_number, speed_hz, data_buffer, data_size, flags);
+
+    if (err == SPI_SUCCESS)
     {
-        perror("alloc failed");
-        return -1;
+        batch->segments[batch->count - 1].type = RPI_SPI_SEGMENT_WRITE_READ;
     }
 
-    // Add the data
-    spi_xchng_msg->nbytes = data_size;
-    for (int i = 0; i < data_size; i++)
+    return err;
+}
+
+/* Set a device's configuration unless it already has it */
+static int
+batch_configure(unsigned bus_number, unsigned device_number, unsigned mode, uint32_t speed_hz)
+{
+    if (atomic_load(&spi_device_config[bus_number][device_number]) == SPI_DEVICE_CFG(mode, speed_hz))
     {
-        spi_xchng_msg->data[i] = data_buffer[i];
+        return SPI_SUCCESS;
     }
 
-    // Send the SPI message
-    err = devctl(spi_device_fd[bus_number][device_number], DCMD_SPI_DATA_XCHNG, spi_xchng_msg, sizeof(spi_xchng_t) + data_size, NULL);
-    if (err != EOK)
+    return rpi_spi_configure_device(bus_number, device_number, mode, speed_hz);
+}
+
+/* Send segments first to last as one exchange, reading back into the write-read segments */
+static int
+batch_exchange(rpi_spi_batch_t *batch, int first, int last)
+{
+    const unsigned bus_number = batch->bus_number;
+    const unsigned device_number = batch->segments[first].device_number;
+    const uint32_t speed_hz = batch->segments[first].speed_hz;
+    uint8_t discard[DISCARD_SIZE];
+    iov_t sv[RPI_SPI_BATCH_SEGMENTS + 1];
+    iov_t rv[2 * RPI_SPI_BATCH_SEGMENTS + 1];
+    spi_xchng_t header = {0};
+    int sparts = 1, rparts = 1;
+    int last_read = -1;
+    int i;
+
+    for (i = first; i <= last; i++)
     {
-        free(spi_xchng_msg);
-        fprintf(stderr, "error: %d\n", err);
-        perror("devctl");
-        return SPI_ERROR_OPERATION_FAILED;
+        rpi_spi_segment_t *segment = &batch->segments[i];
+
+        if (segment->type == RPI_SPI_SEGMENT_CONFIGURE || segment->device_number != device_number ||
+            segment->speed_hz != speed_hz)
+        {
+            perror("joined segments differ");
+            return SPI_ERROR_BAD_ARGUMENT;
+        }
+
+        SETIOV(&sv[sparts], segment->data, segment->size);
+        sparts++;
+        header.nbytes += segment->size;
+
+        if (segment->type == RPI_SPI_SEGMENT_WRITE_READ)
+        {
+            last_read = i;
+        }
+    }
+
+    // the reply is as long as what was sent up to the last write-read segment, the bytes of write
+    // segments in front of it go to the discard buffer
+    for (i = first; i <= last_read; i++)
+    {
+        rpi_spi_segment_t *segment = &batch->segments[i];
+        uint32_t offset = 0;
+
+        do
+        {
+            uint32_t size = segment->size - offset;
+            if (segment->type == RPI_SPI_SEGMENT_WRITE && size > DISCARD_SIZE)
+            {
+                size = DISCARD_SIZE;
+            }
+
+            if (rparts == sizeof(rv) / sizeof(rv[0]))
+            {
+                perror("too many parts before a read back");
+                return SPI_ERROR_BAD_ARGUMENT;
+            }
+            SETIOV(&rv[rparts], segment->type == RPI_SPI_SEGMENT_WRITE_READ ? segment->data : discard, size);
+            rparts++;
+            offset += size;
+        } while (offset < segment->size);
+    }
+
+    // the segment speed needs the device's mode, which is only known once it was configured
+    if (speed_hz != 0)
+    {
+        const uint64_t cfg = atomic_load(&spi_device_config[bus_number][device_number]);
+        if (cfg == 0)
+        {
+            perror("segment speed on an unconfigured device");
+            return SPI_ERROR_BAD_ARGUMENT;
+        }
+
+        int err = batch_configure(bus_number, device_number, cfg >> 32, speed_hz);
+        if (err != SPI_SUCCESS)
+        {
+            return err;
+        }
+    }
+
+    SETIOV(&sv[0], &header, sizeof(spi_xchng_t));
+    SETIOV(&rv[0], &header, sizeof(spi_xchng_t));
+
+    return spi_devctlv(bus_number, device_number, DCMD_SPI_DATA_XCHNG, sparts, rparts, sv, rv);
+}
+
+int rpi_spi_batch_submit(rpi_spi_batch_t *batch)
+{
+    int first = 0;
+
+    batch->completed = 0;
+
+    if (batch->bus_number >= MAX_SPI_BUSES)
+    {
+        return SPI_ERROR_NOT_CONNECTED;
     }
 
-    // Free allocated message
-    free(spi_xchng_msg);
+    while (first < batch->count)
+    {
+        rpi_spi_segment_t *segment = &batch->segments[first];
+        int last = first;
+        int err;
+
+        if (segment->device_number >= MAX_SPI_BUS_DEVICES)
+        {
+            return SPI_ERROR_NOT_CONNECTED;
+        }
+
+        if (segment->type == RPI_SPI_SEGMENT_CONFIGURE)
+        {
+            err = batch_configure(batch->bus_number, segment->device_number, segment->mode, segment->speed_hz);
+        }
+        else
+        {
+            while ((batch->segments[last].flags & RPI_SPI_SEGMENT_CS_HOLD) && last + 1 < batch->count)
+            {
+                last++;
+            }
+            err = batch_exchange(batch, first, last);
+        }
+
+        if (err != SPI_SUCCESS)
+        {
+            return err;
+        }
+
+        first = last + 1;
+        batch->completed = first;
+    }
 
     return SPI_SUCCESS;
 }
 
 int rpi_spi_cleanup_device(unsigned bus_number, unsigned device_number)
 {
+    if (bus_number < MAX_SPI_BUSES && device_number < MAX_SPI_BUS_DEVICES)
+    {
+        // async requests queued on the bus may still use the buffers
+        rpi_spi_async_shutdown(bus_number);
+
+        for (int index = 0; index < RPI_SPI_BUFFERS; index++)
+        {
+            free(spi_buffer[bus_number][device_number][index]);
+            spi_buffer[bus_number][device_number][index] = NULL;
+            spi_buffer_size[bus_number][device_number][index] = 0;
+        }
+    }
+
     if (close_spi_device_fd(bus_number, device_number))
     {
         perror("close_spi_device_fd");
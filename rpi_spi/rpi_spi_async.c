@@ -0,0 +1,367 @@
+/*
+ * Async requests, queued per bus and run by one worker thread per bus on top of the
+ * synchronous calls of rpi_spi.c.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__QNXNTO__)
+#include <sys/neutrino.h>
+#endif
+#include "public/rpi_spi.h"
+
+enum
+{
+    REQUEST_CONFIGURE,
+    REQUEST_WRITE,
+    REQUEST_BATCH,
+};
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;                         // signalled when a request is queued or completes
+    pthread_t thread;
+    int running;
+    int stopping;                                // set by rpi_spi_async_shutdown, the worker exits once idle
+    rpi_spi_request_t *queue[RPI_SPI_QUEUE_DEPTH]; // waiting requests, oldest first
+    int queued;
+    rpi_spi_request_t *active;                   // request the worker is running
+} bus_queue_t;
+
+static bus_queue_t bus_queue[RPI_SPI_MAX_BUSES];
+static pthread_once_t bus_queue_once = PTHREAD_ONCE_INIT;
+
+static void
+init_bus_queues(void)
+{
+    for (int bus = 0; bus < RPI_SPI_MAX_BUSES; bus++)
+    {
+        pthread_mutex_init(&bus_queue[bus].mutex, NULL);
+        pthread_cond_init(&bus_queue[bus].cond, NULL);
+    }
+}
+
+/* Deliver a completion event to this process */
+static void
+deliver_event(const struct sigevent *event)
+{
+    switch (event->sigev_notify)
+    {
+#if defined(__QNXNTO__)
+    case SIGEV_PULSE:
+        if (MsgSendPulsePtr(event->sigev_coid, event->sigev_priority, event->sigev_code,
+                            event->sigev_value.sival_ptr) == -1)
+        {
+            perror("MsgSendPulsePtr");
+        }
+        break;
+#endif
+    case SIGEV_SIGNAL:
+        if (sigqueue(getpid(), event->sigev_signo, event->sigev_value) == -1)
+        {
+            perror("sigqueue");
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static int
+run_request(rpi_spi_request_t *request)
+{
+    switch (request->type)
+    {
+    case REQUEST_CONFIGURE:
+        return rpi_spi_configure_device(request->bus_number, request->device_number, request->mode, request->speed_hz);
+    case REQUEST_WRITE:
+        return rpi_spi_write_read_data(request->bus_number, request->device_number, request->data, request->size);
+    case REQUEST_BATCH:
+        return rpi_spi_batch_submit(request->batch);
+    default:
+        return SPI_ERROR_BAD_ARGUMENT;
+    }
+}
+
+static void *
+bus_thread(void *arg)
+{
+    bus_queue_t *queue = arg;
+
+    pthread_mutex_lock(&queue->mutex);
+    while (1)
+    {
+        while (queue->queued == 0 && !queue->stopping)
+        {
+            pthread_cond_wait(&queue->cond, &queue->mutex);
+        }
+        if (queue->queued == 0)
+        {
+            break;
+        }
+
+        rpi_spi_request_t *request = queue->queue[0];
+        memmove(&queue->queue[0], &queue->queue[1], --queue->queued * sizeof(queue->queue[0]));
+        queue->active = request;
+        pthread_mutex_unlock(&queue->mutex);
+
+        const int result = run_request(request);
+
+        // the caller may reuse the request as soon as it sees the result, keep the event
+        const struct sigevent event = request->event;
+
+        pthread_mutex_lock(&queue->mutex);
+        queue->active = NULL;
+        atomic_store(&request->result, result);
+        pthread_cond_broadcast(&queue->cond);
+        pthread_mutex_unlock(&queue->mutex);
+
+        deliver_event(&event);
+
+        pthread_mutex_lock(&queue->mutex);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+
+    return NULL;
+}
+
+/* A request can only be filled again once it is neither queued nor running */
+static int
+request_pending(rpi_spi_request_t *request)
+{
+    if (atomic_load(&request->result) == SPI_ERROR_PENDING)
+    {
+        fprintf(stderr, "SPI request %p is still pending\n", (void *)request);
+        return 1;
+    }
+
+    return 0;
+}
+
+void rpi_spi_request_init(rpi_spi_request_t *request)
+{
+    memset(request, 0, sizeof(*request));
+    atomic_init(&request->result, SPI_ERROR_BAD_ARGUMENT);
+}
+
+/* Queue a filled request on its bus, starting the bus worker on first use */
+static int
+submit_request(rpi_spi_request_t *request, const struct sigevent *event)
+{
+    if (request->bus_number >= RPI_SPI_MAX_BUSES)
+    {
+        fprintf(stderr, "invalid SPI bus %u\n", request->bus_number);
+        return SPI_ERROR_BAD_ARGUMENT;
+    }
+
+    memset(&request->event, 0, sizeof(request->event));
+    request->event.sigev_notify = SIGEV_NONE;
+    if (event != NULL)
+    {
+        switch (event->sigev_notify)
+        {
+#if defined(__QNXNTO__)
+        case SIGEV_PULSE:
+#endif
+        case SIGEV_SIGNAL:
+        case SIGEV_NONE:
+            request->event = *event;
+            break;
+        default:
+            fprintf(stderr, "unsupported sigevent notify %d\n", event->sigev_notify);
+            return SPI_ERROR_BAD_ARGUMENT;
+        }
+    }
+
+    pthread_once(&bus_queue_once, init_bus_queues);
+    bus_queue_t *queue = &bus_queue[request->bus_number];
+
+    pthread_mutex_lock(&queue->mutex);
+
+    if (queue->stopping)
+    {
+        pthread_mutex_unlock(&queue->mutex);
+        fprintf(stderr, "SPI bus %u is shutting down\n", request->bus_number);
+        return SPI_ERROR_OPERATION_FAILED;
+    }
+
+    if (!queue->running)
+    {
+        int err = pthread_create(&queue->thread, NULL, bus_thread, queue);
+        if (err != 0)
+        {
+            pthread_mutex_unlock(&queue->mutex);
+            fprintf(stderr, "pthread_create: %s\n", strerror(err));
+            return SPI_ERROR_OPERATION_FAILED;
+        }
+        queue->running = 1;
+    }
+
+    if (queue->queued + (queue->active != NULL) == RPI_SPI_QUEUE_DEPTH)
+    {
+        pthread_mutex_unlock(&queue->mutex);
+        return SPI_ERROR_QUEUE_FULL;
+    }
+
+    atomic_store(&request->result, SPI_ERROR_PENDING);
+    queue->queue[queue->queued++] = request;
+    pthread_cond_broadcast(&queue->cond);
+
+    pthread_mutex_unlock(&queue->mutex);
+
+    return SPI_SUCCESS;
+}
+
+int rpi_spi_configure_device_async(rpi_spi_request_t *request, unsigned bus_number, unsigned device_number,
+                                   unsigned mode, uint32_t spi_device_speed_hz, const struct sigevent *event)
+{
+    if (request_pending(request))
+    {
+        return SPI_ERROR_PENDING;
+    }
+
+    request->type = REQUEST_CONFIGURE;
+    request->bus_number = bus_number;
+    request->device_number = device_number;
+    request->mode = mode;
+    request->speed_hz = spi_device_speed_hz;
+
+    return submit_request(request, event);
+}
+
+int rpi_spi_write_read_data_async(rpi_spi_request_t *request, unsigned bus_number, unsigned device_number,
+                                  uint8_t *data_buffer, uint32_t data_size, const struct sigevent *event)
+{
+    if (request_pending(request))
+    {
+        return SPI_ERROR_PENDING;
+    }
+
+    request->type = REQUEST_WRITE;
+    request->bus_number = bus_number;
+    request->device_number = device_number;
+    request->data = data_buffer;
+    request->size = data_size;
+
+    return submit_request(request, event);
+}
+
+int rpi_spi_batch_submit_async(rpi_spi_request_t *request, rpi_spi_batch_t *batch, const struct sigevent *event)
+{
+    if (request_pending(request))
+    {
+        return SPI_ERROR_PENDING;
+    }
+
+    request->type = REQUEST_BATCH;
+    request->bus_number = batch->bus_number;
+    request->batch = batch;
+
+    return submit_request(request, event);
+}
+
+int rpi_spi_cancel(rpi_spi_request_t *request)
+{
+    if (request->bus_number >= RPI_SPI_MAX_BUSES)
+    {
+        return SPI_ERROR_BAD_ARGUMENT;
+    }
+
+    pthread_once(&bus_queue_once, init_bus_queues);
+    bus_queue_t *queue = &bus_queue[request->bus_number];
+    int err = SPI_ERROR_BAD_ARGUMENT;
+
+    pthread_mutex_lock(&queue->mutex);
+
+    if (queue->active == request)
+    {
+        err = SPI_ERROR_PENDING;
+    }
+
+    for (int i = 0; i < queue->queued; i++)
+    {
+        if (queue->queue[i] == request)
+        {
+            memmove(&queue->queue[i], &queue->queue[i + 1], (queue->queued - i - 1) * sizeof(queue->queue[0]));
+            queue->queued--;
+            atomic_store(&request->result, SPI_ERROR_CANCELLED);
+            pthread_cond_broadcast(&queue->cond);
+            err = SPI_SUCCESS;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&queue->mutex);
+
+    return err;
+}
+
+int rpi_spi_wait(rpi_spi_request_t *request)
+{
+    if (request->bus_number >= RPI_SPI_MAX_BUSES)
+    {
+        return SPI_ERROR_BAD_ARGUMENT;
+    }
+
+    pthread_once(&bus_queue_once, init_bus_queues);
+    bus_queue_t *queue = &bus_queue[request->bus_number];
+
+    pthread_mutex_lock(&queue->mutex);
+    while (atomic_load(&request->result) == SPI_ERROR_PENDING)
+    {
+        pthread_cond_wait(&queue->cond, &queue->mutex);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+
+    return atomic_load(&request->result);
+}
+
+int rpi_spi_async_shutdown(unsigned bus_number)
+{
+    if (bus_number >= RPI_SPI_MAX_BUSES)
+    {
+        return SPI_ERROR_BAD_ARGUMENT;
+    }
+
+    pthread_once(&bus_queue_once, init_bus_queues);
+    bus_queue_t *queue = &bus_queue[bus_number];
+
+    pthread_mutex_lock(&queue->mutex);
+
+    if (queue->stopping)
+    {
+        // another caller is joining the worker, wait for it to be gone
+        while (queue->running)
+        {
+            pthread_cond_wait(&queue->cond, &queue->mutex);
+        }
+        pthread_mutex_unlock(&queue->mutex);
+        return SPI_SUCCESS;
+    }
+
+    if (!queue->running)
+    {
+        pthread_mutex_unlock(&queue->mutex);
+        return SPI_SUCCESS;
+    }
+
+    queue->stopping = 1;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+
+    // the worker runs what is queued before it exits
+    pthread_join(queue->thread, NULL);
+
+    pthread_mutex_lock(&queue->mutex);
+    queue->running = 0;
+    queue->stopping = 0;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+
+    return SPI_SUCCESS;
+}
@@ -0,0 +1,124 @@
+/*
+ * Lookup tables for ws2811_init_gamma_lookup, generated by spi_mock/gamma_gen.c.
+ *
+ * The gamma curves are for the default color correction and temperature (255 on every color),
+ * out = round(pow(in / 255, gamma) * 255), matching what pow() produced in
+ * ws2811_init_gamma_lookup. Gamma 1.0 is the identity and needs no table.
+ */
+
+#ifndef __WS2811_GAMMA_TABLES_H__
+#define __WS2811_GAMMA_TABLES_H__
+
+#include <stdint.h>
+
+static const uint8_t gamma_2_2[256] = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,
+      1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+      3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+      6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  11,  11,  11,  12,
+     12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,
+     20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+     30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,  41,
+     42,  43,  43,  44,  45,  46,  47,  48,  49,  49,  50,  51,  52,  53,  54,  55,
+     56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+     73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,  87,  88,  89,  90,
+     91,  93,  94,  95,  97,  98,  99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+    113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+    137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+    163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+    192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+    223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255,
+};
+
+static const uint8_t gamma_2_8[256] = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   1,   1,   1,
+      1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+      2,   3,   3,   3,   3,   3,   3,   3,   4,   4,   4,   4,   4,   5,   5,   5,
+      5,   6,   6,   6,   6,   7,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,
+     10,  10,  11,  11,  11,  12,  12,  13,  13,  13,  14,  14,  15,  15,  16,  16,
+     17,  17,  18,  18,  19,  19,  20,  20,  21,  21,  22,  22,  23,  24,  24,  25,
+     25,  26,  27,  27,  28,  29,  29,  30,  31,  32,  32,  33,  34,  35,  35,  36,
+     37,  38,  39,  39,  40,  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  50,
+     51,  52,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,  64,  66,  67,  68,
+     69,  70,  72,  73,  74,  75,  77,  78,  79,  81,  82,  83,  85,  86,  87,  89,
+     90,  92,  93,  95,  96,  98,  99, 101, 102, 104, 105, 107, 109, 110, 112, 114,
+    115, 117, 119, 120, 122, 124, 126, 127, 129, 131, 133, 135, 137, 138, 140, 142,
+    144, 146, 148, 150, 152, 154, 156, 158, 160, 162, 164, 167, 169, 171, 173, 175,
+    177, 180, 182, 184, 186, 189, 191, 193, 196, 198, 200, 203, 205, 208, 210, 213,
+    215, 218, 220, 223, 225, 228, 231, 233, 236, 239, 241, 244, 247, 249, 252, 255,
+};
+
+// log2(n) in Q16, for the fixed point gamma generator (log2(0) is unused)
+static const int32_t log2_q16[256] = {
+          0,       0,   65536,  103872,  131072,  152170,  169408,  183983,
+     196608,  207744,  217706,  226717,  234944,  242512,  249519,  256042,
+     262144,  267876,  273280,  278392,  283242,  287855,  292253,  296456,
+     300480,  304340,  308048,  311616,  315055,  318373,  321578,  324678,
+     327680,  330589,  333412,  336153,  338816,  341407,  343928,  346384,
+     348778,  351113,  353391,  355616,  357789,  359914,  361992,  364026,
+     366016,  367966,  369876,  371748,  373584,  375385,  377152,  378887,
+     380591,  382264,  383909,  385525,  387114,  388677,  390214,  391727,
+     393216,  394682,  396125,  397547,  398948,  400328,  401689,  403030,
+     404352,  405656,  406943,  408212,  409464,  410700,  411920,  413125,
+     414314,  415488,  416649,  417795,  418927,  420046,  421152,  422245,
+     423325,  424394,  425450,  426495,  427528,  428550,  429562,  430562,
+     431552,  432532,  433502,  434462,  435412,  436353,  437284,  438206,
+     439120,  440025,  440921,  441809,  442688,  443560,  444423,  445279,
+     446127,  446967,  447800,  448626,  449445,  450256,  451061,  451859,
+     452650,  453435,  454213,  454985,  455750,  456510,  457263,  458010,
+     458752,  459488,  460218,  460942,  461661,  462375,  463083,  463786,
+     464484,  465177,  465864,  466547,  467225,  467898,  468566,  469229,
+     469888,  470543,  471192,  471838,  472479,  473115,  473748,  474376,
+     475000,  475620,  476236,  476848,  477456,  478060,  478661,  479257,
+     479850,  480439,  481024,  481606,  482185,  482759,  483331,  483898,
+     484463,  485024,  485582,  486136,  486688,  487236,  487781,  488323,
+     488861,  489397,  489930,  490459,  490986,  491510,  492031,  492549,
+     493064,  493577,  494086,  494593,  495098,  495599,  496098,  496594,
+     497088,  497579,  498068,  498554,  499038,  499519,  499998,  500474,
+     500948,  501419,  501889,  502355,  502820,  503282,  503742,  504200,
+     504656,  505109,  505561,  506010,  506457,  506902,  507345,  507786,
+     508224,  508661,  509096,  509528,  509959,  510388,  510815,  511240,
+     511663,  512084,  512503,  512921,  513336,  513750,  514162,  514572,
+     514981,  515387,  515792,  516195,  516597,  516997,  517395,  517791,
+     518186,  518579,  518971,  519361,  519749,  520136,  520521,  520904,
+     521286,  521667,  522046,  522423,  522799,  523173,  523546,  523918,
+};
+
+// 2^-(n / 256) in Q30, for the fixed point gamma generator
+static const uint32_t exp2_q30[256] = {
+    1073741824, 1070838486, 1067942999, 1065055341, 1062175491, 1059303428, 1056439131, 1053582579,
+    1050733751, 1047892626, 1045059183, 1042233401, 1039415261, 1036604740, 1033801819, 1031006477,
+    1028218693, 1025438448, 1022665720, 1019900489, 1017142735, 1014392438, 1011649578, 1008914134,
+    1006186087, 1003465416, 1000752102,  998046124,  995347464,  992656100,  989972014,  987295185,
+     984625594,  981963222,  979308048,  976660054,  974019220,  971385527,  968758955,  966139485,
+     963527098,  960921775,  958323496,  955732243,  953147997,  950570738,  948000448,  945437108,
+     942880699,  940331203,  937788600,  935252872,  932724001,  930201967,  927686753,  925178340,
+     922676710,  920181844,  917693724,  915212331,  912737649,  910269657,  907808339,  905353676,
+     902905651,  900464244,  898029440,  895601218,  893179563,  890764456,  888355878,  885953814,
+     883558244,  881169153,  878786521,  876410331,  874040567,  871677210,  869320244,  866969651,
+     864625413,  862287515,  859955938,  857630665,  855311680,  852998965,  850692504,  848392279,
+     846098274,  843810471,  841528855,  839253408,  836984114,  834720956,  832463917,  830212982,
+     827968132,  825729353,  823496627,  821269938,  819049271,  816834607,  814625932,  812423229,
+     810226483,  808035676,  805850792,  803671817,  801498734,  799331526,  797170178,  795014675,
+     792865000,  790721137,  788583072,  786450787,  784324269,  782203500,  780088465,  777979150,
+     775875538,  773777614,  771685363,  769598769,  767517817,  765442492,  763372778,  761308661,
+     759250125,  757197155,  755149737,  753107854,  751071493,  749040637,  747015274,  744995386,
+     742980960,  740971982,  738968435,  736970306,  734977579,  732990241,  731008277,  729031671,
+     727060411,  725094480,  723133865,  721178552,  719228525,  717283772,  715344277,  713410026,
+     711481005,  709557200,  707638598,  705725183,  703816941,  701913860,  700015924,  698123120,
+     696235434,  694352853,  692475362,  690602947,  688735596,  686873293,  685016026,  683163781,
+     681316545,  679474303,  677637043,  675804750,  673977412,  672155015,  670337545,  668524990,
+     666717336,  664914570,  663116678,  661323648,  659535466,  657752119,  655973594,  654199878,
+     652430958,  650666822,  648907455,  647152846,  645402981,  643657847,  641917433,  640181724,
+     638450708,  636724373,  635002706,  633285695,  631573326,  629865587,  628162466,  626463950,
+     624770026,  623080683,  621395908,  619715688,  618040012,  616368866,  614702239,  613040119,
+     611382493,  609729349,  608080675,  606436459,  604796689,  603161352,  601530438,  599903933,
+     598281827,  596664106,  595050760,  593441776,  591837143,  590236848,  588640881,  587049229,
+     585461881,  583878825,  582300049,  580725543,  579155293,  577589290,  576027521,  574469975,
+     572916640,  571367506,  569822560,  568281792,  566745190,  565212742,  563684439,  562160268,
+     560640218,  559124278,  557612438,  556104685,  554601009,  553101399,  551605844,  550114332,
+     548626854,  547143398,  545663953,  544188508,  542717053,  541249576,  539786068,  538326517,
+};
+
+#endif /* __WS2811_GAMMA_TABLES_H__ */
@@ -123,9 +123,17 @@ typedef struct ws2811_t
     uint64_t render_wait_time;                   //< time in µs before the next render can run
     struct ws2811_device *device;                //< Private data for driver use
     uint32_t freq;                               //< Required output frequency
+    int async;                                   //< Send from a worker thread, ws2811_render does not block
     ws2811_channel_t channel[LED_STRIP_CHANNELS];
 } ws2811_t;
 
+typedef struct ws2811_stats_t
+{
+    uint64_t queued;                             //< Frames rendered
+    uint64_t coalesced;                          //< Frames replaced by a newer render before being sent
+    uint64_t completed;                          //< Frames sent to the strips
+} ws2811_stats_t;
+
 #define WS2811_RETURN_STATES(X)                                                             \
             X(0, WS2811_SUCCESS, "Success"),                                                \
             X(-1, WS2811_ERROR_GENERIC, "Generic failure"),                                 \
@@ -165,15 +173,31 @@ void ws2811_fini(ws2811_t *ws2811);
 /**
  * Render the pixel buffer from the user supplied LED arrays.
  * This will update all LEDs on both PWM channels.
+ * In async mode the frame is queued for the worker thread and the call returns without waiting,
+ * a queued frame not yet sent is replaced by the new one.
  *
  * @param    ws2811  ws2811 instance pointer.
  *
- * @returns  None
+ * @returns  0 on success, in async mode the error of the last failed transfer
  */
 ws2811_return_t ws2811_render(ws2811_t *ws2811);
 
+/**
+ * Encode color bytes into the SPI symbols sent to the strip, 8 bytes per color byte.
+ * ws2811_render uses this for every channel, it is exposed for benchmarking.
+ *
+ * @param    dst     encoded output, count * 8 bytes, no alignment needed
+ * @param    colors  color bytes in transmit order
+ * @param    count   number of color bytes
+ * @param    invert  non-zero to invert the output signal
+ *
+ * @returns  None
+ */
+void ws2811_encode(uint8_t *dst, const uint8_t *colors, int count, int invert);
+
 /**
  * Wait for any executing operation to complete before returning.
+ * In async mode this blocks until the last rendered frame has been sent.
  *
  * @param    ws2811  ws2811 instance pointer.
  *
@@ -181,6 +205,16 @@ ws2811_return_t ws2811_render(ws2811_t *ws2811);
  */
 ws2811_return_t ws2811_wait(ws2811_t *ws2811);
 
+/**
+ * Read the frame counters, queued == coalesced + completed once ws2811_wait returns.
+ *
+ * @param    ws2811  ws2811 instance pointer.
+ * @param    stats   filled with the counters
+ *
+ * @returns  None
+ */
+void ws2811_get_stats(ws2811_t *ws2811, ws2811_stats_t *stats);
+
 /**
  * Return string representation of API return codes.
  *
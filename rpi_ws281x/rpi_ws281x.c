@@ -42,13 +42,20 @@
 
 
 #include <fcntl.h>
-#include <math.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/neutrino.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 #include "public/rpi_ws281x.h"
+#include "gamma_tables.h"
 
 // Driver mode definitions
 // PWM/PCM/DMA driver mode removed (for now) from QNX version of this library
@@ -62,6 +69,25 @@
 
 #define LED_ZERO 0b11000000
 #define LED_ONE 0b11111100
+
+// The 8 SPI symbols of a color byte as one 64-bit word, most significant bit first in memory.
+// The tables below are built at compile time for little-endian stores.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "the WS2811 symbol tables assume a little-endian target"
+#endif
+
+#define LED_SYMBOL(x, b) ((uint64_t)(((x) & (0x80 >> (b))) ? LED_ONE : LED_ZERO) << ((b) * 8))
+#define LED_SYMBOLS(x) (LED_SYMBOL(x, 0) | LED_SYMBOL(x, 1) | LED_SYMBOL(x, 2) | LED_SYMBOL(x, 3) | \
+                        LED_SYMBOL(x, 4) | LED_SYMBOL(x, 5) | LED_SYMBOL(x, 6) | LED_SYMBOL(x, 7))
+#define LED_SYMBOLS_INVERTED(x) (~LED_SYMBOLS(x))
+
+#define LED_TABLE_4(f, x) f(x), f(x + 1), f(x + 2), f(x + 3)
+#define LED_TABLE_16(f, x) LED_TABLE_4(f, x), LED_TABLE_4(f, x + 4), LED_TABLE_4(f, x + 8), LED_TABLE_4(f, x + 12)
+#define LED_TABLE_64(f, x) LED_TABLE_16(f, x), LED_TABLE_16(f, x + 16), LED_TABLE_16(f, x + 32), LED_TABLE_16(f, x + 48)
+#define LED_TABLE_256(f) LED_TABLE_64(f, 0), LED_TABLE_64(f, 64), LED_TABLE_64(f, 128), LED_TABLE_64(f, 192)
+
+static const uint64_t led_symbols[256] = {LED_TABLE_256(LED_SYMBOLS)};
+static const uint64_t led_symbols_inverted[256] = {LED_TABLE_256(LED_SYMBOLS_INVERTED)};
 #define PREAMBLE_BYTES 44
 
 #define LED_RESET_NS 100000
@@ -78,13 +104,51 @@
 // Pad out to the nearest uint32 + 32-bits for idle low/high times the number of channels
 #define SPI_BYTE_COUNT(leds) (PREAMBLE_BYTES + ((LED_BIT_COUNT(leds) & ~0x7) + 4) + 4)
 
+// A frame holds the encoded data of every channel, each in its own buffer sized for its count.
+// Async mode alternates between two frames so one can be encoded while the other is sent.
+#define FRAMES RPI_SPI_BUFFERS
+
+// Sends one channel of a frame, see spi_transfer
+typedef struct bus_worker
+{
+    ws2811_t *ws2811;
+    pthread_t thread;
+    int running;
+    int chan;
+    int frame;                                   // frame to send, -1 when idle
+    ws2811_return_t result;
+} bus_worker_t;
+
 typedef struct ws2811_device
 {
     int driver_mode;
-    uint8_t *pxl_raw;
+    uint8_t *pxl_raw[FRAMES][LED_STRIP_CHANNELS]; // exchange buffers of the channel's SPI device
+    uint32_t pxl_bytes[LED_STRIP_CHANNELS];      // SPI_BYTE_COUNT of the channel, 0 if nothing is sent
+    uint32_t latch_time[FRAMES];                 // µs the strip needs after a frame is sent
+    uint8_t *colors;                             // color bytes of a channel in transmit order
+    // brightness and gamma folded into one lookup per color in transmit order, rebuilt by update_lut
+    uint8_t lut[LED_STRIP_CHANNELS][LED_COLORS][256];
+    uint8_t shift[LED_STRIP_CHANNELS][LED_COLORS];  // position of each color in a ws2811_led_t
+    int lut_brightness[LED_STRIP_CHANNELS];         // brightness the lut was built for, -1 when stale
     int spi_bus_number[LED_STRIP_CHANNELS];
     int spi_device_number[LED_STRIP_CHANNELS];
     int max_count;
+    // bus workers, protected by bus_mutex
+    bus_worker_t bus[LED_STRIP_CHANNELS];
+    pthread_mutex_t bus_mutex;
+    pthread_cond_t bus_cond;                     // signalled when a channel is queued or sent
+    int bus_pending;                             // channels the workers have not sent yet
+    int bus_stop;
+    // async mode, everything below is protected by mutex
+    pthread_t worker;
+    int worker_running;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;                         // signalled when a frame is queued or sent
+    int pending;                                 // frame waiting for the worker, -1 if none
+    int sending;                                 // frame the worker is sending, -1 if none
+    int stop;
+    ws2811_return_t result;                      // result of the last transfer
+    ws2811_stats_t stats;
 } ws2811_device_t;
 
 // QNX-specific SPI constants
@@ -93,6 +157,22 @@ typedef struct ws2811_device
 #define LED_STRIP_SPI_BUS_3 1
 #define LED_STRIP_SPI_DEVICE 0
 
+// SPI bus driving a data pin, -1 if the pin is not a supported MOSI pin
+static int spi_bus_number(int gpionum)
+{
+    switch (gpionum)
+    {
+    case LED_CHANNEL_0_DATA_PIN:
+        return LED_STRIP_SPI_BUS_1;
+    case LED_CHANNEL_1_DATA_PIN:
+        return LED_STRIP_SPI_BUS_2;
+    case LED_CHANNEL_2_DATA_PIN:
+        return LED_STRIP_SPI_BUS_3;
+    default:
+        return -1;
+    }
+}
+
 // Provides monotonic timestamp in microseconds.
 static uint64_t get_microsecond_timestamp()
 {
@@ -111,6 +191,31 @@ static void ws2811_cleanup(ws2811_t *ws2811)
     ws2811_device_t *device = ws2811->device;
     int chan;
 
+    // stop the threads before the SPI devices and their buffers go away
+    if (device)
+    {
+        if (device->worker_running)
+        {
+            pthread_mutex_lock(&device->mutex);
+            device->stop = 1;
+            pthread_cond_broadcast(&device->cond);
+            pthread_mutex_unlock(&device->mutex);
+            pthread_join(device->worker, NULL);
+        }
+
+        pthread_mutex_lock(&device->bus_mutex);
+        device->bus_stop = 1;
+        pthread_cond_broadcast(&device->bus_cond);
+        pthread_mutex_unlock(&device->bus_mutex);
+        for (chan = 0; chan < LED_STRIP_CHANNELS; chan++)
+        {
+            if (device->bus[chan].running)
+            {
+                pthread_join(device->bus[chan].thread, NULL);
+            }
+        }
+    }
+
     for (chan = 0; chan < LED_STRIP_CHANNELS; chan++)
     {
         if (ws2811->channel[chan].leds)
@@ -125,6 +230,7 @@ static void ws2811_cleanup(ws2811_t *ws2811)
         }
         ws2811->channel[chan].gamma = NULL;
 
+        // this also frees the exchange buffers in pxl_raw
         if (device && (device->spi_bus_number[chan] >= 0))
         {
             rpi_spi_cleanup_device(device->spi_bus_number[chan], device->spi_device_number[chan]);
@@ -133,12 +239,64 @@ static void ws2811_cleanup(ws2811_t *ws2811)
 
     if (device)
     {
+        pthread_mutex_destroy(&device->mutex);
+        pthread_cond_destroy(&device->cond);
+        pthread_mutex_destroy(&device->bus_mutex);
+        pthread_cond_destroy(&device->bus_cond);
+
+        free(device->colors);
         free(device);
     }
 
     ws2811->device = NULL;
 }
 
+static ws2811_return_t channel_transfer(ws2811_t *ws2811, int frame, int chan)
+{
+    ws2811_device_t *device = ws2811->device;
+
+    if (rpi_spi_write_read_buffer(device->spi_bus_number[chan], device->spi_device_number[chan], frame,
+                                  device->pxl_bytes[chan]))
+    {
+        return WS2811_ERROR_SPI_TRANSFER;
+    }
+
+    return WS2811_SUCCESS;
+}
+
+static void *bus_thread(void *arg)
+{
+    bus_worker_t *worker = arg;
+    ws2811_device_t *device = worker->ws2811->device;
+
+    pthread_mutex_lock(&device->bus_mutex);
+    while (1)
+    {
+        while (worker->frame == -1 && !device->bus_stop)
+        {
+            pthread_cond_wait(&device->bus_cond, &device->bus_mutex);
+        }
+        if (worker->frame == -1)
+        {
+            break;
+        }
+
+        const int frame = worker->frame;
+        pthread_mutex_unlock(&device->bus_mutex);
+
+        const ws2811_return_t ret = channel_transfer(worker->ws2811, frame, worker->chan);
+
+        pthread_mutex_lock(&device->bus_mutex);
+        worker->frame = -1;
+        worker->result = ret;
+        device->bus_pending--;
+        pthread_cond_broadcast(&device->bus_cond);
+    }
+    pthread_mutex_unlock(&device->bus_mutex);
+
+    return NULL;
+}
+
 static ws2811_return_t spi_init(ws2811_t *ws2811)
 {
     int chan;
@@ -156,43 +314,157 @@ static ws2811_return_t spi_init(ws2811_t *ws2811)
         }
     }
 
-    // Allocate SPI transmit buffer (same size as PCM)
-    device->pxl_raw = malloc(SPI_BYTE_COUNT(device->max_count));
-    if (device->pxl_raw == NULL)
+    // Frames are encoded straight into the SPI exchange buffers, which are zeroed so the preamble
+    // and reset bytes stay low
+    for (chan = 0; chan < LED_STRIP_CHANNELS; chan++)
+    {
+        if (device->spi_bus_number[chan] != -1 && ws2811->channel[chan].count > 0)
+        {
+            device->pxl_bytes[chan] = SPI_BYTE_COUNT(ws2811->channel[chan].count);
+        }
+
+        for (int frame = 0; frame < (ws2811->async ? FRAMES : 1) && device->pxl_bytes[chan]; frame++)
+        {
+            device->pxl_raw[frame][chan] = rpi_spi_get_buffer(device->spi_bus_number[chan],
+                                                              device->spi_device_number[chan], frame,
+                                                              device->pxl_bytes[chan]);
+            if (device->pxl_raw[frame][chan] == NULL)
+            {
+                ws2811_cleanup(ws2811);
+                return WS2811_ERROR_OUT_OF_MEMORY;
+            }
+        }
+    }
+
+    device->colors = malloc(LED_COUNT(device->max_count));
+    if (device->colors == NULL)
     {
         ws2811_cleanup(ws2811);
         return WS2811_ERROR_OUT_OF_MEMORY;
     }
 
-    uint32_t *pxl_raw = (uint32_t *)device->pxl_raw;
-    int maxcount = device->max_count;
-    int wordcount = LED_COUNT(maxcount) / sizeof(uint32_t);
-    int i;
-
-    for (i = 0; i < wordcount; i++)
+    // The thread calling spi_transfer sends the first channel, every other one gets a worker
+    int first = 1;
+    for (chan = 0; chan < LED_STRIP_CHANNELS; chan++)
     {
-        pxl_raw[i] = 0x0;
+        if (device->pxl_bytes[chan] == 0)
+        {
+            continue;
+        }
+        if (!first)
+        {
+            if (pthread_create(&device->bus[chan].thread, NULL, bus_thread, &device->bus[chan]) != 0)
+            {
+                ws2811_cleanup(ws2811);
+                return WS2811_ERROR_SPI_SETUP;
+            }
+            device->bus[chan].running = 1;
+        }
+        first = 0;
     }
 
     return WS2811_SUCCESS;
 }
 
-static ws2811_return_t spi_transfer(ws2811_t *ws2811, int chan)
+// Sends every channel of a frame to its own bus, the first from the calling thread and the
+// others from their bus workers, so a frame takes as long as its longest strip
+static ws2811_return_t spi_transfer(ws2811_t *ws2811, int frame)
 {
-    // initialize SPI devices indicated in the provided configuration
+    ws2811_device_t *device = ws2811->device;
+    ws2811_return_t ret = WS2811_SUCCESS;
+    int first = -1;
+    int chan;
+
+    pthread_mutex_lock(&device->bus_mutex);
     for (chan = 0; chan < LED_STRIP_CHANNELS; chan++)
     {
-        if (ws2811->device->spi_bus_number[chan] != -1)
+        if (device->pxl_bytes[chan] == 0)
         {
-            if (rpi_spi_write_read_data(ws2811->device->spi_bus_number[chan], ws2811->device->spi_device_number[chan],
-                                        ws2811->device->pxl_raw, SPI_BYTE_COUNT(ws2811->device->max_count)))
-            {
-                return WS2811_ERROR_SPI_TRANSFER;
-            }
+            continue;
+        }
+        if (first == -1)
+        {
+            first = chan;
         }
+        else
+        {
+            device->bus[chan].frame = frame;
+            device->bus_pending++;
+        }
+    }
+    if (device->bus_pending)
+    {
+        pthread_cond_broadcast(&device->bus_cond);
     }
+    pthread_mutex_unlock(&device->bus_mutex);
 
-    return WS2811_SUCCESS;
+    if (first != -1)
+    {
+        ret = channel_transfer(ws2811, frame, first);
+    }
+
+    pthread_mutex_lock(&device->bus_mutex);
+    while (device->bus_pending)
+    {
+        pthread_cond_wait(&device->bus_cond, &device->bus_mutex);
+    }
+    for (chan = 0; chan < LED_STRIP_CHANNELS; chan++)
+    {
+        if (ret == WS2811_SUCCESS)
+        {
+            ret = device->bus[chan].result;
+        }
+        device->bus[chan].result = WS2811_SUCCESS;
+    }
+    pthread_mutex_unlock(&device->bus_mutex);
+
+    return ret;
+}
+
+// Async mode worker, sends the latest queued frame once the strip has latched the previous one
+static void *transfer_thread(void *arg)
+{
+    ws2811_t *ws2811 = arg;
+    ws2811_device_t *device = ws2811->device;
+    uint64_t previous_timestamp = 0;
+    uint32_t latch_time = 0;
+
+    pthread_mutex_lock(&device->mutex);
+    while (1)
+    {
+        while (device->pending == -1 && !device->stop)
+        {
+            pthread_cond_wait(&device->cond, &device->mutex);
+        }
+        if (device->pending == -1)
+        {
+            break;
+        }
+
+        const int frame = device->pending;
+        device->pending = -1;
+        device->sending = frame;
+        pthread_mutex_unlock(&device->mutex);
+
+        const uint64_t time_diff = get_microsecond_timestamp() - previous_timestamp;
+        if (latch_time > time_diff)
+        {
+            usleep(latch_time - time_diff);
+        }
+
+        const ws2811_return_t ret = spi_transfer(ws2811, frame);
+        previous_timestamp = get_microsecond_timestamp();
+        latch_time = device->latch_time[frame];
+
+        pthread_mutex_lock(&device->mutex);
+        device->sending = -1;
+        device->result = ret;
+        device->stats.completed++;
+        pthread_cond_broadcast(&device->cond);
+    }
+    pthread_mutex_unlock(&device->mutex);
+
+    return NULL;
 }
 
 ws2811_return_t ws2811_init(ws2811_t *ws2811)
@@ -208,60 +480,49 @@ ws2811_return_t ws2811_init(ws2811_t *ws2811)
 
     memset(ws2811->device, 0, sizeof(*ws2811->device));
     device = ws2811->device;
+    pthread_mutex_init(&device->mutex, NULL);
+    pthread_cond_init(&device->cond, NULL);
+    device->pending = -1;
+    device->sending = -1;
+    pthread_mutex_init(&device->bus_mutex, NULL);
+    pthread_cond_init(&device->bus_cond, NULL);
 
     for (chan = 0; chan < LED_STRIP_CHANNELS; chan++)
     {
         device->spi_bus_number[chan] = -1;
         device->spi_device_number[chan] = -1;
+        device->lut_brightness[chan] = -1;
+        device->bus[chan].ws2811 = ws2811;
+        device->bus[chan].chan = chan;
+        device->bus[chan].frame = -1;
     }
 
     // the SPI support currently implemented should work on both RPI 4 and RPI 5 and related devices
-    // only support GPIO pins for SPI (for now)
-    if (ws2811->channel[0].gpionum == LED_CHANNEL_0_DATA_PIN || ws2811->channel[0].gpionum == LED_CHANNEL_1_DATA_PIN)
+    // only support GPIO pins for SPI (for now), channel 0 is required and the others are skipped
+    // when they have no pin or no LEDs
+    for (chan = 0; chan < LED_STRIP_CHANNELS; chan++)
     {
-        ws2811->device->driver_mode = SPI;
-        if (ws2811->channel[0].gpionum == LED_CHANNEL_0_DATA_PIN)
-        {
-            device->spi_bus_number[0] = LED_STRIP_SPI_BUS_1;
-        }
-        else if (ws2811->channel[0].gpionum == LED_CHANNEL_1_DATA_PIN)
+        if (chan > 0 && (ws2811->channel[chan].gpionum == -1 || ws2811->channel[chan].count == 0))
         {
-            device->spi_bus_number[0] = LED_STRIP_SPI_BUS_2;
+            continue;
         }
-        else if (ws2811->channel[0].gpionum == LED_CHANNEL_2_DATA_PIN)
+
+        device->spi_bus_number[chan] = spi_bus_number(ws2811->channel[chan].gpionum);
+        if (device->spi_bus_number[chan] == -1)
         {
-            device->spi_bus_number[0] = LED_STRIP_SPI_BUS_3;
+            return WS2811_ERROR_ILLEGAL_GPIO;
         }
-        device->spi_device_number[0] = LED_STRIP_SPI_DEVICE;
-    }
-    else
-    {
-        return WS2811_ERROR_ILLEGAL_GPIO;
-    }
 
-    if (ws2811->channel[1].gpionum != -1)
-    {
-        if (ws2811->channel[1].gpionum == LED_CHANNEL_0_DATA_PIN || ws2811->channel[1].gpionum == LED_CHANNEL_1_DATA_PIN)
+        // channels share nothing, each needs its own bus and exchange buffers
+        for (int other = 0; other < chan; other++)
         {
-            ws2811->device->driver_mode = SPI;
-            if (ws2811->channel[1].gpionum == LED_CHANNEL_0_DATA_PIN)
-            {
-                device->spi_bus_number[1] = LED_STRIP_SPI_BUS_1;
-            }
-            else if (ws2811->channel[1].gpionum == LED_CHANNEL_1_DATA_PIN)
+            if (device->spi_bus_number[other] == device->spi_bus_number[chan])
             {
-                device->spi_bus_number[1] = LED_STRIP_SPI_BUS_2;
+                return WS2811_ERROR_ILLEGAL_GPIO;
             }
-            else if (ws2811->channel[1].gpionum == LED_CHANNEL_2_DATA_PIN)
-            {
-                device->spi_bus_number[1] = LED_STRIP_SPI_BUS_3;
-            }
-            device->spi_device_number[1] = LED_STRIP_SPI_DEVICE;
-        }
-        else
-        {
-            return WS2811_ERROR_ILLEGAL_GPIO;
         }
+        device->spi_device_number[chan] = LED_STRIP_SPI_DEVICE;
+        device->driver_mode = SPI;
     }
 
     device->max_count = 0;
@@ -274,7 +535,14 @@ ws2811_return_t ws2811_init(ws2811_t *ws2811)
     }
 
     // Initialize all pointers to NULL.  Any non-NULL pointers will be freed on cleanup.
-    device->pxl_raw = NULL;
+    for (int frame = 0; frame < FRAMES; frame++)
+    {
+        for (chan = 0; chan < LED_STRIP_CHANNELS; chan++)
+        {
+            device->pxl_raw[frame][chan] = NULL;
+        }
+    }
+    device->colors = NULL;
 
     // Allocate the LED buffers
     for (chan = 0; chan < LED_STRIP_CHANNELS; chan++)
@@ -346,7 +614,21 @@ ws2811_return_t ws2811_init(ws2811_t *ws2811)
     switch (device->driver_mode)
     {
     case SPI:
-        return spi_init(ws2811);
+    {
+        ws2811_return_t ret = spi_init(ws2811);
+        if (ret != WS2811_SUCCESS || !ws2811->async)
+        {
+            return ret;
+        }
+
+        if (pthread_create(&device->worker, NULL, transfer_thread, ws2811) != 0)
+        {
+            ws2811_cleanup(ws2811);
+            return WS2811_ERROR_GENERIC;
+        }
+        device->worker_running = 1;
+        break;
+    }
     default:
         break;
     }
@@ -361,331 +643,108 @@ void ws2811_fini(ws2811_t *ws2811)
     ws2811_cleanup(ws2811);
 }
 
-ws2811_return_t ws2811_render(ws2811_t *ws2811)
+#if defined(__aarch64__) || defined(__ARM_NEON)
+// Encodes 16 color bytes into 128 symbol bytes
+static inline void encode_16(uint8_t *dst, const uint8_t *colors, uint8x16_t zero, uint8x16_t one)
 {
-    static uint8_t convert_table[256][8] =
-        {
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE, LED_ONE},
-
-            {LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO, LED_ONE},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ZERO},
-            {LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE, LED_ONE}
-
-        };
-    volatile uint8_t *pxl_raw = ws2811->device->pxl_raw;
-    int driver_mode = ws2811->device->driver_mode;
-    int i, l, chan;
-    unsigned j;
-    ws2811_return_t ret = WS2811_SUCCESS;
-    uint32_t protocol_time = 0;
-    static uint64_t previous_timestamp = 0;
+    uint8x16_t const in = vld1q_u8(colors);
+    uint8x16_t s[8];
+    int l;
 
-    // Wait for any previous operation to complete.
-    if ((ret = ws2811_wait(ws2811)) != WS2811_SUCCESS)
+    // s[l] holds the symbol for bit 7 - l of every color byte
+    for (l = 0; l < 8; l++)
     {
-        return ret;
+        s[l] = vbslq_u8(vtstq_u8(in, vdupq_n_u8(0x80 >> l)), one, zero);
     }
 
-    if (ws2811->render_wait_time != 0)
+    // transpose so the 8 symbols of each color byte end up next to each other
+    uint8x16x2_t const a01 = vzipq_u8(s[0], s[1]);
+    uint8x16x2_t const a23 = vzipq_u8(s[2], s[3]);
+    uint8x16x2_t const a45 = vzipq_u8(s[4], s[5]);
+    uint8x16x2_t const a67 = vzipq_u8(s[6], s[7]);
+
+    for (l = 0; l < 2; l++)
     {
-        const uint64_t current_timestamp = get_microsecond_timestamp();
-        uint64_t time_diff = current_timestamp - previous_timestamp;
+        uint16x8x2_t const b03 = vzipq_u16(vreinterpretq_u16_u8(a01.val[l]), vreinterpretq_u16_u8(a23.val[l]));
+        uint16x8x2_t const b47 = vzipq_u16(vreinterpretq_u16_u8(a45.val[l]), vreinterpretq_u16_u8(a67.val[l]));
+        uint32x4x2_t const c0 = vzipq_u32(vreinterpretq_u32_u16(b03.val[0]), vreinterpretq_u32_u16(b47.val[0]));
+        uint32x4x2_t const c1 = vzipq_u32(vreinterpretq_u32_u16(b03.val[1]), vreinterpretq_u32_u16(b47.val[1]));
+
+        vst1q_u8(dst + l * 64, vreinterpretq_u8_u32(c0.val[0]));
+        vst1q_u8(dst + l * 64 + 16, vreinterpretq_u8_u32(c0.val[1]));
+        vst1q_u8(dst + l * 64 + 32, vreinterpretq_u8_u32(c1.val[0]));
+        vst1q_u8(dst + l * 64 + 48, vreinterpretq_u8_u32(c1.val[1]));
+    }
+}
+#endif
 
-        if (ws2811->render_wait_time > time_diff)
+void ws2811_encode(uint8_t *dst, const uint8_t *colors, int count, int invert)
+{
+    const uint64_t *table = invert ? led_symbols_inverted : led_symbols;
+    int i = 0;
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+    uint8x16_t const zero = vdupq_n_u8(invert ? (uint8_t)~LED_ZERO : LED_ZERO);
+    uint8x16_t const one = vdupq_n_u8(invert ? (uint8_t)~LED_ONE : LED_ONE);
+
+    for (; i + 16 <= count; i += 16)
+    {
+        encode_16(dst + i * 8, colors + i, zero, one);
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        // the buffer is only byte aligned, memcpy compiles to a single unaligned store
+        memcpy(dst + i * 8, &table[colors[i]], sizeof(uint64_t));
+    }
+}
+
+// Rebuilds the lookup of a channel from its gamma table, brightness and strip type
+static void update_lut(ws2811_t *ws2811, int chan)
+{
+    ws2811_device_t *device = ws2811->device;
+    ws2811_channel_t *channel = &ws2811->channel[chan];
+    const int scale = (channel->brightness & 0xff) + 1;
+    int x, j;
+
+    device->shift[chan][0] = channel->rshift;
+    device->shift[chan][1] = channel->gshift;
+    device->shift[chan][2] = channel->bshift;
+    device->shift[chan][3] = channel->wshift;
+
+    for (j = 0; j < LED_COLORS; j++)
+    {
+        for (x = 0; x < 256; x++)
         {
-            usleep(ws2811->render_wait_time - time_diff);
+            device->lut[chan][j][x] = channel->gamma[((x * scale) >> 8) * LED_COLORS + j];
         }
     }
 
+    device->lut_brightness[chan] = channel->brightness;
+}
+
+// Encodes every channel into a frame, returns the time the strips need to latch it in µs
+static uint32_t encode_frame(ws2811_t *ws2811, int frame)
+{
+    ws2811_device_t *device = ws2811->device;
+    uint8_t *colors = device->colors;
+    int i, chan;
+    uint32_t protocol_time = 0;
+
     for (chan = 0; chan < LED_STRIP_CHANNELS; chan++)
     {
         ws2811_channel_t *channel = &ws2811->channel[chan];
-
-        const int scale = (channel->brightness & 0xff) + 1;
+        const uint8_t(*lut)[256] = device->lut[chan];
+        const uint8_t *shift = device->shift[chan];
         uint8_t array_size = 3; // Assume 3 color LEDs, RGB
 
+        // channels without LEDs or a bus are not sent
+        if (device->pxl_bytes[chan] == 0)
+        {
+            continue;
+        }
+
         // If our shift mask includes the highest nibble, then we have 4 LEDs, RBGW.
         if (channel->strip_type & SK6812_SHIFT_WMASK)
         {
@@ -701,72 +760,163 @@ ws2811_return_t ws2811_render(ws2811_t *ws2811)
             protocol_time = channel_protocol_time;
         }
 
-        for (i = 0; i < channel->count; i++) // Led
+        // the setters mark the lut stale, brightness is written directly by the caller
+        if (channel->count > 0 && device->lut_brightness[chan] != channel->brightness)
         {
-            uint8_t color[LED_COLORS];
-            for (j = 0; j < array_size; j++) // Color
-            {
-                switch (j)
-                {
-                case 0: // red
-                    color[j] = channel->gamma[((((channel->leds[i] >> channel->rshift) & 0xff) * scale) >> 8) * LED_COLORS + j];
-                    break;
-
-                case 1: // green
-                    color[j] = channel->gamma[((((channel->leds[i] >> channel->gshift) & 0xff) * scale) >> 8) * LED_COLORS + j];
-                    break;
-
-                case 2: // blue
-                    color[j] = channel->gamma[((((channel->leds[i] >> channel->bshift) & 0xff) * scale) >> 8) * LED_COLORS + j];
-                    break;
+            update_lut(ws2811, chan);
+        }
 
-                case 3: // white
-                    color[j] = channel->gamma[((((channel->leds[i] >> channel->wshift) & 0xff) * scale) >> 8) * LED_COLORS + j];
-                    break;
-                }
-            }
-            // printf("led color: %x\n", channel->leds[i]);
-            // printf("color: %x %x %x %x\n", color[0], color[1], color[2], color[3]);
+        // everything in locals, the color stores could alias any of it otherwise
+        const ws2811_led_t *leds = channel->leds;
+        const int count = channel->count;
+        const unsigned s0 = shift[0], s1 = shift[1], s2 = shift[2], s3 = shift[3];
+        uint8_t *color = colors;
 
-            for (j = 0; j < array_size; j++) // Color
+        if (array_size == 4)
+        {
+            for (i = 0; i < count; i++, color += 4) // Led
             {
-                for (l = 0; l < 8; ++l)
-                {
-                    uint8_t val = convert_table[color[j]][l];
-                    if (channel->invert)
-                        val = ~val;
-
-                    pxl_raw[PREAMBLE_BYTES + i * array_size * 8 + j * 8 + l] = val;
-                }
+                const ws2811_led_t led = leds[i];
+                color[0] = lut[0][(led >> s0) & 0xff];
+                color[1] = lut[1][(led >> s1) & 0xff];
+                color[2] = lut[2][(led >> s2) & 0xff];
+                color[3] = lut[3][(led >> s3) & 0xff];
             }
         }
-
-        if (driver_mode == SPI)
+        else
         {
-            ret = spi_transfer(ws2811, chan);
-            if (ret)
+            for (i = 0; i < count; i++, color += 3) // Led
             {
-                break;
+                const ws2811_led_t led = leds[i];
+                color[0] = lut[0][(led >> s0) & 0xff];
+                color[1] = lut[1][(led >> s1) & 0xff];
+                color[2] = lut[2][(led >> s2) & 0xff];
             }
         }
+
+        ws2811_encode(device->pxl_raw[frame][chan] + PREAMBLE_BYTES, colors, channel->count * array_size,
+                      channel->invert);
     }
 
     // LED_RESET_WAIT_TIME is added to allow enough time for the reset to occur.
+    return protocol_time + LED_RESET_WAIT_TIME;
+}
+
+// Encodes into whichever frame the worker is not sending and queues it, a frame still waiting
+// to be sent is replaced so only the latest render reaches the strip
+static ws2811_return_t render_async(ws2811_t *ws2811)
+{
+    ws2811_device_t *device = ws2811->device;
+    int frame;
+
+    pthread_mutex_lock(&device->mutex);
+    if (device->pending != -1)
+    {
+        frame = device->pending;
+        device->pending = -1;
+        device->stats.coalesced++;
+    }
+    else
+    {
+        frame = device->sending == 0 ? 1 : 0;
+    }
+    pthread_mutex_unlock(&device->mutex);
+
+    // the worker only touches the frame it is sending, so this one can be encoded unlocked
+    const uint32_t latch_time = encode_frame(ws2811, frame);
+
+    pthread_mutex_lock(&device->mutex);
+    device->latch_time[frame] = latch_time;
+    device->pending = frame;
+    device->stats.queued++;
+    pthread_cond_signal(&device->cond);
+    const ws2811_return_t ret = device->result;
+    pthread_mutex_unlock(&device->mutex);
+
+    ws2811->render_wait_time = latch_time;
+
+    // an error from a previous transfer is reported by the next render
+    return ret;
+}
+
+ws2811_return_t ws2811_render(ws2811_t *ws2811)
+{
+    ws2811_device_t *device = ws2811->device;
+    ws2811_return_t ret = WS2811_SUCCESS;
+    static uint64_t previous_timestamp = 0;
+
+    if (device->worker_running)
+    {
+        return render_async(ws2811);
+    }
+
+    // Wait for any previous operation to complete.
+    if ((ret = ws2811_wait(ws2811)) != WS2811_SUCCESS)
+    {
+        return ret;
+    }
+
+    if (ws2811->render_wait_time != 0)
+    {
+        const uint64_t current_timestamp = get_microsecond_timestamp();
+        uint64_t time_diff = current_timestamp - previous_timestamp;
+
+        if (ws2811->render_wait_time > time_diff)
+        {
+            usleep(ws2811->render_wait_time - time_diff);
+        }
+    }
+
+    const uint32_t latch_time = encode_frame(ws2811, 0);
+    device->stats.queued++;
+
+    if (device->driver_mode == SPI)
+    {
+        ret = spi_transfer(ws2811, 0);
+    }
+    device->stats.completed++;
+
     previous_timestamp = get_microsecond_timestamp();
-    ws2811->render_wait_time = protocol_time + LED_RESET_WAIT_TIME;
+    ws2811->render_wait_time = latch_time;
 
     return ret;
 }
 
 ws2811_return_t ws2811_wait(ws2811_t *ws2811)
 {
+    ws2811_device_t *device = ws2811->device;
+    ws2811_return_t ret;
+
     // Nothing to do for SPI but return error for other driver modes just in case
-    if (ws2811->device->driver_mode != SPI)
+    if (device->driver_mode != SPI)
     {
         return WS2811_ERROR_GENERIC;
     }
 
-    return WS2811_SUCCESS;
+    if (!device->worker_running)
+    {
+        return WS2811_SUCCESS;
+    }
+
+    pthread_mutex_lock(&device->mutex);
+    while (device->pending != -1 || device->sending != -1)
+    {
+        pthread_cond_wait(&device->cond, &device->mutex);
+    }
+    ret = device->result;
+    device->result = WS2811_SUCCESS;
+    pthread_mutex_unlock(&device->mutex);
+
+    return ret;
+}
+
+void ws2811_get_stats(ws2811_t *ws2811, ws2811_stats_t *stats)
+{
+    ws2811_device_t *device = ws2811->device;
+
+    pthread_mutex_lock(&device->mutex);
+    *stats = device->stats;
+    pthread_mutex_unlock(&device->mutex);
 }
 
 const char *ws2811_get_return_t_str(const ws2811_return_t state)
@@ -782,49 +932,87 @@ const char *ws2811_get_return_t_str(const ws2811_return_t state)
     return "";
 }
 
+// 2^-y in Q30 for y >= 0 in Q16, the low 8 bits of the fraction are applied linearly
+static uint32_t exp2_neg_q30(uint64_t y)
+{
+    uint64_t ip = y >> 16;
+    uint32_t lo = y & 0xff;
+    uint64_t result;
+
+    if (ip >= 31)
+    {
+        return 0;
+    }
+
+    // 2^-(lo / 65536) ~= 1 - lo * ln(2) / 65536, ln(2) * 65536 ~= 45426
+    result = exp2_q30[(y >> 8) & 0xff];
+    result -= (result * lo * 45426) >> 32;
+
+    return result >> ip;
+}
+
+// round(pow(color_factor * x / (255 * 255), gamma) * 255) in fixed point, within 1 of the floating point result.
+// Gamma factors of 0 or less give full output.
+static uint8_t gamma_value(uint32_t color_factor, uint32_t x, int32_t gamma_q16)
+{
+    if (gamma_q16 <= 0)
+    {
+        return 255;
+    }
+    if (color_factor == 0 || x == 0)
+    {
+        return 0;
+    }
+
+    // -log2(color_factor * x / (255 * 255)) * gamma
+    int32_t log2_ratio = 2 * log2_q16[255] - log2_q16[color_factor] - log2_q16[x];
+    uint64_t y = ((uint64_t)log2_ratio * gamma_q16 + (1 << 15)) >> 16;
+
+    return ((uint64_t)exp2_neg_q30(y) * 255 + (1 << 29)) >> 30;
+}
+
 void ws2811_init_gamma_lookup(ws2811_t *ws2811)
 {
-    int chan, counter;
-    uint8_t color_factor;
+    static const int shifts[LED_COLORS] = {LED_SHIFT_R, LED_SHIFT_G, LED_SHIFT_B, LED_SHIFT_W};
+    int chan, counter, j;
+
     for (chan = 0; chan < LED_STRIP_CHANNELS; chan++)
     {
         ws2811_channel_t *channel = &ws2811->channel[chan];
 
+        if (ws2811->device)
+        {
+            ws2811->device->lut_brightness[chan] = -1;
+        }
+
         if (channel->gamma)
         {
-            for (counter = 0; counter < 256; counter++)
+            const int32_t gamma_q16 = (int32_t)(channel->gamma_factor * 65536.0 + 0.5);
+            const uint8_t *table = NULL;
+            int identity = 0;
+
+            for (j = 0; j < LED_COLORS; j++)
             {
-                for (int j = 0; j < LED_COLORS; j++)
+                uint32_t color_factor = (((channel->color_correction >> shifts[j]) & 0xff) *
+                                         ((channel->color_temperature >> shifts[j]) & 0xff)) / 255;
+
+                // the default correction and temperature leave the common curves to the tables
+                if (color_factor == 255)
                 {
-                    switch (j)
-                    {
-                    case 0: // red
-                        color_factor = (uint8_t)(((double)((channel->color_correction >> LED_SHIFT_R) & 0xff) *
-                                                  (double)((channel->color_temperature >> LED_SHIFT_R) & 0xff)) /
-                                                 255.0);
-                        break;
-
-                    case 1: // green
-                        color_factor = (uint8_t)(((double)((channel->color_correction >> LED_SHIFT_G) & 0xff) *
-                                                  (double)((channel->color_temperature >> LED_SHIFT_G) & 0xff)) /
-                                                 255.0);
-                        break;
-
-                    case 2: // blue
-                        color_factor = (uint8_t)(((double)((channel->color_correction >> LED_SHIFT_B) & 0xff) *
-                                                  (double)((channel->color_temperature >> LED_SHIFT_B) & 0xff)) /
-                                                 255.0);
-                        break;
-
-                    case 3: // white
-                        color_factor = (uint8_t)(((double)((channel->color_correction >> LED_SHIFT_W) & 0xff) *
-                                                  (double)((channel->color_temperature >> LED_SHIFT_W) & 0xff)) /
-                                                 255.0);
-                        break;
-                    }
+                    identity = gamma_q16 == 65536;
+                    table = gamma_q16 == (int32_t)(2.2 * 65536.0 + 0.5) ? gamma_2_2 :
+                            gamma_q16 == (int32_t)(2.8 * 65536.0 + 0.5) ? gamma_2_8 : NULL;
+                }
+                else
+                {
+                    identity = 0;
+                    table = NULL;
+                }
 
+                for (counter = 0; counter < 256; counter++)
+                {
                     channel->gamma[counter * LED_COLORS + j] =
-                        (int)(pow((float)color_factor * (float)counter / (float)(255.00 * 255.0), channel->gamma_factor) * 255.00 + 0.5);
+                        identity ? counter : table ? table[counter] : gamma_value(color_factor, counter, gamma_q16);
                 }
             }
         }
@@ -1,6 +1,14 @@
 #include <aarch64/rpi_gpio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fb_kernels.h>
+#include <game.h>
+#include <game_record.h>
+#include <input.h>
 #include <math.h>
 #include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <rpi_ws281x.h>
 #include <screen/screen.h>
 #include <stdbool.h>
@@ -9,14 +17,11 @@
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/neutrino.h>
+#include <sys/rpi_gpio.h>
+#include <sys/syspage.h>
 #include <time.h>
 #include <unistd.h>
 
-#define PLAYER_WIDTH 80
-#define PLAYER_HEIGHT 240
-#define WINDOW_HEIGHT 480
-#define WINDOW_WIDTH 800
-
 #define HP_SQUARE_SIZE 50
 #define HP_GAP_SIZE 10
 
@@ -31,35 +36,43 @@
 #define GPIO_P2_2 6
 #define GPIO_P2_HP 20
 
-#define MOVEMENT_SPEED 5
-#define ATTACK_RADIUS (PLAYER_HEIGHT + 100) / 2
-
-#define PLAYER_HEIGHT 240
-#define MAX_HP 5
-#define WINDOW_HEIGHT 480
-#define WINDOW_WIDTH 800
-
-#define ATTACK_CD 800
-#define HIT_CD 500
-#define PARRY_CD 250
-#define PARRY_COUNTER_CD 1000
-
-#define ON_NORMAL_CD 1
-#define ON_ATTACK_CD 2
-#define ON_HIT_CD 3
-#define ON_PARRY_CD 4
-
 #define CIRCLE_COLOR 0xFFFF0000
+// tolerance on the squared distance for pixels drawn by draw_circle
+#define RING_RADIUS_ERROR 200
 #define NORMAL_COLOR 0xFFFFFFFF
 #define ATTACK_COLOR 0xFF00FFFF
 #define HIT_COLOR 0xFFFF0000
 #define PARRY_COLOR 0xFF0000FF
 #define HP_COLOR 0xFFFF0000
+#define BACKGROUND_COLOR 0xFF000000
 
-#define GAME_CLOCK_DELAY 15
+#define MAX_DIRTY_RECTS 16
+// number of buffers in the window's swap chain, 2 or 3
+#ifndef RENDER_BUFFERS
+#define RENDER_BUFFERS 2
+#endif
+#if RENDER_BUFFERS < 2 || RENDER_BUFFERS > 3
+#error "RENDER_BUFFERS must be 2 or 3"
+#endif
+// print the average number of pixels written every n frames when RENDER_STATS
+// is defined
+#define RENDER_STATS_FRAMES 256
+
+// the simulation runs at exactly one tick per GAME_CLOCK_DELAY regardless of
+// how long frames take
+#define GAME_TICK_NS ((uint64_t)GAME_CLOCK_DELAY * 1000000)
+// most ticks run back to back to catch up after a stall, anything beyond that
+// is dropped
+#define MAX_CATCHUP_TICKS 4
+// tick start lateness histogram, in JITTER_BUCKET_US buckets, the last bucket
+// holds everything later than that
+#define JITTER_BUCKETS 32
+#define JITTER_BUCKET_US 250
 
 ws2811_t p1hpstrip = {
     .freq = WS2811_TARGET_FREQ,
+    // the led thread runs at max priority, it must never block on SPI
+    .async = 1,
     .channel =
         {
             [0] =
@@ -83,6 +96,8 @@ ws2811_t p1hpstrip = {
 
 ws2811_t p2hpstrip = {
     .freq = WS2811_TARGET_FREQ,
+    // the led thread runs at max priority, it must never block on SPI
+    .async = 1,
     .channel =
         {
             [0] =
@@ -104,32 +119,174 @@ ws2811_t p2hpstrip = {
         },
 };
 
+GameState game;
+// chained hash of every tick run so far, matches the one printed by a replay
+// of the same recording
+uint64_t game_hash_value = GAME_HASH_INIT;
+// inputs of every tick are appended here when recording, file is NULL
+// otherwise
+GameRecord game_record;
+
+// pin of each action bit for each player
+const int player_pins[2][ACTION_COUNT] = {
+    {GPIO_P1_L, GPIO_P1_R, GPIO_P1_1, GPIO_P1_2},
+    {GPIO_P2_L, GPIO_P2_R, GPIO_P2_1, GPIO_P2_2},
+};
+
+// screen-space rectangle, x/y is the top left corner
 typedef struct {
   int x;
-  int hitting;
-  int hp;
-  int hp_dirty;
-  int state;
-  int cooldown_ms;
-} Player;
-
-Player p1;
-Player p2;
-
-void start_game() {
-  p1.x = WINDOW_WIDTH / 4 - PLAYER_WIDTH / 2;
-  p1.hitting = 0;
-  p1.hp = MAX_HP;
-  p1.hp_dirty = 1;
-  p1.state = ON_NORMAL_CD;
-  p1.cooldown_ms = 0;
-
-  p2.x = 3 * WINDOW_WIDTH / 4 - PLAYER_WIDTH / 2;
-  p2.hitting = 0;
-  p2.hp = MAX_HP;
-  p2.hp_dirty = 1;
-  p2.state = ON_NORMAL_CD;
-  p2.cooldown_ms = 0;
+  int y;
+  int w;
+  int h;
+} Rect;
+
+// set of non-overlapping rectangles
+typedef struct {
+  Rect rects[MAX_DIRTY_RECTS];
+  int count;
+} RectList;
+
+// copy of the game state handed from the simulation to the render thread
+typedef struct {
+  GameState state;
+  // CLOCK_MONOTONIC time the snapshot was published
+  uint64_t published_ns;
+} GameSnapshot;
+
+typedef struct {
+  // time between the snapshot being published and the frame starting
+  uint64_t snapshot_age_ns;
+  // time spent drawing into the buffer
+  uint64_t raster_ns;
+  // time spent in screen_post_window
+  uint64_t post_ns;
+} FrameTimings;
+
+typedef struct {
+  screen_window_t window;
+  screen_buffer_t buffers[RENDER_BUFFERS];
+  int *pointers[RENDER_BUFFERS];
+  int strides[RENDER_BUFFERS];
+  // bounds of everything drawn the last time each buffer was rendered, the
+  // buffer outside of it is known to be background
+  RectList drawn_bounds[RENDER_BUFFERS];
+  // a buffer's contents are undefined until it is fully painted once
+  int full_repaint[RENDER_BUFFERS];
+  // buffer the next frame is rendered into
+  int next;
+} SwapChain;
+
+pthread_mutex_t snapshot_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t snapshot_cond = PTHREAD_COND_INITIALIZER;
+// latest published state, only the newest one is ever rendered
+GameSnapshot snapshot;
+unsigned long snapshot_seq = 0;
+unsigned long snapshot_rendered_seq = 0;
+
+typedef struct {
+  unsigned long ticks;
+  // ticks that started more than a full period late
+  unsigned long late_ticks;
+  // wakeups that had to run more than one tick
+  unsigned long catchup_batches;
+  // ticks skipped because the backlog exceeded MAX_CATCHUP_TICKS
+  unsigned long dropped_ticks;
+  uint64_t max_jitter_ns;
+  unsigned long jitter[JITTER_BUCKETS];
+} ClockStats;
+
+ClockStats clock_stats;
+
+// polled from GPLEV0/1 unless the resource manager reports edges
+Input buttons;
+// cleared by SIGINT/SIGTERM to leave the simulation loop
+volatile sig_atomic_t running = 1;
+
+// timings of the last frame posted
+FrameTimings frame_timings;
+// pixels written to the buffer during the current frame
+unsigned long pixels_written = 0;
+
+uint64_t now_ns() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+Rect rect_clip(Rect r) {
+  if (r.x < 0) {
+    r.w += r.x;
+    r.x = 0;
+  }
+  if (r.y < 0) {
+    r.h += r.y;
+    r.y = 0;
+  }
+  if (r.x + r.w > WINDOW_WIDTH)
+    r.w = WINDOW_WIDTH - r.x;
+  if (r.y + r.h > WINDOW_HEIGHT)
+    r.h = WINDOW_HEIGHT - r.y;
+  if (r.w < 0)
+    r.w = 0;
+  if (r.h < 0)
+    r.h = 0;
+  return r;
+}
+
+int rect_overlaps(Rect a, Rect b) {
+  return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h &&
+         b.y < a.y + a.h;
+}
+
+Rect rect_union(Rect a, Rect b) {
+  Rect r;
+  r.x = a.x < b.x ? a.x : b.x;
+  r.y = a.y < b.y ? a.y : b.y;
+  r.w = (a.x + a.w > b.x + b.w ? a.x + a.w : b.x + b.w) - r.x;
+  r.h = (a.y + a.h > b.y + b.h ? a.y + a.h : b.y + b.h) - r.y;
+  return r;
+}
+
+// adds a rectangle to the list, merging it with every rectangle it overlaps so
+// that no pixel is covered twice
+void rect_list_add(RectList *list, Rect r) {
+  r = rect_clip(r);
+  if (r.w == 0 || r.h == 0)
+    return;
+
+  int i = 0;
+  while (i < list->count) {
+    if (rect_overlaps(list->rects[i], r)) {
+      r = rect_union(list->rects[i], r);
+      list->rects[i] = list->rects[--list->count];
+      // the grown rectangle may now overlap one we already checked
+      i = 0;
+      continue;
+    }
+    i++;
+  }
+
+  if (list->count == MAX_DIRTY_RECTS) {
+    // out of slots, fold the last one in and try again
+    list->count--;
+    return rect_list_add(list, rect_union(list->rects[list->count], r));
+  }
+
+  list->rects[list->count++] = r;
+}
+
+void fill_rect(int *buffer, int stride, Rect r, int color) {
+  r = rect_clip(r);
+  int stride_px = stride / 4;
+  fb_fill_rect((uint32_t *)buffer + stride_px * r.y + r.x, stride_px, r.w, r.h,
+               color);
+  pixels_written += r.w * r.h;
+}
+
+Rect player_rect(Player *p) {
+  Rect r = {p->x, WINDOW_HEIGHT - PLAYER_HEIGHT, PLAYER_WIDTH, PLAYER_HEIGHT};
+  return r;
 }
 
 void draw_player(Player *p, int *buffer, int stride) {
@@ -153,14 +310,7 @@ void draw_player(Player *p, int *buffer, int stride) {
   }
   }
 
-  int *lbuffer = buffer;
-  int player_head = PLAYER_HEIGHT;
-  lbuffer += (stride / 4) * (WINDOW_HEIGHT - player_head);
-  for (int i = player_head; i > 0; i--, lbuffer += (stride / 4)) {
-    for (int j = p->x; j < p->x + PLAYER_WIDTH; j++) {
-      lbuffer[j] = color;
-    }
-  }
+  fill_rect(buffer, stride, player_rect(p), color);
 }
 
 int point_distance_squared(int x1, int y1, int x2, int y2) {
@@ -189,55 +339,96 @@ int in_range(int a, int b, int range) {
   return 0;
 }
 
-void draw_circle(int *buffer, int stride, int radius, int x, int y) {
-  int radius_error = 200;
-  int *lbuffer = buffer;
-  int rr = radius * radius;
-  for (int i = 0; i < WINDOW_HEIGHT; ++i, lbuffer += (stride / 4)) {
-    for (int j = 0; j < WINDOW_WIDTH; j++) {
-      if (in_range(point_distance_squared(x, y, j, i), rr, radius_error) == 1) {
-        lbuffer[j] = CIRCLE_COLOR;
-      }
-    }
-  }
+// largest n such that n * n <= v, or -1 if v is negative
+int isqrt(int v) {
+  if (v < 0)
+    return -1;
+  int n = (int)sqrt((double)v);
+  while (n * n > v)
+    n--;
+  while ((n + 1) * (n + 1) <= v)
+    n++;
+  return n;
 }
 
-void render_hit_radius(int *buffer, int stride, Player *p) {
-  int y = WINDOW_HEIGHT - (PLAYER_HEIGHT / 2);
-  int x = p->x + PLAYER_WIDTH / 2;
-
-  draw_circle(buffer, stride, ATTACK_RADIUS, x, y);
+void fill_span(int *lbuffer, int x1, int x2, int color) {
+  if (x1 < 0)
+    x1 = 0;
+  if (x2 >= WINDOW_WIDTH)
+    x2 = WINDOW_WIDTH - 1;
+  if (x2 < x1)
+    return;
+  fb_fill_span((uint32_t *)lbuffer + x1, x2 - x1 + 1, color);
+  pixels_written += x2 - x1 + 1;
 }
 
-void clear_screen(int *buffer, int stride) {
-  int *lbuffer = buffer;
-  for (int i = 0; i < WINDOW_HEIGHT; ++i, lbuffer += (stride / 4)) {
-    for (int j = 0; j < WINDOW_WIDTH; j++) {
-      lbuffer[j] = 0xFF000000;
+// fills every pixel whose squared distance to (x, y) is within
+// [inner_sq, outer_sq], one or two horizontal spans per scanline
+void draw_annulus_sq(int *buffer, int stride, int x, int y, int inner_sq,
+                     int outer_sq, int color) {
+  int r = isqrt(outer_sq);
+  if (r < 0)
+    return;
+
+  int y1 = y - r < 0 ? 0 : y - r;
+  int y2 = y + r >= WINDOW_HEIGHT ? WINDOW_HEIGHT - 1 : y + r;
+  int *lbuffer = buffer + (stride / 4) * y1;
+  for (int i = y1; i <= y2; ++i, lbuffer += (stride / 4)) {
+    int dy2 = (i - y) * (i - y);
+    int outer = isqrt(outer_sq - dy2);
+    // the hole is every dx with dx * dx < inner_sq - dy2
+    int inner = isqrt(inner_sq - dy2 - 1);
+    if (outer < 0)
+      continue;
+    if (inner < 0) {
+      fill_span(lbuffer, x - outer, x + outer, color);
+    } else if (inner < outer) {
+      fill_span(lbuffer, x - outer, x - inner - 1, color);
+      fill_span(lbuffer, x + inner + 1, x + outer, color);
     }
   }
 }
 
-int move_player_left(Player *p) {
-  if (p->x <= MOVEMENT_SPEED) {
-    p->x = MOVEMENT_SPEED;
-    return 0;
-  }
+// ring of the given width centered on radius
+void draw_ring(int *buffer, int stride, int x, int y, int radius, int width,
+               int color) {
+  int inner = radius - width / 2;
+  int outer = inner + width;
+  if (inner < 0)
+    inner = 0;
+  draw_annulus_sq(buffer, stride, x, y, inner * inner, outer * outer, color);
+}
 
-  p->x -= MOVEMENT_SPEED;
+void draw_disc(int *buffer, int stride, int x, int y, int radius, int color) {
+  draw_annulus_sq(buffer, stride, x, y, 0, radius * radius, color);
+}
 
-  return 1;
+void draw_circle(int *buffer, int stride, int radius, int x, int y) {
+  int rr = radius * radius;
+  draw_annulus_sq(buffer, stride, x, y, rr - RING_RADIUS_ERROR,
+                  rr + RING_RADIUS_ERROR, CIRCLE_COLOR);
 }
 
-int move_player_right(Player *p) {
-  if (p->x >= WINDOW_WIDTH - (PLAYER_WIDTH + MOVEMENT_SPEED)) {
-    p->x = WINDOW_WIDTH - (PLAYER_WIDTH + MOVEMENT_SPEED);
-    return 0;
-  }
+// bounding box of the ring drawn by render_hit_radius
+Rect hit_radius_rect(Player *p) {
+  int y = WINDOW_HEIGHT - (PLAYER_HEIGHT / 2);
+  int x = p->x + PLAYER_WIDTH / 2;
+  int r = isqrt(ATTACK_RADIUS * ATTACK_RADIUS + RING_RADIUS_ERROR);
+  Rect rect = {x - r, y - r, 2 * r + 1, 2 * r + 1};
+  return rect;
+}
 
-  p->x += MOVEMENT_SPEED;
+void render_hit_radius(int *buffer, int stride, Player *p) {
+  int y = WINDOW_HEIGHT - (PLAYER_HEIGHT / 2);
+  int x = p->x + PLAYER_WIDTH / 2;
 
-  return 1;
+  draw_circle(buffer, stride, ATTACK_RADIUS, x, y);
+}
+
+void clear_screen(int *buffer, int stride, RectList *dirty) {
+  for (int i = 0; i < dirty->count; i++) {
+    fill_rect(buffer, stride, dirty->rects[i], BACKGROUND_COLOR);
+  }
 }
 
 // this name is hard-coded in 'rpi_gpio.h'
@@ -261,242 +452,856 @@ void setup_gpios() {
   rpi_gpio_set_select(GPIO_P2_2, RPI_GPIO_FUNC_IN);
 }
 
-int is_in_swing_range(Player *attacker, Player *defender) {
-  int distance = 0;
-  // if attacker is on the right of defender
-  if (attacker->x >= defender->x) {
-    int d = attacker->x - defender->x;
-    // avoid negatives if they're in one-another
-    if (d < PLAYER_WIDTH / 2)
-      return 1;
-    distance = d - PLAYER_WIDTH / 2;
-  } else {
-    int d = defender->x - attacker->x;
-    if (d < PLAYER_WIDTH / 2)
-      return 1;
-    distance = d - PLAYER_WIDTH / 2;
+// the 'msg' node of the resource manager, read for queued edge records
+int input_fd = -1;
+
+// receives the resource manager's doorbell pulses and drains the queued edge
+// records, each stamped by the IST when it serviced the interrupt. Gaps in the
+// sequence numbers are records the resource manager dropped.
+void *input_thread(void *args) {
+  int chid = (int)(intptr_t)args;
+  uint64_t cycles_per_sec = SYSPAGE_ENTRY(qtime)->cycles_per_sec;
+  uint32_t next_seq = 0;
+
+  while (1) {
+    struct _pulse pulse;
+    if (MsgReceivePulse(chid, &pulse, sizeof(pulse), NULL) == -1) {
+      perror("MsgReceivePulse");
+      continue;
+    }
+
+    if (pulse.code != _PULSE_CODE_MINAVAIL)
+      continue;
+
+    // read until empty, the next pulse only comes once a record lands in an
+    // empty queue
+    rpi_gpio_event_record_t records[32];
+    ssize_t n;
+    while ((n = read(input_fd, records, sizeof(records))) > 0) {
+      // ClockCycles() doesn't count from the same origin as CLOCK_MONOTONIC,
+      // so place each edge by its age
+      uint64_t now = now_ns();
+      uint64_t cycles = ClockCycles();
+      for (unsigned i = 0; i < n / sizeof(records[0]); i++) {
+        rpi_gpio_event_record_t *r = &records[i];
+        uint64_t age_ns = (uint64_t)((unsigned __int128)(cycles - r->cycles) *
+                                     1000000000 / cycles_per_sec);
+        buttons.stats.dropped += r->seq - next_seq;
+        next_seq = r->seq + 1;
+        input_inject_edge(&buttons, r->gpio, r->level, now - age_ns);
+      }
+    }
   }
 
-  if (distance < ATTACK_RADIUS)
-    return 1;
-  return 0;
+  return NULL;
 }
 
-void hitreg_player(Player *attacker, Player *defender) {
-  if (attacker->cooldown_ms != 0)
-    return;
+// levels of all pins, GPLEV1 follows GPLEV0
+uint64_t read_levels() {
+  return rpi_gpio_regs[RPI_GPIO_REG_GPLEV0] |
+         (uint64_t)rpi_gpio_regs[RPI_GPIO_REG_GPLEV0 + 1] << 32;
+}
 
-  attacker->hitting = 1;
-  attacker->cooldown_ms = ATTACK_CD;
-  attacker->state = ON_ATTACK_CD;
+// undoes a failed input_init, closing fd removes the pins registered on it
+void input_release(int fd, int chid, int coid) {
+  if (coid != -1)
+    ConnectDetach(coid);
+  ChannelDestroy(chid);
+  close(fd);
+}
 
-  if (is_in_swing_range(attacker, defender) == 0) {
-    return;
+// registers for edge events on every button through the rpi_gpio resource
+// manager, returns 0 if it isn't available so inputs are polled instead
+int input_init() {
+  static const unsigned pins[] = {GPIO_P1_L, GPIO_P1_R, GPIO_P1_1, GPIO_P1_2,
+                                  GPIO_P2_L, GPIO_P2_R, GPIO_P2_1, GPIO_P2_2};
+
+  int fd = open("/dev/gpio/msg", O_RDWR);
+  if (fd == -1) {
+    perror("open(\"/dev/gpio/msg\"), polling inputs instead");
+    return 0;
   }
 
-  if (defender->state == ON_PARRY_CD) {
-    attacker->state = ON_ATTACK_CD;
-    attacker->cooldown_ms = PARRY_COUNTER_CD;
-    return;
+  int chid = ChannelCreate(_NTO_CHF_PRIVATE);
+  if (chid == -1) {
+    perror("ChannelCreate");
+    close(fd);
+    return 0;
   }
 
-  if (defender->state == ON_NORMAL_CD) {
-    defender->hp--;
-    if (defender->hp == 0) // dirty restart, might lose some input data but it
-                           // doens't really matter
-      return start_game();
-    defender->hp_dirty = 1;
-    defender->state = ON_HIT_CD;
-    defender->cooldown_ms = HIT_CD;
-    return;
+  int coid = ConnectAttach(0, 0, chid, _NTO_SIDE_CHANNEL, 0);
+  if (coid == -1) {
+    perror("ConnectAttach");
+    input_release(fd, chid, -1);
+    return 0;
+  }
+
+  struct sigevent event;
+  SIGEV_PULSE_INIT(&event, coid, -1, _PULSE_CODE_MINAVAIL, 0);
+  SIGEV_MAKE_UPDATEABLE(&event);
+  if (MsgRegisterEvent(&event, fd) == -1) {
+    perror("MsgRegisterEvent");
+    input_release(fd, chid, coid);
+    return 0;
+  }
+
+  // every pin is registered before the thread draining the queue starts
+  for (unsigned i = 0; i < sizeof(pins) / sizeof(pins[0]); i++) {
+    rpi_gpio_event_t msg = {
+        .hdr.type = _IO_MSG,
+        .hdr.mgrid = RPI_GPIO_IOMGR,
+        .hdr.subtype = RPI_GPIO_ADD_EVENT,
+        .gpio = pins[i],
+        .detect = RPI_EVENT_EDGE_RISING | RPI_EVENT_EDGE_FALLING |
+                  RPI_EVENT_QUEUE,
+        .event = event,
+    };
+    if (MsgSend(fd, &msg, sizeof(msg), NULL, 0) == -1) {
+      perror("MsgSend(RPI_GPIO_ADD_EVENT)");
+      input_release(fd, chid, coid);
+      return 0;
+    }
   }
 
-  if (defender->state == ON_ATTACK_CD) {
-    defender->hp--;
-    if (defender->hp == 0) // dirty restart, might lose some input data but it
-                           // doens't really matter
-      return start_game();
-    defender->hp_dirty = 1;
-    if (defender->cooldown_ms <= HIT_CD)
-      defender->cooldown_ms = HIT_CD;
-    defender->state = ON_HIT_CD;
+  // levels before the first edge is consumed, edges already queued by the
+  // resource manager only repeat them
+  input_use_events(&buttons, read_levels());
+  input_fd = fd;
+
+  pthread_t thr_input;
+  if (pthread_create(&thr_input, NULL, input_thread, (void *)(intptr_t)chid) !=
+      0) {
+    perror("pthread_create");
+    input_fd = -1;
+    input_reset(&buttons, player_pins);
+    input_release(fd, chid, coid);
+    return 0;
+  }
+
+  return 1;
+}
+
+// collects the button state for the next tick, from one read of GPLEV0/1 when
+// the pins are polled
+void read_inputs(InputState *in) {
+  input_poll(&buttons, buttons.events ? 0 : read_levels(), now_ns(), in);
+}
+
+#if defined(ENABLE_LED)
+void dump_led_stats(const char *name, ws2811_t *strip) {
+  ws2811_stats_t stats;
+  ws2811_wait(strip);
+  ws2811_get_stats(strip, &stats);
+  printf("%s: %llu frames queued, %llu coalesced, %llu sent\n", name,
+         (unsigned long long)stats.queued, (unsigned long long)stats.coalesced,
+         (unsigned long long)stats.completed);
+}
+#endif
+
+void dump_input_stats() {
+  if (buttons.events == 0) {
+    printf("input: polled\n");
     return;
   }
+  printf("input: %lu edges, %lu dropped, %lu bounced, max press to tick "
+         "latency %llu us\n",
+         buttons.stats.edges, buttons.stats.dropped, buttons.stats.bounced,
+         (unsigned long long)(buttons.stats.max_latency_ns / 1000));
+
+  // time the resource manager's IST took per interrupt, for all its clients
+  rpi_gpio_ist_stats_t ist = {
+      .hdr.type = _IO_MSG,
+      .hdr.mgrid = RPI_GPIO_IOMGR,
+      .hdr.subtype = RPI_GPIO_IST_STATS,
+  };
+  if (MsgSend(input_fd, &ist, sizeof(ist), &ist, sizeof(ist)) == -1) {
+    perror("MsgSend(RPI_GPIO_IST_STATS)");
+    return;
+  }
+  printf("input: %llu interrupts, ist min %llu avg %llu p99 %llu max %llu ns\n",
+         (unsigned long long)ist.interrupts, (unsigned long long)ist.min_ns,
+         (unsigned long long)ist.avg_ns, (unsigned long long)ist.p99_ns,
+         (unsigned long long)ist.max_ns);
+}
+
+// square k of a player's hp bar, p1 fills from the left edge and p2 from the
+// right edge
+Rect hp_square_rect(int right, int k) {
+  Rect r = {HP_GAP_SIZE + k * (HP_SQUARE_SIZE + HP_GAP_SIZE), 0, HP_SQUARE_SIZE,
+            HP_SQUARE_SIZE};
+  if (right)
+    r.x = WINDOW_WIDTH - r.x - HP_SQUARE_SIZE;
+  return r;
 }
 
-void handle_inputs() {
-  if (rpi_gpio_read(GPIO_P1_L))
-    move_player_left(&p1);
-  if (rpi_gpio_read(GPIO_P1_R))
-    move_player_right(&p1);
-  if (rpi_gpio_read(GPIO_P2_L))
-    move_player_left(&p2);
-  if (rpi_gpio_read(GPIO_P2_R))
-    move_player_right(&p2);
+void render_hp_bars(int *buffer, int stride, GameSnapshot *s) {
+  for (int k = 0; k < s->state.players[0].hp; k++)
+    fill_rect(buffer, stride, hp_square_rect(0, k), HP_COLOR);
+  for (int k = 0; k < s->state.players[1].hp; k++)
+    fill_rect(buffer, stride, hp_square_rect(1, k), HP_COLOR);
+}
 
-  if (p1.cooldown_ms == 0) {
-    if (rpi_gpio_read(GPIO_P1_2)) {
-      p1.cooldown_ms = PARRY_CD;
-      p1.state = ON_PARRY_CD;
-    }
+// collects the bounds of everything the frame is going to draw
+void frame_bounds(GameSnapshot *s, RectList *bounds) {
+  bounds->count = 0;
+  if (s->state.players[0].hitting == 1)
+    rect_list_add(bounds, hit_radius_rect(&s->state.players[0]));
+  if (s->state.players[1].hitting == 1)
+    rect_list_add(bounds, hit_radius_rect(&s->state.players[1]));
+
+  rect_list_add(bounds, player_rect(&s->state.players[0]));
+  rect_list_add(bounds, player_rect(&s->state.players[1]));
+
+  for (int k = 0; k < s->state.players[0].hp; k++)
+    rect_list_add(bounds, hp_square_rect(0, k));
+  for (int k = 0; k < s->state.players[1].hp; k++)
+    rect_list_add(bounds, hp_square_rect(1, k));
+}
 
-    if (rpi_gpio_read(GPIO_P1_1) == 1) {
-      hitreg_player(&p1, &p2);
-    }
+void render(SwapChain *chain, GameSnapshot *s) {
+  int idx = chain->next;
+  int *ptr = chain->pointers[idx];
+  int stride = chain->strides[idx];
+  uint64_t start = now_ns();
+
+  // only repaint what was drawn the last time this buffer was used or will be
+  // drawn this frame, everything else is already background
+  RectList bounds;
+  frame_bounds(s, &bounds);
+
+  RectList dirty = chain->drawn_bounds[idx];
+  for (int i = 0; i < bounds.count; i++) {
+    rect_list_add(&dirty, bounds.rects[i]);
   }
-  if (p2.cooldown_ms == 0) {
-    if (rpi_gpio_read(GPIO_P2_2)) {
-      p2.cooldown_ms = PARRY_CD;
-      p2.state = ON_PARRY_CD;
-    }
+  if (chain->full_repaint[idx] == 1) {
+    Rect screen = {0, 0, WINDOW_WIDTH, WINDOW_HEIGHT};
+    dirty.count = 0;
+    rect_list_add(&dirty, screen);
+    chain->full_repaint[idx] = 0;
+  }
+  chain->drawn_bounds[idx] = bounds;
 
-    if (rpi_gpio_read(GPIO_P2_1) == 1) {
-      hitreg_player(&p2, &p1);
-    }
+  pixels_written = 0;
+  clear_screen(ptr, stride, &dirty);
+
+  if (s->state.players[0].hitting == 1)
+    render_hit_radius(ptr, stride, &s->state.players[0]);
+  if (s->state.players[1].hitting == 1)
+    render_hit_radius(ptr, stride, &s->state.players[1]);
+
+  draw_player(&s->state.players[0], ptr, stride);
+  draw_player(&s->state.players[1], ptr, stride);
+
+  render_hp_bars(ptr, stride, s);
+
+  uint64_t rastered = now_ns();
+
+  // x, y, w, h for every dirty rectangle
+  int dirty_rects[MAX_DIRTY_RECTS * 4];
+  for (int i = 0; i < dirty.count; i++) {
+    dirty_rects[i * 4 + 0] = dirty.rects[i].x;
+    dirty_rects[i * 4 + 1] = dirty.rects[i].y;
+    dirty_rects[i * 4 + 2] = dirty.rects[i].w;
+    dirty_rects[i * 4 + 3] = dirty.rects[i].h;
   }
+
+  // wait for the post to be consumed so the buffer we cycle back to is no
+  // longer on screen
+  int err = screen_post_window(chain->window, chain->buffers[idx], dirty.count,
+                               dirty_rects, SCREEN_WAIT_IDLE);
+  if (err != 0) {
+    printf("Failed to post window\n");
+  }
+  chain->next = (idx + 1) % RENDER_BUFFERS;
+
+  frame_timings.snapshot_age_ns = start - s->published_ns;
+  frame_timings.raster_ns = rastered - start;
+  frame_timings.post_ns = now_ns() - rastered;
+
+#if defined(RENDER_STATS)
+  static unsigned long frames = 0;
+  static unsigned long total_pixels = 0;
+  static FrameTimings total;
+  static FrameTimings worst;
+  total_pixels += pixels_written;
+  total.snapshot_age_ns += frame_timings.snapshot_age_ns;
+  total.raster_ns += frame_timings.raster_ns;
+  total.post_ns += frame_timings.post_ns;
+  if (frame_timings.snapshot_age_ns > worst.snapshot_age_ns)
+    worst.snapshot_age_ns = frame_timings.snapshot_age_ns;
+  if (frame_timings.raster_ns > worst.raster_ns)
+    worst.raster_ns = frame_timings.raster_ns;
+  if (frame_timings.post_ns > worst.post_ns)
+    worst.post_ns = frame_timings.post_ns;
+  if (++frames == RENDER_STATS_FRAMES) {
+    printf("render: %lu pixels written per frame (full frame is %d)\n",
+           total_pixels / frames, WINDOW_WIDTH * WINDOW_HEIGHT);
+    printf("render: avg/max us snapshot age %llu/%llu raster %llu/%llu post "
+           "%llu/%llu\n",
+           (unsigned long long)(total.snapshot_age_ns / frames / 1000),
+           (unsigned long long)(worst.snapshot_age_ns / 1000),
+           (unsigned long long)(total.raster_ns / frames / 1000),
+           (unsigned long long)(worst.raster_ns / 1000),
+           (unsigned long long)(total.post_ns / frames / 1000),
+           (unsigned long long)(worst.post_ns / 1000));
+    frames = 0;
+    total_pixels = 0;
+    memset(&total, 0, sizeof(total));
+    memset(&worst, 0, sizeof(worst));
+  }
+#endif
 }
 
-void render_hp_bars(int *buffer, int stride) {
-  int *lbuffer = buffer;
+// hands the current state to the render thread, replacing any snapshot it has
+// not picked up yet
+void publish_snapshot() {
+  pthread_mutex_lock(&snapshot_mutex);
+  // a hit ring in a skipped snapshot still has to be shown once
+  int hitting[2];
+  for (int i = 0; i < 2; i++) {
+    hitting[i] = game.players[i].hitting;
+    if (snapshot_seq != snapshot_rendered_seq)
+      hitting[i] |= snapshot.state.players[i].hitting;
+  }
+  snapshot.state = game;
+  for (int i = 0; i < 2; i++)
+    snapshot.state.players[i].hitting = hitting[i];
+  snapshot.published_ns = now_ns();
+  snapshot_seq++;
+  pthread_cond_signal(&snapshot_cond);
+  pthread_mutex_unlock(&snapshot_mutex);
+
+  // the ring is drawn for a single frame
+  game.players[0].hitting = 0;
+  game.players[1].hitting = 0;
+}
 
-  for (int i = 0; i < HP_SQUARE_SIZE; ++i, lbuffer += (stride / 4)) {
-    // render p1 hp from left to right
-    int gap = 1;
-    int cum = 0;
-    int p1hp = p1.hp;
-    for (int j = 0; j < WINDOW_WIDTH / 2; j++) {
-      if (p1hp == 0)
-        continue;
-      cum += 1;
-
-      if (gap == 1) {
-        if (cum == HP_GAP_SIZE) {
-          gap = 0;
-          cum = 0;
-        }
-        continue;
-      }
+void *render_thread(void *args) {
+  SwapChain *chain = args;
+  GameSnapshot s;
+
+  while (1) {
+    pthread_mutex_lock(&snapshot_mutex);
+    while (snapshot_seq == snapshot_rendered_seq)
+      pthread_cond_wait(&snapshot_cond, &snapshot_mutex);
+    s = snapshot;
+    snapshot_rendered_seq = snapshot_seq;
+    pthread_mutex_unlock(&snapshot_mutex);
+
+    render(chain, &s);
+  }
+
+  return NULL;
+}
 
-      if (cum == HP_SQUARE_SIZE) {
-        gap = 1;
-        p1hp -= 1;
-        cum = 0;
+// lights a strip's first hp leds and queues the frame, the strips are async so
+// this never waits for SPI
+void render_hp_strip(ws2811_t *strip, int hp) {
+  for (int i = 0; i < 5; i++)
+    strip->channel[0].leds[i] = i < hp ? 0x00FF0000 : 0x00000000;
+
+  ws2811_return_t ret = ws2811_render(strip);
+  if (ret != WS2811_SUCCESS)
+    fprintf(stderr, "ws2811_render: %s\n", ws2811_get_return_t_str(ret));
+}
+
+// follows the hp of the latest published snapshot, the live game state
+// belongs to the simulation thread
+void *render_lights(void *args) {
+  ws2811_t *strips[2] = {&p1hpstrip, &p2hpstrip};
+  int shown[2] = {-1, -1};
+
+  while (1) {
+    int hp[2];
+    pthread_mutex_lock(&snapshot_mutex);
+    for (int i = 0; i < 2; i++)
+      hp[i] = snapshot.state.players[i].hp;
+    pthread_mutex_unlock(&snapshot_mutex);
+
+    for (int i = 0; i < 2; i++) {
+      if (hp[i] != shown[i]) {
+        render_hp_strip(strips[i], hp[i]);
+        shown[i] = hp[i];
       }
-      lbuffer[j] = HP_COLOR;
     }
 
-    // render p2 hp from left to right
-    gap = 1;
-    cum = 0;
-    int p2hp = p2.hp;
-    for (int j = WINDOW_WIDTH; j >= WINDOW_WIDTH / 2; j--) {
-      if (p2hp == 0)
-        continue;
-      cum += 1;
-
-      if (gap == 1) {
-        if (cum == HP_GAP_SIZE) {
-          gap = 0;
-          cum = 0;
-        }
-        continue;
+    delay(50);
+  }
+}
+
+#if defined(RENDER_BENCH)
+// the original full-screen scan, kept to compare against draw_circle
+void draw_circle_scan(int *buffer, int stride, int radius, int x, int y) {
+  int *lbuffer = buffer;
+  int rr = radius * radius;
+  for (int i = 0; i < WINDOW_HEIGHT; ++i, lbuffer += (stride / 4)) {
+    for (int j = 0; j < WINDOW_WIDTH; j++) {
+      if (in_range(point_distance_squared(x, y, j, i), rr,
+                   RING_RADIUS_ERROR) == 1) {
+        lbuffer[j] = CIRCLE_COLOR;
       }
+    }
+  }
+}
+
+// ns per ring for the scan and span paths at 1x, 2x and 4x ATTACK_RADIUS,
+// centered where render_hit_radius draws for p1
+void bench_rings() {
+  int stride = WINDOW_WIDTH * 4;
+  int *buffer = malloc(WINDOW_WIDTH * WINDOW_HEIGHT * 4);
+  if (buffer == NULL)
+    perror("malloc"), exit(EXIT_FAILURE);
+  memset(buffer, 0, WINDOW_WIDTH * WINDOW_HEIGHT * 4);
+
+  int x = WINDOW_WIDTH / 4;
+  int y = WINDOW_HEIGHT - (PLAYER_HEIGHT / 2);
+  int iterations = 200;
+  for (int scale = 1; scale <= 4; scale *= 2) {
+    int radius = ATTACK_RADIUS * scale;
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < iterations; i++)
+      draw_circle_scan(buffer, stride, radius, x, y);
+    uint64_t scan_ns = (now_ns() - start) / iterations;
+
+    start = now_ns();
+    for (int i = 0; i < iterations; i++)
+      draw_circle(buffer, stride, radius, x, y);
+    uint64_t span_ns = (now_ns() - start) / iterations;
+
+    printf("ring radius %d: scan %llu ns/ring, span %llu ns/ring\n", radius,
+           (unsigned long long)scan_ns, (unsigned long long)span_ns);
+  }
 
-      if (cum == HP_SQUARE_SIZE) {
-        gap = 1;
-        p2hp -= 1;
-        cum = 0;
+  free(buffer);
+}
+
+// throughput of each framebuffer kernel for a span, a full row, a player
+// sized rectangle and the whole screen
+void bench_kernels() {
+  static const struct {
+    const char *name;
+    int w;
+    int h;
+  } sizes[] = {
+      {"span", 64, 1},
+      {"row", WINDOW_WIDTH, 1},
+      {"player", PLAYER_WIDTH, PLAYER_HEIGHT},
+      {"screen", WINDOW_WIDTH, WINDOW_HEIGHT},
+  };
+  int stride_px = WINDOW_WIDTH;
+  uint32_t *dst = malloc(WINDOW_WIDTH * WINDOW_HEIGHT * 4);
+  uint32_t *src = malloc(WINDOW_WIDTH * WINDOW_HEIGHT * 4);
+  if (dst == NULL || src == NULL)
+    perror("malloc"), exit(EXIT_FAILURE);
+  for (int i = 0; i < WINDOW_WIDTH * WINDOW_HEIGHT; i++) {
+    src[i] = (i & 7) == 0 ? BACKGROUND_COLOR : NORMAL_COLOR;
+    dst[i] = 0;
+  }
+
+  printf("kernels: %s\n", fb_kernels_name());
+  for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    int w = sizes[s].w;
+    int h = sizes[s].h;
+    // roughly 256MB written per kernel
+    int iterations = (256 << 20) / (w * h * 4);
+    double bytes = (double)iterations * w * h * 4;
+
+    for (int k = 0; k < 4; k++) {
+      const char *kernel = "";
+      uint64_t start = now_ns();
+      for (int i = 0; i < iterations; i++) {
+        switch (k) {
+        case 0:
+          kernel = "fill_rect";
+          fb_fill_rect(dst, stride_px, w, h, NORMAL_COLOR);
+          break;
+        case 1:
+          kernel = "fill_span";
+          for (int row = 0; row < h; row++)
+            fb_fill_span(dst + row * stride_px, w, NORMAL_COLOR);
+          break;
+        case 2:
+          kernel = "copy_row";
+          for (int row = 0; row < h; row++)
+            fb_copy_row(dst + row * stride_px, src + row * stride_px, w);
+          break;
+        case 3:
+          kernel = "copy_row_key";
+          for (int row = 0; row < h; row++)
+            fb_copy_row_key(dst + row * stride_px, src + row * stride_px, w,
+                            BACKGROUND_COLOR);
+          break;
+        }
       }
-      lbuffer[j] = HP_COLOR;
+      uint64_t ns = now_ns() - start;
+      printf("%-12s %-6s %4dx%-3d %6.2f GB/s\n", kernel, sizes[s].name, w, h,
+             bytes / (double)ns);
     }
   }
+
+  free(dst);
+  free(src);
 }
 
-void render(screen_buffer_t *screen_buf, screen_window_t *screen_window) {
-  int *ptr = NULL;
-  int err = screen_get_buffer_property_pv(*screen_buf, SCREEN_PROPERTY_POINTER,
-                                          (void **)&ptr);
-  if (err != 0) {
-    printf("Failed to get buffer pointer\n");
+// the original byte-per-bit WS2811 encoder, kept to compare against
+// ws2811_encode
+void ws2811_encode_bytes(volatile uint8_t *dst, const uint8_t *colors,
+                         int count, int invert, uint8_t table[256][8]) {
+  for (int i = 0; i < count; i++) {
+    for (int l = 0; l < 8; ++l) {
+      uint8_t val = table[colors[i]][l];
+      if (invert)
+        val = ~val;
+      dst[i * 8 + l] = val;
+    }
   }
+}
 
-  int stride = 0;
-  err = screen_get_buffer_property_iv(*screen_buf, SCREEN_PROPERTY_STRIDE,
-                                      &stride);
-  if (err != 0) {
-    printf("Failed to get buffer stride\n");
+// LEDs encoded per second by both encoders for a strip of 6 (our hp bars),
+// 300 and 3000 RGB LEDs
+void bench_ws2811_encode() {
+  static const int strips[] = {6, 300, 3000};
+  static uint8_t table[256][8];
+  for (int c = 0; c < 256; c++) {
+    uint8_t color = c;
+    ws2811_encode(table[c], &color, 1, 0);
   }
 
-  // clear screen
-  memset(ptr, 0x00, WINDOW_HEIGHT * WINDOW_WIDTH * 4);
-  clear_screen(ptr, stride);
+  int max_bytes = 3000 * 3;
+  uint8_t *colors = malloc(max_bytes);
+  uint8_t *dst = malloc(max_bytes * 8);
+  if (colors == NULL || dst == NULL)
+    perror("malloc"), exit(EXIT_FAILURE);
+  for (int i = 0; i < max_bytes; i++)
+    colors[i] = i * 37;
+
+  for (unsigned s = 0; s < sizeof(strips) / sizeof(strips[0]); s++) {
+    int bytes = strips[s] * 3;
+    // roughly 30M LEDs per encoder
+    int iterations = 30000000 / strips[s];
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < iterations; i++)
+      ws2811_encode_bytes(dst, colors, bytes, i & 1, table);
+    uint64_t bytes_ns = now_ns() - start;
+
+    start = now_ns();
+    for (int i = 0; i < iterations; i++)
+      ws2811_encode(dst, colors, bytes, i & 1);
+    uint64_t words_ns = now_ns() - start;
+
+    printf("ws2811 %4d leds: byte loop %.1f M leds/s, ws2811_encode %.1f M "
+           "leds/s\n",
+           strips[s], (double)iterations * strips[s] * 1000 / bytes_ns,
+           (double)iterations * strips[s] * 1000 / words_ns);
+  }
 
-  if (p1.hitting == 1) {
-    render_hit_radius(ptr, stride, &p1);
+  free(colors);
+  free(dst);
+}
 
-    p1.hitting = 0;
+// ns per simulation tick over a long match with pseudo-random inputs, no
+// screen or GPIOs involved
+void bench_game_step() {
+  GameState states[2];
+  game_reset(&states[0]);
+  states[0].players[0].hp_dirty = 0;
+  unsigned seed = 1;
+  int ticks = 10000000;
+  unsigned long knockouts = 0;
+
+  uint64_t start = now_ns();
+  for (int i = 0; i < ticks; i++) {
+    seed = seed * 1103515245 + 12345;
+    unsigned actions[2] = {(seed >> 16) & 0xf, (seed >> 24) & 0xf};
+    game_step(&states[i & 1], actions, &states[~i & 1]);
+    knockouts += states[~i & 1].players[0].hp_dirty &
+                 (states[~i & 1].players[0].hp == MAX_HP);
+    states[~i & 1].players[0].hp_dirty = 0;
   }
-  if (p2.hitting == 1) {
-    render_hit_radius(ptr, stride, &p2);
-    p2.hitting = 0;
+  uint64_t ns = now_ns() - start;
+
+  uint64_t hash = GAME_HASH_INIT;
+  start = now_ns();
+  for (int i = 0; i < ticks; i++)
+    hash = game_hash(hash, &states[i & 1]);
+  uint64_t hash_ns = now_ns() - start;
+
+  printf("game_step: %.1f ns/tick, %lu knockouts in %d ticks\n",
+         (double)ns / ticks, knockouts, ticks);
+  printf("game_hash: %.1f ns/tick (%016llx)\n", (double)hash_ns / ticks,
+         (unsigned long long)hash);
+}
+
+// SPI0 CE1, nothing is wired to it so the bench only measures the driver
+#define BENCH_SPI_BUS 0
+#define BENCH_SPI_DEVICE 1
+#define BENCH_SPI_HZ 1000000
+
+// us per sequence of a configure and n 4-byte writes: one call each, one
+// batch segment each, and n segments joined under one chip select
+void bench_spi_batch() {
+  static const int segments[] = {1, 8, 64};
+  spi_devinfo_t info;
+  uint8_t data[RPI_SPI_BATCH_SEGMENTS][4] = {{0}};
+  rpi_spi_batch_t batch;
+  int iterations = 200;
+
+  if (rpi_spi_get_device_info(BENCH_SPI_BUS, BENCH_SPI_DEVICE, &info) !=
+      SPI_SUCCESS) {
+    printf("spi batch: no device %d on bus %d\n", BENCH_SPI_DEVICE,
+           BENCH_SPI_BUS);
+    return;
   }
 
-  draw_player(&p1, ptr, stride);
-  draw_player(&p2, ptr, stride);
+  for (unsigned s = 0; s < sizeof(segments) / sizeof(segments[0]); s++) {
+    int n = segments[s];
+    uint64_t ns[3];
 
-  render_hp_bars(ptr, stride);
+    uint64_t start = now_ns();
+    for (int i = 0; i < iterations; i++) {
+      rpi_spi_configure_device(BENCH_SPI_BUS, BENCH_SPI_DEVICE, info.cfg.mode,
+                               BENCH_SPI_HZ);
+      for (int k = 0; k < n; k++)
+        rpi_spi_write_read_data(BENCH_SPI_BUS, BENCH_SPI_DEVICE, data[k], 4);
+    }
+    ns[0] = now_ns() - start;
+
+    for (int joined = 0; joined < 2; joined++) {
+      rpi_spi_batch_init(&batch, BENCH_SPI_BUS);
+      rpi_spi_batch_configure(&batch, BENCH_SPI_DEVICE, info.cfg.mode,
+                              BENCH_SPI_HZ);
+      for (int k = 0; k < n; k++)
+        rpi_spi_batch_write(&batch, BENCH_SPI_DEVICE, 0, data[k], 4,
+                            joined ? RPI_SPI_SEGMENT_CS_HOLD : 0);
+
+      start = now_ns();
+      for (int i = 0; i < iterations; i++)
+        if (rpi_spi_batch_submit(&batch) != SPI_SUCCESS)
+          printf("spi batch: submit failed at segment %d\n", batch.completed);
+      ns[1 + joined] = now_ns() - start;
+    }
 
-  err = screen_post_window(*screen_window, *screen_buf, 0, NULL, 0);
-  if (err != 0) {
-    printf("Failed to post window\n");
+    printf("spi %2d segments: calls %.1f us, batch %.1f us, joined batch "
+           "%.1f us\n",
+           n, (double)ns[0] / iterations / 1000,
+           (double)ns[1] / iterations / 1000,
+           (double)ns[2] / iterations / 1000);
   }
+
+  rpi_spi_cleanup_device(BENCH_SPI_BUS, BENCH_SPI_DEVICE);
 }
 
-void *render_lights(void *args) {
-  while (1) {
-    if (p1.hp_dirty == 1) {
-      for (int i = 0; i < 5; i++) {
-        if (i < p1.hp) {
-          p1hpstrip.channel[0].leds[i] = 0x00FF0000;
-        } else {
-          p1hpstrip.channel[0].leds[i] = 0x00000000;
-        }
-      }
+// A resource manager started with
+// 'rpi_gpio -r -m /dev/gpio-standin -s /rpi_gpio_standin' runs against a
+// register block in memory, so the bench can program outputs
+#define BENCH_GPIO_MSG "/dev/gpio-standin/msg"
+
+// us to sample, write and read the function of the eight button pins: one
+// message per pin against one multi-pin message
+void bench_gpio_msgs() {
+  static const uint8_t pins[] = {GPIO_P1_L, GPIO_P1_R, GPIO_P1_1, GPIO_P1_2,
+                                 GPIO_P2_L, GPIO_P2_R, GPIO_P2_1, GPIO_P2_2};
+  const int n = sizeof(pins) / sizeof(pins[0]);
+  const int iterations = 10000;
+  uint64_t mask = 0;
+  uint64_t ns[3][2];
+
+  int fd = open(BENCH_GPIO_MSG, O_RDWR);
+  if (fd == -1) {
+    perror("gpio msgs: open(\"" BENCH_GPIO_MSG "\")");
+    return;
+  }
+
+  rpi_gpio_select_list_t list = {
+      .hdr.type = _IO_MSG,
+      .hdr.mgrid = RPI_GPIO_IOMGR,
+      .hdr.subtype = RPI_GPIO_SET_SELECT_LIST,
+      .count = n,
+  };
+  for (int k = 0; k < n; k++) {
+    list.list[k].gpio = pins[k];
+    list.list[k].value = RPI_GPIO_FUNC_OUT;
+    mask |= UINT64_C(1) << pins[k];
+  }
+  size_t list_size = RPI_GPIO_SELECT_LIST_SIZE(n);
+  if (MsgSend(fd, &list, list_size, &list, list_size) == -1) {
+    perror("gpio msgs: MsgSend(RPI_GPIO_SET_SELECT_LIST)");
+    close(fd);
+    return;
+  }
 
-      /*ws2811_render(&p1hpstrip);*/
-      p1.hp_dirty = 0;
+  rpi_gpio_msg_t msg = {.hdr.type = _IO_MSG, .hdr.mgrid = RPI_GPIO_IOMGR};
+  rpi_gpio_mask_t mmsg = {.hdr.type = _IO_MSG, .hdr.mgrid = RPI_GPIO_IOMGR};
+
+  // levels, written as outputs and read back as inputs
+  uint64_t start = now_ns();
+  for (int i = 0; i < iterations; i++)
+    for (int k = 0; k < n; k++) {
+      msg.hdr.subtype = RPI_GPIO_WRITE;
+      msg.gpio = pins[k];
+      msg.value = i & 1;
+      MsgSend(fd, &msg, sizeof(msg), NULL, 0);
     }
+  ns[0][0] = now_ns() - start;
+
+  start = now_ns();
+  for (int i = 0; i < iterations; i++) {
+    mmsg.hdr.subtype = RPI_GPIO_WRITE_MASK;
+    mmsg.set = i & 1 ? mask : 0;
+    mmsg.clear = i & 1 ? 0 : mask;
+    MsgSend(fd, &mmsg, sizeof(mmsg), NULL, 0);
+  }
+  ns[0][1] = now_ns() - start;
+
+  start = now_ns();
+  for (int i = 0; i < iterations; i++)
+    for (int k = 0; k < n; k++) {
+      msg.hdr.subtype = RPI_GPIO_GET_SELECT;
+      msg.gpio = pins[k];
+      MsgSend(fd, &msg, sizeof(msg), &msg, sizeof(msg));
+    }
+  ns[1][0] = now_ns() - start;
+
+  list.hdr.subtype = RPI_GPIO_GET_SELECT_LIST;
+  start = now_ns();
+  for (int i = 0; i < iterations; i++)
+    MsgSend(fd, &list, list_size, &list, list_size);
+  ns[1][1] = now_ns() - start;
+
+  for (int k = 0; k < n; k++)
+    list.list[k].value = RPI_GPIO_FUNC_IN;
+  list.hdr.subtype = RPI_GPIO_SET_SELECT_LIST;
+  MsgSend(fd, &list, list_size, &list, list_size);
+
+  start = now_ns();
+  for (int i = 0; i < iterations; i++)
+    for (int k = 0; k < n; k++) {
+      msg.hdr.subtype = RPI_GPIO_READ;
+      msg.gpio = pins[k];
+      MsgSend(fd, &msg, sizeof(msg), &msg, sizeof(msg));
+    }
+  ns[2][0] = now_ns() - start;
 
-    if (p2.hp_dirty == 1) {
-      for (int i = 0; i < 5; i++) {
-        if (i < p2.hp) {
-          p2hpstrip.channel[0].leds[i] = 0x00FF0000;
+  mmsg.hdr.subtype = RPI_GPIO_READ_ALL;
+  start = now_ns();
+  for (int i = 0; i < iterations; i++)
+    MsgSend(fd, &mmsg, sizeof(mmsg), &mmsg, sizeof(mmsg));
+  ns[2][1] = now_ns() - start;
 
-        } else {
-          p2hpstrip.channel[0].leds[i] = 0x00000000;
-        }
+  close(fd);
+
+  static const char *names[] = {"write", "select", "read"};
+  for (int b = 0; b < 3; b++)
+    printf("gpio %-6s %d pins: per pin %.2f us, one message %.2f us\n",
+           names[b], n, (double)ns[b][0] / iterations / 1000,
+           (double)ns[b][1] / iterations / 1000);
+}
+#endif
+
+void record_tick_jitter(uint64_t late_ns) {
+  clock_stats.ticks++;
+  if (late_ns >= GAME_TICK_NS)
+    clock_stats.late_ticks++;
+  if (late_ns > clock_stats.max_jitter_ns)
+    clock_stats.max_jitter_ns = late_ns;
+
+  uint64_t bucket = late_ns / (JITTER_BUCKET_US * 1000);
+  if (bucket >= JITTER_BUCKETS)
+    bucket = JITTER_BUCKETS - 1;
+  clock_stats.jitter[bucket]++;
+}
+
+void dump_clock_stats() {
+  printf("clock: %lu ticks of %d ms, %lu late, %lu catch-up batches, %lu "
+         "dropped\n",
+         clock_stats.ticks, GAME_CLOCK_DELAY, clock_stats.late_ticks,
+         clock_stats.catchup_batches, clock_stats.dropped_ticks);
+  printf("clock: max tick jitter %llu us\n",
+         (unsigned long long)(clock_stats.max_jitter_ns / 1000));
+  for (int i = 0; i < JITTER_BUCKETS; i++) {
+    if (clock_stats.jitter[i] == 0)
+      continue;
+    if (i == JITTER_BUCKETS - 1)
+      printf("  >= %5d us: %lu\n", i * JITTER_BUCKET_US, clock_stats.jitter[i]);
+    else
+      printf("  %5d-%5d us: %lu\n", i * JITTER_BUCKET_US,
+             (i + 1) * JITTER_BUCKET_US, clock_stats.jitter[i]);
+  }
+}
+
+void stop_running(int signo) { running = 0; }
+
+// fixed timestep loop: every elapsed GAME_CLOCK_DELAY runs one tick, a late
+// wakeup runs the missed ticks back to back, and the result is published to
+// the render thread once per wakeup
+void run_simulation() {
+  uint64_t next_tick = now_ns();
+  InputState input;
+
+  while (running) {
+    uint64_t now = now_ns();
+    int ticks = 0;
+
+    while (next_tick <= now && ticks < MAX_CATCHUP_TICKS) {
+      record_tick_jitter(now - next_tick);
+      read_inputs(&input);
+      if (game_record.file != NULL &&
+          game_record_append(&game_record, input.actions) == -1) {
+        perror("game_record_append, recording stopped");
+        game_record_close(&game_record);
       }
+      GameState prev = game;
+      game_step(&prev, input.actions, &game);
+      game_hash_value = game_hash(game_hash_value, &game);
+      next_tick += GAME_TICK_NS;
+      ticks++;
+    }
 
-      /*ws2811_render(&p2hpstrip);*/
-      p1.hp_dirty = 0;
+    if (ticks > 1)
+      clock_stats.catchup_batches++;
+
+    if (next_tick <= now) {
+      // too far behind, drop the backlog instead of running in slow motion
+      uint64_t behind = (now - next_tick) / GAME_TICK_NS + 1;
+      clock_stats.dropped_ticks += behind;
+      next_tick += behind * GAME_TICK_NS;
     }
 
-    delay(50);
+    if (ticks > 0)
+      publish_snapshot();
+
+    struct timespec wake = {.tv_sec = next_tick / 1000000000,
+                            .tv_nsec = next_tick % 1000000000};
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
   }
 }
 
-void tick(Player *p) {
-  // for all intents and purposes, the game renders instantly, this will make it
-  // much easier
-  if (p->cooldown_ms <= GAME_CLOCK_DELAY) {
-    p->cooldown_ms = 0;
-    p->state = ON_NORMAL_CD;
-  } else {
-    p->cooldown_ms -= GAME_CLOCK_DELAY;
+int main(int argc, char **argv) {
+#if defined(RENDER_BENCH)
+  bench_rings();
+  bench_kernels();
+  bench_game_step();
+  bench_ws2811_encode();
+  bench_spi_batch();
+  bench_gpio_msgs();
+  return EXIT_SUCCESS;
+#endif
+
+  const char *record_path = NULL;
+  while (1) {
+    int opt = getopt(argc, argv, "r:");
+    if (opt == -1) {
+      break;
+    } else if (opt == 'r') {
+      record_path = optarg;
+    } else {
+      fprintf(stderr, "usage: %s [-r recording]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
   }
-}
 
-int main(void) {
   int err = 0;
   screen_context_t screen_context = 0;
   screen_window_t screen_window = 0;
@@ -535,7 +1340,7 @@ int main(void) {
   }
 #endif
 
-  err = screen_create_window_buffers(screen_window, 1);
+  err = screen_create_window_buffers(screen_window, RENDER_BUFFERS);
   if (err != 0) {
     printf("Failed to create window buffer\n");
   }
@@ -547,14 +1352,36 @@ int main(void) {
     printf("Failed to get window buffer size\n");
   }
 
-  screen_buffer_t screen_buf;
+  static SwapChain chain;
+  chain.window = screen_window;
   err = screen_get_window_property_pv(
-      screen_window, SCREEN_PROPERTY_RENDER_BUFFERS, (void **)&screen_buf);
+      screen_window, SCREEN_PROPERTY_RENDER_BUFFERS, (void **)chain.buffers);
   if (err != 0) {
     printf("Failed to get window buffer\n");
   }
 
-  start_game();
+  for (int i = 0; i < RENDER_BUFFERS; i++) {
+    err = screen_get_buffer_property_pv(
+        chain.buffers[i], SCREEN_PROPERTY_POINTER, (void **)&chain.pointers[i]);
+    if (err != 0) {
+      printf("Failed to get buffer pointer\n");
+    }
+
+    err = screen_get_buffer_property_iv(chain.buffers[i],
+                                        SCREEN_PROPERTY_STRIDE,
+                                        &chain.strides[i]);
+    if (err != 0) {
+      printf("Failed to get buffer stride\n");
+    }
+
+    chain.full_repaint[i] = 1;
+  }
+
+  game_reset(&game);
+  // the simulation has no randomness yet, the seed is always 0
+  if (record_path != NULL &&
+      game_record_create(&game_record, record_path, 0) == -1)
+    perror("game_record_create"), exit(EXIT_FAILURE);
 
 #if defined(ENABLE_LED)
   // setup rgb strip memory area
@@ -567,6 +1394,8 @@ int main(void) {
 #endif
 
   setup_gpios();
+  input_reset(&buttons, player_pins);
+  input_init();
 
   // init threads
   nanospin_calibrate(1);
@@ -586,14 +1415,37 @@ int main(void) {
     perror("pthread_create"), exit(EXIT_FAILURE);
 #endif
 
+  // render below the simulation's priority so a slow frame never delays it
+  pthread_attr_t render_attr;
+  pthread_attr_init(&render_attr);
+  pthread_attr_setinheritsched(&render_attr, PTHREAD_EXPLICIT_SCHED);
+
+  int policy;
+  struct sched_param render_sched;
+  pthread_getschedparam(pthread_self(), &policy, &render_sched);
+  render_sched.sched_priority -= 1;
+  pthread_attr_setschedpolicy(&render_attr, policy);
+  pthread_attr_setschedparam(&render_attr, &render_sched);
+
+  pthread_t thr_render;
+  if (pthread_create(&thr_render, &render_attr, render_thread, &chain) != 0)
+    perror("pthread_create"), exit(EXIT_FAILURE);
+
+  signal(SIGINT, stop_running);
+  signal(SIGTERM, stop_running);
+
   /* Trap execution */
-  while (1) {
-    tick(&p1);
-    tick(&p2);
-    render(&screen_buf, &screen_window);
-    handle_inputs();
-    delay(GAME_CLOCK_DELAY);
-  }
+  run_simulation();
+  dump_clock_stats();
+  dump_input_stats();
+#if defined(ENABLE_LED)
+  dump_led_stats("p1hpstrip", &p1hpstrip);
+  dump_led_stats("p2hpstrip", &p2hpstrip);
+#endif
+  printf("game: final tick %lu hash %016llx\n", clock_stats.ticks,
+         (unsigned long long)game_hash_value);
+  if (game_record.file != NULL && game_record_close(&game_record) == -1)
+    perror("game_record_close");
 
   screen_destroy_window(screen_window);
   screen_destroy_context(screen_context);
@@ -0,0 +1,259 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <devctl.h>
+#include "rpi_spi.h"
+
+/*
+ * Runs the real rpi_spi.c against a stand-in io-spi. open() and close() are wrapped at link time
+ * (-Wl,--wrap) so the device nodes map to connections tracked here, and devctlv() fails with ESRCH
+ * on connections opened before the last restart of their device, as io-spi does when restarted.
+ * Meanwhile other files are opened and closed so that fd numbers are reused as fast as possible.
+ */
+
+#define BUSES 2
+#define THREADS_PER_BUS 4
+#define TRANSFERS 25000
+
+// Time between restarts of a device
+#define RESTART_US 200
+
+// Time a transfer spends in devctlv at most, so that restarts and closes land during transfers
+#define TRANSFER_MAX_NS 4000
+
+#define MAX_FDS 1024
+
+static int failures;
+
+#define CHECK(cond)                                                                                                    \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            printf("%s:%d: %s\n", __FILE__, __LINE__, #cond);                                                          \
+            failures++;                                                                                                \
+        }                                                                                                              \
+    } while (0)
+
+typedef struct
+{
+    uint64_t connection;                         //< Connection open on the fd, 0 if none
+    unsigned bus;
+    unsigned device;
+    unsigned generation;                         //< Restarts of the device when it was opened
+} mock_fd_t;
+
+static pthread_mutex_t mock_mutex = PTHREAD_MUTEX_INITIALIZER;
+static mock_fd_t mock_fd[MAX_FDS];
+static unsigned generation[BUSES];               //< Restarts of each bus' device 0
+static uint64_t connections;                     //< Connections opened so far
+static uint64_t open_connections;
+static uint64_t restarts;
+static uint64_t stale;                           //< devctlv calls refused on a stale connection
+static uint64_t misdirected;                     //< devctlv calls on an fd that is not the caller's device
+static uint64_t bad_closes;                      //< close() of an fd that is not open
+
+static atomic_int running;
+
+int __real_open(const char *path, int flags, ...);
+int __real_close(int fd);
+
+int __wrap_open(const char *path, int flags, ...)
+{
+    unsigned bus, device;
+
+    if (sscanf(path, "/dev/io-spi/spi%u/dev%u", &bus, &device) != 2)
+    {
+        return __real_open(path, flags);
+    }
+    if (bus >= BUSES || device != 0)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    // any open file gives the connection an fd number of its own
+    int fd = __real_open("/dev/null", O_RDWR);
+    if (fd < 0 || fd >= MAX_FDS)
+    {
+        printf("fd: out of fd numbers with %llu connections open\nFAILED\n", (unsigned long long)open_connections);
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_lock(&mock_mutex);
+    mock_fd[fd] = (mock_fd_t){++connections, bus, device, generation[bus]};
+    open_connections++;
+    pthread_mutex_unlock(&mock_mutex);
+
+    return fd;
+}
+
+int __wrap_close(int fd)
+{
+    pthread_mutex_lock(&mock_mutex);
+    if (fd >= 0 && fd < MAX_FDS && mock_fd[fd].connection != 0)
+    {
+        mock_fd[fd].connection = 0;
+        open_connections--;
+    }
+    else
+    {
+        bad_closes++;
+    }
+    pthread_mutex_unlock(&mock_mutex);
+
+    return __real_close(fd);
+}
+
+int devctlv(int fd, int dcmd, int sparts, int rparts, const iov_t *sv, const iov_t *rv, int *dev_info_ptr)
+{
+    // exchanges tell the bus they were meant for in their first data byte
+    int bus = dcmd == DCMD_SPI_DATA_XCHNG && sparts > 1 ? ((uint8_t *)sv[1].iov_base)[0] : -1;
+    uint64_t connection = 0;
+    int err = EOK;
+
+    pthread_mutex_lock(&mock_mutex);
+    if (fd < 0 || fd >= MAX_FDS || mock_fd[fd].connection == 0)
+    {
+        misdirected++;
+        err = EBADF;
+    }
+    else if (bus != -1 && mock_fd[fd].bus != bus)
+    {
+        misdirected++;
+        err = EIO;
+    }
+    else if (mock_fd[fd].generation != generation[mock_fd[fd].bus])
+    {
+        stale++;
+        err = ESRCH;
+    }
+    else
+    {
+        connection = mock_fd[fd].connection;
+    }
+    pthread_mutex_unlock(&mock_mutex);
+
+    if (err != EOK)
+    {
+        return err;
+    }
+
+    struct timespec delay = {0, rand() % TRANSFER_MAX_NS};
+    nanosleep(&delay, NULL);
+
+    // the connection must not have been closed, or the fd number handed out again, during the transfer
+    pthread_mutex_lock(&mock_mutex);
+    if (mock_fd[fd].connection != connection)
+    {
+        misdirected++;
+        err = EBADF;
+    }
+    pthread_mutex_unlock(&mock_mutex);
+
+    return err;
+}
+
+static void *transfer_thread(void *arg)
+{
+    uint8_t bus = (uint8_t)(uintptr_t)arg;
+    long failed = 0;
+
+    for (int n = 0; n < TRANSFERS; n++)
+    {
+        uint8_t data[4] = {bus, 1, 2, 3};
+
+        failed += rpi_spi_write_read_data(bus, 0, data, sizeof(data)) != SPI_SUCCESS;
+    }
+
+    return (void *)failed;
+}
+
+// Restarts the devices, invalidating every connection opened so far
+static void *restart_thread(void *arg)
+{
+    while (atomic_load(&running))
+    {
+        struct timespec delay = {0, RESTART_US * 1000};
+        nanosleep(&delay, NULL);
+
+        pthread_mutex_lock(&mock_mutex);
+        for (int bus = 0; bus < BUSES; bus++)
+        {
+            generation[bus]++;
+        }
+        restarts++;
+        pthread_mutex_unlock(&mock_mutex);
+    }
+
+    return NULL;
+}
+
+// Opens and closes other files, so that an fd number closed by rpi_spi is quickly taken again
+static void *reuse_thread(void *arg)
+{
+    while (atomic_load(&running))
+    {
+        int fd = __real_open("/dev/null", O_RDONLY);
+        if (fd >= 0)
+        {
+            sched_yield();
+            __real_close(fd);
+        }
+    }
+
+    return NULL;
+}
+
+int main()
+{
+    pthread_t transfers[BUSES * THREADS_PER_BUS];
+    pthread_t restarter, reuser;
+    long failed = 0;
+
+    atomic_store(&running, 1);
+    pthread_create(&restarter, NULL, restart_thread, NULL);
+    pthread_create(&reuser, NULL, reuse_thread, NULL);
+
+    for (int i = 0; i < BUSES * THREADS_PER_BUS; i++)
+    {
+        pthread_create(&transfers[i], NULL, transfer_thread, (void *)(uintptr_t)(i % BUSES));
+    }
+    for (int i = 0; i < BUSES * THREADS_PER_BUS; i++)
+    {
+        void *result;
+
+        pthread_join(transfers[i], &result);
+        failed += (long)result;
+    }
+
+    atomic_store(&running, 0);
+    pthread_join(restarter, NULL);
+    pthread_join(reuser, NULL);
+
+    for (int bus = 0; bus < BUSES; bus++)
+    {
+        CHECK(rpi_spi_cleanup_device(bus, 0) == SPI_SUCCESS);
+    }
+
+    printf("fd: %d transfers, %ld failed, %llu restarts, %llu connections, %llu stale, %llu misdirected\n",
+           BUSES * THREADS_PER_BUS * TRANSFERS, failed, (unsigned long long)restarts,
+           (unsigned long long)connections, (unsigned long long)stale, (unsigned long long)misdirected);
+
+    // a transfer only fails if its device restarts again between reopening and resending, which is rare
+    CHECK(failed * 100 <= BUSES * THREADS_PER_BUS * TRANSFERS);
+    CHECK(restarts > 0 && stale > 0);
+    CHECK(misdirected == 0);
+    CHECK(bad_closes == 0);
+    CHECK(open_connections == 0);
+
+    printf("%s\n", failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
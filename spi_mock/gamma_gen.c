@@ -0,0 +1,74 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Writes rpi_ws281x/gamma_tables.h to stdout, see the gamma_tables rule of the Makefile
+
+// Prints the 256 entries of a table, per line as many as fit in width columns each
+static void print_table(const char *decl, const long long *values, int per_line, int width)
+{
+    printf("%s[256] = {\n", decl);
+    for (int i = 0; i < 256; i++)
+    {
+        printf("%s%*lld,%s", i % per_line ? " " : "    ", width, values[i],
+               (i + 1) % per_line ? "" : "\n");
+    }
+    printf("};\n");
+}
+
+static void print_gamma(const char *name, double gamma)
+{
+    long long values[256];
+    char decl[64];
+
+    for (int i = 0; i < 256; i++)
+    {
+        values[i] = lround(pow(i / 255.0, gamma) * 255.0);
+    }
+    snprintf(decl, sizeof(decl), "static const uint8_t %s", name);
+    print_table(decl, values, 16, 3);
+}
+
+int main()
+{
+    long long values[256];
+
+    printf("/*\n"
+           " * Lookup tables for ws2811_init_gamma_lookup, generated by spi_mock/gamma_gen.c.\n"
+           " *\n"
+           " * The gamma curves are for the default color correction and temperature (255 on every color),\n"
+           " * out = round(pow(in / 255, gamma) * 255), matching what pow() produced in\n"
+           " * ws2811_init_gamma_lookup. Gamma 1.0 is the identity and needs no table.\n"
+           " */\n"
+           "\n"
+           "#ifndef __WS2811_GAMMA_TABLES_H__\n"
+           "#define __WS2811_GAMMA_TABLES_H__\n"
+           "\n"
+           "#include <stdint.h>\n"
+           "\n");
+
+    print_gamma("gamma_2_2", 2.2);
+    printf("\n");
+    print_gamma("gamma_2_8", 2.8);
+    printf("\n");
+
+    printf("// log2(n) in Q16, for the fixed point gamma generator (log2(0) is unused)\n");
+    values[0] = 0;
+    for (int i = 1; i < 256; i++)
+    {
+        values[i] = llround(log2(i) * 65536.0);
+    }
+    print_table("static const int32_t log2_q16", values, 8, 7);
+    printf("\n");
+
+    printf("// 2^-(n / 256) in Q30, for the fixed point gamma generator\n");
+    for (int i = 0; i < 256; i++)
+    {
+        values[i] = llround(exp2(-i / 256.0) * (1 << 30));
+    }
+    print_table("static const uint32_t exp2_q30", values, 8, 10);
+    printf("\n");
+
+    printf("#endif /* __WS2811_GAMMA_TABLES_H__ */\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,262 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rpi_ws281x.h"
+#include "spi_mock.h"
+
+// Frames rendered in each mode
+#define FRAMES 50
+
+// Gamma factors swept, in hundredths
+#define GAMMA_MIN 1
+#define GAMMA_MAX 1000
+
+// Entries of a gamma table per value, as in rpi_ws281x.c
+#define LED_COLORS 4
+
+// Bus behind each data pin, as wired in rpi_ws281x.c
+static const struct
+{
+    int gpionum;
+    unsigned bus;
+} pins[LED_STRIP_CHANNELS] = {
+    {LED_CHANNEL_0_DATA_PIN, 0},
+    {LED_CHANNEL_1_DATA_PIN, 3},
+    {LED_CHANNEL_2_DATA_PIN, 1},
+};
+
+static const int counts[LED_STRIP_CHANNELS] = {60, 30, 144};
+static const int strip_types[LED_STRIP_CHANNELS] = {WS2811_STRIP_GRB, WS2811_STRIP_RGB, SK6812_STRIP_GRBW};
+
+static uint64_t get_nanosecond_timestamp()
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static void fill(ws2811_t *ws2811, int frame)
+{
+    for (int chan = 0; chan < LED_STRIP_CHANNELS; chan++)
+    {
+        for (int i = 0; i < ws2811->channel[chan].count; i++)
+        {
+            ws2811->channel[chan].leds[i] = (frame * 2654435761u) ^ (chan << 28) ^ (i * 0x01010101u);
+        }
+    }
+}
+
+// Checks the last transfer of a channel's bus is the preamble, its colors and the reset bytes
+static int check_channel(ws2811_t *ws2811, int chan, uint64_t transfers)
+{
+    ws2811_channel_t *channel = &ws2811->channel[chan];
+    const int colors_per_led = channel->strip_type & SK6812_SHIFT_WMASK ? 4 : 3;
+    const int n = channel->count * colors_per_led;
+    const uint8_t shifts[4] = {channel->rshift, channel->gshift, channel->bshift, channel->wshift};
+    uint8_t *colors = malloc(n);
+    uint8_t *expected = malloc(n * 8);
+    spi_mock_device_t device;
+    int ok = 1;
+    int i;
+
+    // brightness 255 and gamma 1.0, the color bytes go out unchanged
+    for (i = 0; i < n; i++)
+    {
+        colors[i] = channel->leds[i / colors_per_led] >> shifts[i % colors_per_led];
+    }
+    ws2811_encode(expected, colors, n, channel->invert);
+
+    spi_mock_get_device(pins[chan].bus, 0, &device);
+    if (device.transfers != transfers)
+    {
+        printf("channel %d: %llu transfers on bus %u, expected %llu\n", chan, (unsigned long long)device.transfers,
+               pins[chan].bus, (unsigned long long)transfers);
+        ok = 0;
+    }
+
+    // every symbol byte has its high bit set, the preamble and reset bytes are zero
+    for (i = 0; i < (int)device.size && device.data[i] == 0; i++)
+    {
+    }
+    if (i + n * 8 > (int)device.size || memcmp(device.data + i, expected, n * 8) != 0)
+    {
+        printf("channel %d: bus %u did not receive the channel's colors\n", chan, pins[chan].bus);
+        ok = 0;
+    }
+    for (i += n * 8; ok && i < (int)device.size; i++)
+    {
+        if (device.data[i] != 0)
+        {
+            printf("channel %d: byte %d after the colors is not zero\n", chan, i);
+            ok = 0;
+        }
+    }
+
+    free(colors);
+    free(expected);
+    return ok;
+}
+
+static int run(int async)
+{
+    ws2811_t ws2811 = {
+        .freq = WS2811_TARGET_FREQ,
+        .async = async,
+    };
+    spi_mock_device_t device;
+    uint64_t longest_ns = 0, sum_ns = 0, frame_ns;
+    int ok = 1;
+
+    for (int chan = 0; chan < LED_STRIP_CHANNELS; chan++)
+    {
+        ws2811.channel[chan].gpionum = pins[chan].gpionum;
+        ws2811.channel[chan].count = counts[chan];
+        ws2811.channel[chan].strip_type = strip_types[chan];
+        ws2811.channel[chan].brightness = 255;
+    }
+
+    spi_mock_reset();
+    ws2811_return_t ret = ws2811_init(&ws2811);
+    if (ret != WS2811_SUCCESS)
+    {
+        printf("ws2811_init: %s\n", ws2811_get_return_t_str(ret));
+        return 0;
+    }
+
+    // sync renders are timed one by one, async ones back to back and coalesced
+    uint64_t begin_ns = get_nanosecond_timestamp();
+    for (int frame = 0; frame < FRAMES; frame++)
+    {
+        fill(&ws2811, frame);
+        ws2811.render_wait_time = 0;
+        ws2811_render(&ws2811);
+    }
+    ws2811_wait(&ws2811);
+    frame_ns = (get_nanosecond_timestamp() - begin_ns) / FRAMES;
+
+    ws2811_stats_t stats;
+    ws2811_get_stats(&ws2811, &stats);
+
+    for (int chan = 0; chan < LED_STRIP_CHANNELS; chan++)
+    {
+        ok &= check_channel(&ws2811, chan, stats.completed);
+
+        spi_mock_get_device(pins[chan].bus, 0, &device);
+        const uint64_t ns = device.end_ns - device.begin_ns;
+        sum_ns += ns;
+        longest_ns = ns > longest_ns ? ns : longest_ns;
+    }
+
+    // the last transfers of all buses must have been on the wire at the same time
+    uint64_t last_begin_ns = 0, first_end_ns = UINT64_MAX;
+    for (int chan = 0; chan < LED_STRIP_CHANNELS; chan++)
+    {
+        spi_mock_get_device(pins[chan].bus, 0, &device);
+        last_begin_ns = device.begin_ns > last_begin_ns ? device.begin_ns : last_begin_ns;
+        first_end_ns = device.end_ns < first_end_ns ? device.end_ns : first_end_ns;
+    }
+    if (last_begin_ns >= first_end_ns)
+    {
+        printf("the buses did not transfer in parallel\n");
+        ok = 0;
+    }
+
+    printf("%s: %llu frames queued, %llu coalesced, %llu sent\n", async ? "async" : "sync",
+           (unsigned long long)stats.queued, (unsigned long long)stats.coalesced,
+           (unsigned long long)stats.completed);
+    printf("%s: longest strip %llu us, all strips %llu us, %llu us per render\n", async ? "async" : "sync",
+           (unsigned long long)longest_ns / 1000, (unsigned long long)sum_ns / 1000,
+           (unsigned long long)frame_ns / 1000);
+
+    ws2811_fini(&ws2811);
+    return ok;
+}
+
+// Color correction and temperature of each channel in each round of the gamma sweep, the first being the default
+static const ws2811_led_t corrections[][2][LED_STRIP_CHANNELS] = {
+    {{0xffffffff, 0x00ffb0f0, 0x80402010}, {0xffffffff, 0xffffffff, 0xfff0e0d0}},
+    {{0x01020304, 0xff7f3f1f, 0xc0c0c0c0}, {0xfefdfcfb, 0x10204080, 0x9f9f9f9f}},
+    {{0x00000000, 0xffff00ff, 0x55aa55aa}, {0xffffffff, 0xff00ffff, 0xaa55aa55}},
+};
+
+// Sweeps the gamma factor over channels with different color correction and temperature. The fixed point tables
+// must be within 1 of the pow() expression they replaced, and the const tables used by default must match it.
+static int check_gamma()
+{
+    static const int shifts[LED_COLORS] = {LED_SHIFT_R, LED_SHIFT_G, LED_SHIFT_B, LED_SHIFT_W};
+    static uint8_t gamma[LED_STRIP_CHANNELS][256 * LED_COLORS];
+    ws2811_t ws2811 = {0};
+    uint64_t values = 0, exact = 0, off = 0, table_off = 0;
+
+    for (int chan = 0; chan < LED_STRIP_CHANNELS; chan++)
+    {
+        ws2811.channel[chan].gamma = gamma[chan];
+    }
+
+    for (int round = 0; round < (int)(sizeof(corrections) / sizeof(corrections[0])); round++)
+    {
+        for (int chan = 0; chan < LED_STRIP_CHANNELS; chan++)
+        {
+            ws2811.channel[chan].color_correction = corrections[round][0][chan];
+            ws2811.channel[chan].color_temperature = corrections[round][1][chan];
+        }
+
+        for (int hundredths = GAMMA_MIN; hundredths <= GAMMA_MAX; hundredths++)
+        {
+            const double gamma_factor = hundredths / 100.0;
+
+            ws2811_set_custom_gamma_factor(&ws2811, gamma_factor);
+
+            for (int chan = 0; chan < LED_STRIP_CHANNELS; chan++)
+            {
+                for (int j = 0; j < LED_COLORS; j++)
+                {
+                    const uint32_t color_factor = ((corrections[round][0][chan] >> shifts[j]) & 0xff) *
+                                                  ((corrections[round][1][chan] >> shifts[j]) & 0xff) / 255;
+                    // the const tables are only used with the default correction and temperature
+                    const int table = color_factor == 255 && (hundredths == 220 || hundredths == 280);
+
+                    for (int x = 0; x < 256; x++)
+                    {
+                        const int expected = (int)(pow((float)color_factor * (float)x / (float)(255.00 * 255.0),
+                                                       gamma_factor) * 255.00 + 0.5);
+                        const int value = gamma[chan][x * LED_COLORS + j];
+
+                        values++;
+                        exact += value == expected;
+                        if (abs(value - expected) > 1 || (table && value != expected))
+                        {
+                            if (off + table_off < 10)
+                            {
+                                printf("gamma %.2f, color factor %u, %d: %d, expected %d\n", gamma_factor,
+                                       color_factor, x, value, expected);
+                            }
+                            off += !table;
+                            table_off += table;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    printf("gamma: %llu values over %.2f to %.2f, %llu exact, %llu off by more than 1, %llu off in const tables\n",
+           (unsigned long long)values, GAMMA_MIN / 100.0, GAMMA_MAX / 100.0, (unsigned long long)exact,
+           (unsigned long long)off, (unsigned long long)table_off);
+    return off == 0 && table_off == 0;
+}
+
+int main()
+{
+    int ok = run(0);
+    ok &= run(1);
+    ok &= check_gamma();
+
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,12 @@
+/*
+ * Host stand-in for the QNX <devctl.h>, devctlv is implemented by fd_check.c.
+ */
+
+#ifndef SPI_MOCK_DEVCTL_H
+#define SPI_MOCK_DEVCTL_H
+
+#include <sys/neutrino.h>
+
+int devctlv(int filedes, int dcmd, int sparts, int rparts, const iov_t *sv, const iov_t *rv, int *dev_info_ptr);
+
+#endif
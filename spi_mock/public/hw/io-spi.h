@@ -0,0 +1,42 @@
+/*
+ * Host stand-in for the QNX <hw/io-spi.h>, only the types and commands rpi_spi.h and rpi_spi.c need.
+ */
+
+#ifndef SPI_MOCK_IO_SPI_H
+#define SPI_MOCK_IO_SPI_H
+
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t mode;
+    uint32_t clock_rate;
+} spi_cfg_t;
+
+typedef struct
+{
+    uint32_t version;
+    char name[16];
+    uint32_t feature;
+} spi_drvinfo_t;
+
+typedef struct
+{
+    uint32_t device;
+    char name[16];
+    spi_cfg_t cfg;
+} spi_devinfo_t;
+
+typedef struct
+{
+    uint32_t nbytes;
+    uint32_t reserved[3];
+    uint8_t data[];
+} spi_xchng_t;
+
+#define DCMD_SPI_SET_CONFIG 0x101
+#define DCMD_SPI_GET_DRVINFO 0x102
+#define DCMD_SPI_GET_DEVINFO 0x103
+#define DCMD_SPI_DATA_XCHNG 0x104
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef SPI_MOCK_H
+#define SPI_MOCK_H
+
+#include <stdint.h>
+
+/*
+ * Host implementation of the rpi_spi API. Each bus/device keeps the last transfer it received
+ * and a transfer takes as long as it would on the wire at the configured clock rate.
+ */
+
+typedef struct spi_mock_device_t
+{
+    uint32_t clock_rate;                         //< Set by rpi_spi_configure_device, 0 if not configured
+    uint64_t transfers;                          //< Number of transfers received
+    uint64_t bytes;                              //< Bytes received over all transfers
+    uint64_t begin_ns;                           //< CLOCK_MONOTONIC start of the last transfer
+    uint64_t end_ns;                             //< CLOCK_MONOTONIC end of the last transfer
+    const uint8_t *data;                         //< Data of the last transfer, valid until the next one
+    uint32_t size;                               //< Size of the last transfer
+} spi_mock_device_t;
+
+/**
+ * Read the state of a mocked SPI device
+ *
+ * @param    bus_number      SPI bus number
+ * @param    device_number   SPI device number
+ * @param    device          device state (output)
+ *
+ * @returns  SPI_SUCCESS on success, SPI_ERROR_BAD_ARGUMENT for an unknown bus/device
+ */
+int spi_mock_get_device(unsigned bus_number, unsigned device_number, spi_mock_device_t *device);
+
+/**
+ * Set the data a mocked SPI device sends back, exchanges read it from the start and get zeros
+ * past its end
+ *
+ * @param    bus_number      SPI bus number
+ * @param    device_number   SPI device number
+ * @param    data            data to read back, copied
+ * @param    size            data size, 0 to read back zeros
+ *
+ * @returns  SPI_SUCCESS on success, SPI_ERROR_BAD_ARGUMENT for an unknown bus/device
+ */
+int spi_mock_set_response(unsigned bus_number, unsigned device_number, const uint8_t *data, uint32_t size);
+
+/**
+ * Forget every transfer, configuration and response
+ *
+ * @returns  None
+ */
+void spi_mock_reset(void);
+
+#endif
@@ -0,0 +1,16 @@
+/*
+ * Host stand-in for the QNX <sys/neutrino.h>, only what rpi_spi.c uses.
+ */
+
+#ifndef SPI_MOCK_NEUTRINO_H
+#define SPI_MOCK_NEUTRINO_H
+
+#include <sys/uio.h>
+
+#define EOK 0
+
+typedef struct iovec iov_t;
+
+#define SETIOV(iov, addr, len) ((iov)->iov_base = (void *)(addr), (iov)->iov_len = (len))
+
+#endif
@@ -0,0 +1,265 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rpi_spi.h"
+#include "spi_mock.h"
+
+// 1 MHz, a byte takes 8 us on the wire
+#define CLOCK_HZ 1000000
+#define SLOW_BYTES 2500
+#define BUS 1
+
+static int failures;
+
+#define CHECK(cond)                                                                                                    \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            printf("%s:%d: %s\n", __FILE__, __LINE__, #cond);                                                          \
+            failures++;                                                                                                \
+        }                                                                                                              \
+    } while (0)
+
+static uint64_t get_nanosecond_timestamp()
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+// Requests complete in order with the results of the synchronous calls
+static void check_order(void)
+{
+    rpi_spi_request_t requests[RPI_SPI_QUEUE_DEPTH];
+    uint8_t data[RPI_SPI_QUEUE_DEPTH][16];
+    spi_mock_device_t device;
+
+    spi_mock_reset();
+    CHECK(rpi_spi_configure_device(BUS, 0, 0, CLOCK_HZ) == SPI_SUCCESS);
+
+    for (int i = 0; i < RPI_SPI_QUEUE_DEPTH; i++)
+    {
+        rpi_spi_request_init(&requests[i]);
+        memset(data[i], i, sizeof(data[i]));
+        CHECK(rpi_spi_write_read_data_async(&requests[i], BUS, 0, data[i], sizeof(data[i]), NULL) == SPI_SUCCESS);
+    }
+    for (int i = 0; i < RPI_SPI_QUEUE_DEPTH; i++)
+    {
+        CHECK(rpi_spi_wait(&requests[i]) == SPI_SUCCESS);
+    }
+
+    spi_mock_get_device(BUS, 0, &device);
+    CHECK(device.transfers == RPI_SPI_QUEUE_DEPTH);
+    CHECK(device.size == 16 && device.data[0] == RPI_SPI_QUEUE_DEPTH - 1);
+
+    // errors come back through the request
+    rpi_spi_request_t request;
+    rpi_spi_request_init(&request);
+    CHECK(rpi_spi_configure_device_async(&request, BUS, 99, 0, CLOCK_HZ, NULL) == SPI_SUCCESS);
+    CHECK(rpi_spi_wait(&request) == SPI_ERROR_NOT_CONNECTED);
+    CHECK(rpi_spi_write_read_data_async(&request, RPI_SPI_MAX_BUSES, 0, data[0], 1, NULL) == SPI_ERROR_BAD_ARGUMENT);
+}
+
+// Submitting does not wait for the bus, a full queue is refused and queued requests can be cancelled
+static void check_queue(void)
+{
+    static uint8_t slow[SLOW_BYTES];
+    rpi_spi_request_t requests[RPI_SPI_QUEUE_DEPTH + 1];
+    uint8_t data[RPI_SPI_QUEUE_DEPTH][4];
+    spi_mock_device_t device;
+
+    spi_mock_reset();
+    CHECK(rpi_spi_configure_device(BUS, 0, 0, CLOCK_HZ) == SPI_SUCCESS);
+    for (int i = 0; i <= RPI_SPI_QUEUE_DEPTH; i++)
+    {
+        rpi_spi_request_init(&requests[i]);
+    }
+
+    // 20 ms on the wire
+    const uint64_t begin_ns = get_nanosecond_timestamp();
+    CHECK(rpi_spi_write_read_data_async(&requests[0], BUS, 0, slow, sizeof(slow), NULL) == SPI_SUCCESS);
+    for (int i = 1; i < RPI_SPI_QUEUE_DEPTH; i++)
+    {
+        CHECK(rpi_spi_write_read_data_async(&requests[i], BUS, 0, data[i], sizeof(data[i]), NULL) == SPI_SUCCESS);
+    }
+    const uint64_t submit_ns = get_nanosecond_timestamp() - begin_ns;
+    CHECK(submit_ns < 5000000);
+
+    CHECK(rpi_spi_write_read_data_async(&requests[RPI_SPI_QUEUE_DEPTH], BUS, 0, data[0], 1, NULL) ==
+          SPI_ERROR_QUEUE_FULL);
+
+    // the worker has picked up the slow write by now
+    struct timespec t = {.tv_nsec = 2000000};
+    nanosleep(&t, NULL);
+    CHECK(rpi_spi_cancel(&requests[0]) == SPI_ERROR_PENDING);
+    CHECK(rpi_spi_cancel(&requests[3]) == SPI_SUCCESS);
+    CHECK(atomic_load(&requests[3].result) == SPI_ERROR_CANCELLED);
+    CHECK(rpi_spi_cancel(&requests[3]) == SPI_ERROR_BAD_ARGUMENT);
+
+    // the cancelled request's slot is free again
+    CHECK(rpi_spi_write_read_data_async(&requests[RPI_SPI_QUEUE_DEPTH], BUS, 0, data[0], 1, NULL) == SPI_SUCCESS);
+
+    for (int i = 0; i <= RPI_SPI_QUEUE_DEPTH; i++)
+    {
+        CHECK(rpi_spi_wait(&requests[i]) == (i == 3 ? SPI_ERROR_CANCELLED : SPI_SUCCESS));
+    }
+    CHECK(rpi_spi_cancel(&requests[0]) == SPI_ERROR_BAD_ARGUMENT);
+
+    spi_mock_get_device(BUS, 0, &device);
+    CHECK(device.transfers == RPI_SPI_QUEUE_DEPTH);
+
+    printf("submitted %d requests behind a %d byte write in %llu us\n", RPI_SPI_QUEUE_DEPTH, SLOW_BYTES,
+           (unsigned long long)submit_ns / 1000);
+}
+
+// Exchanges read the device's response back in place, into a separate buffer or not at all
+static void check_exchange(void)
+{
+    const uint8_t response[3] = {0x01, 0x80, 0x7f};
+    uint8_t data[4] = {0xaa, 0xbb, 0xcc, 0xdd};
+    uint8_t rx[4];
+    spi_mock_device_t device;
+    rpi_spi_request_t request;
+
+    spi_mock_reset();
+    rpi_spi_request_init(&request);
+    CHECK(spi_mock_set_response(BUS, 0, response, sizeof(response)) == SPI_SUCCESS);
+
+    CHECK(rpi_spi_exchange(BUS, 0, data, rx, sizeof(data)) == SPI_SUCCESS);
+    CHECK(memcmp(rx, response, 3) == 0 && rx[3] == 0 && data[0] == 0xaa);
+
+    CHECK(rpi_spi_exchange(BUS, 0, data, NULL, sizeof(data)) == SPI_SUCCESS);
+    CHECK(data[0] == 0xaa);
+
+    CHECK(rpi_spi_write_read_data(BUS, 0, data, sizeof(data)) == SPI_SUCCESS);
+    spi_mock_get_device(BUS, 0, &device);
+    CHECK(device.data[0] == 0xaa && memcmp(data, response, 3) == 0);
+
+    memset(rx, 0xff, sizeof(rx));
+    CHECK(rpi_spi_read_data(BUS, 0, rx, sizeof(rx)) == SPI_SUCCESS);
+    spi_mock_get_device(BUS, 0, &device);
+    CHECK(device.data[0] == 0 && memcmp(rx, response, 3) == 0);
+
+    CHECK(rpi_spi_exchange(BUS, 0, NULL, NULL, 1) == SPI_ERROR_BAD_ARGUMENT);
+
+    memset(rx, 0xff, sizeof(rx));
+    CHECK(rpi_spi_write_read_data_async(&request, BUS, 0, rx, sizeof(rx), NULL) == SPI_SUCCESS);
+    CHECK(rpi_spi_wait(&request) == SPI_SUCCESS);
+    CHECK(memcmp(rx, response, 3) == 0);
+}
+
+// A signal event is queued with the caller's value once the request is done
+static void check_signal(void)
+{
+    rpi_spi_batch_t batch;
+    rpi_spi_request_t request;
+    uint8_t data[8] = {0};
+    struct sigevent event;
+    siginfo_t info;
+    sigset_t set;
+
+    spi_mock_reset();
+    rpi_spi_request_init(&request);
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_SIGNAL;
+    event.sigev_signo = SIGUSR1;
+    event.sigev_value.sival_ptr = &request;
+
+    rpi_spi_batch_init(&batch, BUS);
+    CHECK(rpi_spi_batch_configure(&batch, 0, 0, CLOCK_HZ) == SPI_SUCCESS);
+    CHECK(rpi_spi_batch_write(&batch, 0, 0, data, sizeof(data), 0) == SPI_SUCCESS);
+    CHECK(rpi_spi_batch_submit_async(&request, &batch, &event) == SPI_SUCCESS);
+
+    CHECK(sigwaitinfo(&set, &info) == SIGUSR1);
+    CHECK(info.si_value.sival_ptr == &request);
+    CHECK(atomic_load(&request.result) == SPI_SUCCESS);
+    CHECK(batch.completed == 2);
+
+    event.sigev_notify = SIGEV_THREAD;
+    CHECK(rpi_spi_batch_submit_async(&request, &batch, &event) == SPI_ERROR_BAD_ARGUMENT);
+}
+
+static void *shutdown_thread(void *arg)
+{
+    return (void *)(intptr_t)rpi_spi_async_shutdown(BUS);
+}
+
+// A request still queued or running is not filled again, and cleanup waits for the requests and the bus worker
+static void check_shutdown(void)
+{
+    static uint8_t slow[SLOW_BYTES];
+    rpi_spi_request_t requests[3];
+    uint8_t data[4] = {0};
+    spi_mock_device_t device;
+    pthread_t stopper;
+    void *result;
+
+    spi_mock_reset();
+    CHECK(rpi_spi_configure_device(BUS, 0, 0, CLOCK_HZ) == SPI_SUCCESS);
+    for (int i = 0; i < 3; i++)
+    {
+        rpi_spi_request_init(&requests[i]);
+    }
+
+    // never submitted, there is nothing to wait for
+    CHECK(rpi_spi_wait(&requests[0]) == SPI_ERROR_BAD_ARGUMENT);
+
+    CHECK(rpi_spi_write_read_data_async(&requests[0], BUS, 0, slow, sizeof(slow), NULL) == SPI_SUCCESS);
+    CHECK(rpi_spi_write_read_data_async(&requests[1], BUS, 0, data, sizeof(data), NULL) == SPI_SUCCESS);
+    CHECK(rpi_spi_write_read_data_async(&requests[0], BUS, 0, data, sizeof(data), NULL) == SPI_ERROR_PENDING);
+    CHECK(rpi_spi_configure_device_async(&requests[1], BUS, 0, 0, CLOCK_HZ, NULL) == SPI_ERROR_PENDING);
+    CHECK(requests[0].data == slow && requests[0].size == sizeof(slow));
+
+    // requests are refused while the worker is stopping
+    pthread_create(&stopper, NULL, shutdown_thread, NULL);
+    struct timespec t = {.tv_nsec = 2000000};
+    nanosleep(&t, NULL);
+    CHECK(rpi_spi_write_read_data_async(&requests[2], BUS, 0, data, sizeof(data), NULL) ==
+          SPI_ERROR_OPERATION_FAILED);
+    pthread_join(stopper, &result);
+    CHECK((intptr_t)result == SPI_SUCCESS);
+    CHECK(atomic_load(&requests[0].result) == SPI_SUCCESS);
+    CHECK(atomic_load(&requests[1].result) == SPI_SUCCESS);
+
+    // a new request starts a new worker, and cleanup returns once it is done
+    CHECK(rpi_spi_write_read_data_async(&requests[0], BUS, 0, slow, sizeof(slow), NULL) == SPI_SUCCESS);
+    CHECK(rpi_spi_cleanup_device(BUS, 0) == SPI_SUCCESS);
+    CHECK(atomic_load(&requests[0].result) == SPI_SUCCESS);
+
+    spi_mock_get_device(BUS, 0, &device);
+    CHECK(device.transfers == 3);
+
+    CHECK(rpi_spi_async_shutdown(BUS) == SPI_SUCCESS);
+    CHECK(rpi_spi_async_shutdown(RPI_SPI_MAX_BUSES) == SPI_ERROR_BAD_ARGUMENT);
+}
+
+int main(void)
+{
+    sigset_t set;
+
+    // the bus workers inherit the mask, SIGUSR1 stays pending for sigwaitinfo
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    check_order();
+    check_queue();
+    check_exchange();
+    check_signal();
+    check_shutdown();
+
+    printf("%s\n", failures == 0 ? "ok" : "FAILED");
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
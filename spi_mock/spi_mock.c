@@ -0,0 +1,446 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rpi_spi.h"
+#include "public/spi_mock.h"
+
+#define MAX_SPI_BUSES RPI_SPI_MAX_BUSES
+#define MAX_SPI_BUS_DEVICES 10
+
+typedef struct
+{
+    spi_mock_device_t state;
+    uint8_t *data;
+    uint32_t capacity;
+    uint8_t *buffer[RPI_SPI_BUFFERS];            // handed out by rpi_spi_get_buffer
+    uint8_t *response;                           // read back by exchanges, zeros past its end
+    uint32_t response_size;
+    uint32_t buffer_size[RPI_SPI_BUFFERS];
+} mock_device_t;
+
+static mock_device_t devices[MAX_SPI_BUSES][MAX_SPI_BUS_DEVICES];
+
+// Protects devices, not held while a transfer is on the wire so buses run in parallel
+static pthread_mutex_t devices_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t get_nanosecond_timestamp()
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static mock_device_t *get_device(unsigned bus_number, unsigned device_number)
+{
+    if (bus_number >= MAX_SPI_BUSES || device_number >= MAX_SPI_BUS_DEVICES)
+    {
+        return NULL;
+    }
+
+    return &devices[bus_number][device_number];
+}
+
+int rpi_spi_get_driver_info(unsigned bus_number, unsigned device_number, spi_drvinfo_t *driver_info)
+{
+    if (get_device(bus_number, device_number) == NULL || driver_info == NULL)
+    {
+        return SPI_ERROR_BAD_ARGUMENT;
+    }
+
+    memset(driver_info, 0, sizeof(*driver_info));
+    strcpy(driver_info->name, "spi_mock");
+
+    return SPI_SUCCESS;
+}
+
+int rpi_spi_get_device_info(unsigned bus_number, unsigned device_number, spi_devinfo_t *device_info)
+{
+    mock_device_t *device = get_device(bus_number, device_number);
+
+    if (device == NULL || device_info == NULL)
+    {
+        return SPI_ERROR_BAD_ARGUMENT;
+    }
+
+    memset(device_info, 0, sizeof(*device_info));
+    device_info->device = device_number;
+    strcpy(device_info->name, "spi_mock");
+    pthread_mutex_lock(&devices_mutex);
+    device_info->cfg.clock_rate = device->state.clock_rate;
+    pthread_mutex_unlock(&devices_mutex);
+
+    return SPI_SUCCESS;
+}
+
+int rpi_spi_configure_device(unsigned bus_number, unsigned device_number, unsigned mode, uint32_t spi_device_speed_hz)
+{
+    mock_device_t *device = get_device(bus_number, device_number);
+
+    if (device == NULL)
+    {
+        return SPI_ERROR_NOT_CONNECTED;
+    }
+
+    pthread_mutex_lock(&devices_mutex);
+    device->state.clock_rate = spi_device_speed_hz;
+    pthread_mutex_unlock(&devices_mutex);
+
+    return SPI_SUCCESS;
+}
+
+// Keeps the data of a transfer after holding the caller for its time on the wire
+static int record_transfer(unsigned bus_number, unsigned device_number, const struct iovec *iov, int parts)
+{
+    mock_device_t *device = get_device(bus_number, device_number);
+    uint32_t data_size = 0;
+
+    if (device == NULL)
+    {
+        return SPI_ERROR_NOT_CONNECTED;
+    }
+
+    for (int i = 0; i < parts; i++)
+    {
+        data_size += iov[i].iov_len;
+    }
+
+    if (data_size < 1)
+    {
+        return SPI_ERROR_BAD_ARGUMENT;
+    }
+
+    pthread_mutex_lock(&devices_mutex);
+    const uint32_t clock_rate = device->state.clock_rate;
+    pthread_mutex_unlock(&devices_mutex);
+
+    // hold the caller for as long as the bus would take to shift the data out
+    const uint64_t begin_ns = get_nanosecond_timestamp();
+    if (clock_rate != 0)
+    {
+        const uint64_t wire_ns = (uint64_t)data_size * 8 * 1000000000 / clock_rate;
+        struct timespec t = {.tv_sec = wire_ns / 1000000000, .tv_nsec = wire_ns % 1000000000};
+        nanosleep(&t, NULL);
+    }
+    const uint64_t end_ns = get_nanosecond_timestamp();
+
+    pthread_mutex_lock(&devices_mutex);
+    if (device->capacity < data_size)
+    {
+        uint8_t *data = realloc(device->data, data_size);
+        if (data == NULL)
+        {
+            pthread_mutex_unlock(&devices_mutex);
+            return SPI_ERROR_OPERATION_FAILED;
+        }
+        device->data = data;
+        device->capacity = data_size;
+    }
+    for (int i = 0, offset = 0; i < parts; offset += iov[i].iov_len, i++)
+    {
+        memcpy(device->data + offset, iov[i].iov_base, iov[i].iov_len);
+    }
+    device->state.transfers++;
+    device->state.bytes += data_size;
+    device->state.begin_ns = begin_ns;
+    device->state.end_ns = end_ns;
+    device->state.size = data_size;
+    pthread_mutex_unlock(&devices_mutex);
+
+    return SPI_SUCCESS;
+}
+
+int rpi_spi_write_read_datav(unsigned bus_number, unsigned device_number, const struct iovec *iov, int parts)
+{
+    if (parts < 1 || parts > RPI_SPI_MAX_PARTS)
+    {
+        return SPI_ERROR_BAD_ARGUMENT;
+    }
+
+    return record_transfer(bus_number, device_number, iov, parts);
+}
+
+int rpi_spi_write_read_data(unsigned bus_number, unsigned device_number, uint8_t *data_buffer, uint32_t data_size)
+{
+    return rpi_spi_exchange(bus_number, device_number, data_buffer, data_buffer, data_size);
+}
+
+int rpi_spi_exchange(unsigned bus_number, unsigned device_number, const uint8_t *tx_buffer, uint8_t *rx_buffer,
+                     uint32_t data_size)
+{
+    mock_device_t *device = get_device(bus_number, device_number);
+
+    if (device == NULL)
+    {
+        return SPI_ERROR_NOT_CONNECTED;
+    }
+
+    if (data_size < 1 || (tx_buffer == NULL && rx_buffer == NULL))
+    {
+        return SPI_ERROR_BAD_ARGUMENT;
+    }
+
+    // a read sends zeros
+    if (tx_buffer == NULL)
+    {
+        memset(rx_buffer, 0, data_size);
+        tx_buffer = rx_buffer;
+    }
+
+    struct iovec iov = {.iov_base = (void *)tx_buffer, .iov_len = data_size};
+    int err = record_transfer(bus_number, device_number, &iov, 1);
+    if (err != SPI_SUCCESS || rx_buffer == NULL)
+    {
+        return err;
+    }
+
+    pthread_mutex_lock(&devices_mutex);
+    const uint32_t n = device->response_size < data_size ? device->response_size : data_size;
+    memcpy(rx_buffer, device->response, n);
+    memset(rx_buffer + n, 0, data_size - n);
+    pthread_mutex_unlock(&devices_mutex);
+
+    return SPI_SUCCESS;
+}
+
+int rpi_spi_read_data(unsigned bus_number, unsigned device_number, uint8_t *rx_buffer, uint32_t data_size)
+{
+    return rpi_spi_exchange(bus_number, device_number, NULL, rx_buffer, data_size);
+}
+
+uint8_t *rpi_spi_get_buffer(unsigned bus_number, unsigned device_number, unsigned index, uint32_t data_size)
+{
+    mock_device_t *device = get_device(bus_number, device_number);
+
+    if (device == NULL || index >= RPI_SPI_BUFFERS)
+    {
+        return NULL;
+    }
+
+    if (device->buffer[index] == NULL || device->buffer_size[index] < data_size)
+    {
+        free(device->buffer[index]);
+        device->buffer_size[index] = 0;
+
+        device->buffer[index] = calloc(1, data_size);
+        if (device->buffer[index] == NULL)
+        {
+            return NULL;
+        }
+        device->buffer_size[index] = data_size;
+    }
+
+    return device->buffer[index];
+}
+
+int rpi_spi_write_read_buffer(unsigned bus_number, unsigned device_number, unsigned index, uint32_t data_size)
+{
+    mock_device_t *device = get_device(bus_number, device_number);
+
+    if (device == NULL)
+    {
+        return SPI_ERROR_NOT_CONNECTED;
+    }
+
+    if (index >= RPI_SPI_BUFFERS || data_size < 1 || data_size > device->buffer_size[index])
+    {
+        return SPI_ERROR_BAD_ARGUMENT;
+    }
+
+    // sent in place, nothing is read back into the buffer
+    return rpi_spi_exchange(bus_number, device_number, device->buffer[index], NULL, data_size);
+}
+
+void rpi_spi_batch_init(rpi_spi_batch_t *batch, unsigned bus_number)
+{
+    batch->bus_number = bus_number;
+    batch->count = 0;
+    batch->completed = 0;
+}
+
+static int batch_add(rpi_spi_batch_t *batch, rpi_spi_segment_t segment)
+{
+    if (batch->count == RPI_SPI_BATCH_SEGMENTS || (segment.type != RPI_SPI_SEGMENT_CONFIGURE && segment.size < 1))
+    {
+        return SPI_ERROR_BAD_ARGUMENT;
+    }
+
+    batch->segments[batch->count++] = segment;
+
+    return SPI_SUCCESS;
+}
+
+int rpi_spi_batch_configure(rpi_spi_batch_t *batch, unsigned device_number, unsigned mode, uint32_t spi_device_speed_hz)
+{
+    rpi_spi_segment_t segment = {
+        .type = RPI_SPI_SEGMENT_CONFIGURE, .device_number = device_number, .mode = mode, .speed_hz = spi_device_speed_hz};
+
+    return batch_add(batch, segment);
+}
+
+int rpi_spi_batch_write(rpi_spi_batch_t *batch, unsigned device_number, uint32_t speed_hz, uint8_t *data_buffer,
+                        uint32_t data_size, unsigned flags)
+{
+    rpi_spi_segment_t segment = {.type = RPI_SPI_SEGMENT_WRITE,
+                                 .device_number = device_number,
+                                 .flags = flags,
+                                 .speed_hz = speed_hz,
+                                 .data = data_buffer,
+                                 .size = data_size};
+
+    return batch_add(batch, segment);
+}
+
+int rpi_spi_batch_write_read(rpi_spi_batch_t *batch, unsigned device_number, uint32_t speed_hz, uint8_t *data_buffer,
+                             uint32_t data_size, unsigned flags)
+{
+    rpi_spi_segment_t segment = {.type = RPI_SPI_SEGMENT_WRITE_READ,
+                                 .device_number = device_number,
+                                 .flags = flags,
+                                 .speed_hz = speed_hz,
+                                 .data = data_buffer,
+                                 .size = data_size};
+
+    return batch_add(batch, segment);
+}
+
+// Joined segments are recorded as one transfer, the mock has nothing to read back so write-read
+// segments keep their data
+int rpi_spi_batch_submit(rpi_spi_batch_t *batch)
+{
+    int first = 0;
+
+    batch->completed = 0;
+
+    while (first < batch->count)
+    {
+        rpi_spi_segment_t *segment = &batch->segments[first];
+        struct iovec iov[RPI_SPI_BATCH_SEGMENTS];
+        int last = first;
+        int err;
+
+        if (segment->type == RPI_SPI_SEGMENT_CONFIGURE)
+        {
+            err = rpi_spi_configure_device(batch->bus_number, segment->device_number, segment->mode, segment->speed_hz);
+        }
+        else
+        {
+            while ((batch->segments[last].flags & RPI_SPI_SEGMENT_CS_HOLD) && last + 1 < batch->count)
+            {
+                last++;
+            }
+            for (int i = first; i <= last; i++)
+            {
+                if (batch->segments[i].type == RPI_SPI_SEGMENT_CONFIGURE ||
+                    batch->segments[i].device_number != segment->device_number ||
+                    batch->segments[i].speed_hz != segment->speed_hz)
+                {
+                    return SPI_ERROR_BAD_ARGUMENT;
+                }
+                iov[i - first].iov_base = batch->segments[i].data;
+                iov[i - first].iov_len = batch->segments[i].size;
+            }
+            err = record_transfer(batch->bus_number, segment->device_number, iov, last - first + 1);
+        }
+
+        if (err != SPI_SUCCESS)
+        {
+            return err;
+        }
+
+        first = last + 1;
+        batch->completed = first;
+    }
+
+    return SPI_SUCCESS;
+}
+
+int rpi_spi_cleanup_device(unsigned bus_number, unsigned device_number)
+{
+    mock_device_t *device = get_device(bus_number, device_number);
+
+    if (device == NULL)
+    {
+        return SPI_ERROR_NOT_CONNECTED;
+    }
+
+    // as rpi_spi.c, let the requests queued on the bus finish first
+    rpi_spi_async_shutdown(bus_number);
+
+    for (int index = 0; index < RPI_SPI_BUFFERS; index++)
+    {
+        free(device->buffer[index]);
+        device->buffer[index] = NULL;
+        device->buffer_size[index] = 0;
+    }
+
+    return SPI_SUCCESS;
+}
+
+int spi_mock_get_device(unsigned bus_number, unsigned device_number, spi_mock_device_t *state)
+{
+    mock_device_t *device = get_device(bus_number, device_number);
+
+    if (device == NULL)
+    {
+        return SPI_ERROR_BAD_ARGUMENT;
+    }
+
+    pthread_mutex_lock(&devices_mutex);
+    *state = device->state;
+    state->data = device->data;
+    pthread_mutex_unlock(&devices_mutex);
+
+    return SPI_SUCCESS;
+}
+
+int spi_mock_set_response(unsigned bus_number, unsigned device_number, const uint8_t *data, uint32_t size)
+{
+    mock_device_t *device = get_device(bus_number, device_number);
+    uint8_t *response = NULL;
+
+    if (device == NULL)
+    {
+        return SPI_ERROR_BAD_ARGUMENT;
+    }
+
+    if (size > 0)
+    {
+        response = malloc(size);
+        if (response == NULL)
+        {
+            return SPI_ERROR_OPERATION_FAILED;
+        }
+        memcpy(response, data, size);
+    }
+
+    pthread_mutex_lock(&devices_mutex);
+    free(device->response);
+    device->response = response;
+    device->response_size = size;
+    pthread_mutex_unlock(&devices_mutex);
+
+    return SPI_SUCCESS;
+}
+
+void spi_mock_reset(void)
+{
+    pthread_mutex_lock(&devices_mutex);
+    for (int bus = 0; bus < MAX_SPI_BUSES; bus++)
+    {
+        for (int dev = 0; dev < MAX_SPI_BUS_DEVICES; dev++)
+        {
+            free(devices[bus][dev].data);
+            free(devices[bus][dev].response);
+            for (int index = 0; index < RPI_SPI_BUFFERS; index++)
+            {
+                free(devices[bus][dev].buffer[index]);
+            }
+            memset(&devices[bus][dev], 0, sizeof(devices[bus][dev]));
+        }
+    }
+    pthread_mutex_unlock(&devices_mutex);
+}